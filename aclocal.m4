@@ -1323,11 +1323,13 @@ m4_include([config/ac_msghdr_accrights.m4])
 m4_include([config/ac_netgroup.m4])
 m4_include([config/ac_nodeattr.m4])
 m4_include([config/ac_nodeupdown.m4])
+m4_include([config/ac_output_modules.m4])
 m4_include([config/ac_pam.m4])
 m4_include([config/ac_pollselect.m4])
 m4_include([config/ac_qshell.m4])
 m4_include([config/ac_rcmd_rank_list.m4])
 m4_include([config/ac_readline.m4])
+m4_include([config/ac_zlib.m4])
 m4_include([config/ac_rmsquery.m4])
 m4_include([config/ac_rsh.m4])
 m4_include([config/ac_sdr.m4])
@@ -0,0 +1,42 @@
+##*****************************************************************************
+## $Id$
+##*****************************************************************************
+#  AUTHOR:
+#    Mark Grondona <mgrondona@llnl.gov>
+#
+#  SYNOPSIS:
+#    AC_OUTPUT_MODULES
+#
+#  DESCRIPTION:
+#    Check if user wants to compile the output/files and output/journal
+#    modules
+#
+#  WARNINGS:
+#    This macro must be placed after AC_PROG_CC or equivalent.
+##*****************************************************************************
+
+AC_DEFUN([AC_OUTPUT_MODULES],
+[
+  #
+  # Check for whether to include output modules
+  #
+  AC_MSG_CHECKING([for whether to build output modules])
+  AC_ARG_WITH([output-modules],
+    AC_HELP_STRING([--without-output-modules], 
+                   [Do not build output/files and output/journal modules]),
+    [ case "$withval" in
+        no)  ac_with_output_modules=no ;;
+        yes) ac_with_output_modules=yes ;;
+        *)   AC_MSG_RESULT([doh!])
+             AC_MSG_ERROR([bad value "$withval" for --with-output-modules]) ;;
+      esac
+    ]
+  )
+  AC_MSG_RESULT([${ac_with_output_modules=yes}])
+   
+  if test "$ac_with_output_modules" = "yes"; then
+     ac_have_output_modules=yes
+     AC_ADD_STATIC_MODULE("outfiles")
+     AC_ADD_STATIC_MODULE("outjournal")
+  fi
+])
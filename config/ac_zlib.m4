@@ -0,0 +1,39 @@
+##*****************************************************************************
+## $Id$
+##*****************************************************************************
+#  SYNOPSIS:
+#    AC_ZLIB
+#
+#  DESCRIPTION:
+#    Adds support for --without-zlib. Checks for zlib.h and libz by
+#    default, defines HAVE_ZLIB and exports ZLIB_LIBS if found.
+#
+#  WARNINGS:
+#    This macro must be placed after AC_PROG_CC or equivalent.
+##*****************************************************************************
+
+AC_DEFUN([AC_ZLIB],
+[
+  AC_MSG_CHECKING([for whether to include zlib compression support])
+  AC_ARG_WITH([zlib],
+    AC_HELP_STRING([--without-zlib], [do not use zlib for pdcp compression]),
+      [ case "$withval" in
+        yes) ac_with_zlib=yes ;;
+        no)  ac_with_zlib=no ;;
+        *)   AC_MSG_RESULT([doh!])
+             AC_MSG_ERROR([bad value "$withval" for --with-zlib]) ;;
+      esac
+    ]
+  )
+  AC_MSG_RESULT([${ac_with_zlib=yes}])
+  if test "$ac_with_zlib" = "yes"; then
+      AC_CHECK_HEADER([zlib.h],
+          [AC_CHECK_LIB([z], [compress2], [ac_have_zlib=yes])])
+  fi
+  if test "$ac_have_zlib" = "yes"; then
+      ZLIB_LIBS="-lz"
+      AC_DEFINE([HAVE_ZLIB], [1],
+                [Define if you are compiling with zlib.])
+  fi
+  AC_SUBST(ZLIB_LIBS)
+])
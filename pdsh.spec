@@ -279,6 +279,20 @@ Requires:  torque
 Pdsh module providing support for gathering the list of target nodes
 from an allocated Torque job.
 
+%package   mod-outfiles
+Summary:   Provides per-host output files for pdsh
+Group:     System Environment/Base
+%description mod-outfiles
+Pdsh output module which saves the output of each remote host in
+a separate file. Provides the -D dir option to pdsh.
+
+%package   mod-outjournal
+Summary:   Provides an indexed output journal for pdsh
+Group:     System Environment/Base
+%description mod-outjournal
+Pdsh output module which records the output of all remote hosts
+in a single indexed journal, which may be queried with pdjournal(1).
+Provides the -J file option to pdsh.
 
 
 ##############################################################################
@@ -366,6 +380,7 @@ rm -rf "$RPM_BUILD_ROOT"
 %{_bindir}/pdcp
 %{_bindir}/rpdcp
 %{_bindir}/dshbak
+%{_bindir}/pdjournal
 %dir %{_libdir}/pdsh
 %{_mandir}/man1/*
 ##############################################################################
@@ -454,6 +469,16 @@ rm -rf "$RPM_BUILD_ROOT"
 %endif
 ##############################################################################
 
+%files mod-outfiles
+%defattr(-,root,root)
+%{_libdir}/pdsh/outfiles.*
+##############################################################################
+
+%files mod-outjournal
+%defattr(-,root,root)
+%{_libdir}/pdsh/outjournal.*
+##############################################################################
+
 %if %{?_with_dshgroups:1}%{!?_with_dshgroups:0}
 %files mod-dshgroup
 %defattr(-,root,root)
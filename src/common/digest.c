@@ -0,0 +1,192 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  XXH64, following the reference description by Yann Collet.
+ *   Input is read a byte at a time into little endian words so that
+ *   digests are identical on all architectures.
+ */
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <string.h>
+
+#include "src/common/digest.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t _read64 (const unsigned char *p)
+{
+    return ((uint64_t) p[0]       | (uint64_t) p[1] << 8
+          | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24
+          | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40
+          | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56);
+}
+
+static inline uint32_t _read32 (const unsigned char *p)
+{
+    return ((uint32_t) p[0]       | (uint32_t) p[1] << 8
+          | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+}
+
+static inline uint64_t _round (uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc  = ROTL64 (acc, 31);
+    return (acc * PRIME64_1);
+}
+
+static inline uint64_t _merge_round (uint64_t acc, uint64_t val)
+{
+    acc ^= _round (0, val);
+    return (acc * PRIME64_1 + PRIME64_4);
+}
+
+/*
+ *  Consume one 32 byte stripe.
+ */
+static inline void _stripe (uint64_t v[4], const unsigned char *p)
+{
+    v[0] = _round (v[0], _read64 (p));
+    v[1] = _round (v[1], _read64 (p + 8));
+    v[2] = _round (v[2], _read64 (p + 16));
+    v[3] = _round (v[3], _read64 (p + 24));
+}
+
+void digest_init (struct digest *d)
+{
+    memset (d, 0, sizeof (*d));
+    d->v[0] = PRIME64_1 + PRIME64_2;
+    d->v[1] = PRIME64_2;
+    d->v[2] = 0;
+    d->v[3] = -PRIME64_1;
+}
+
+void digest_update (struct digest *d, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    const unsigned char *end = p + len;
+
+    d->total += len;
+
+    if (d->memlen + len < 32) {
+        memcpy (d->mem + d->memlen, p, len);
+        d->memlen += len;
+        return;
+    }
+
+    if (d->memlen) {
+        size_t n = 32 - d->memlen;
+        memcpy (d->mem + d->memlen, p, n);
+        _stripe (d->v, d->mem);
+        p += n;
+        d->memlen = 0;
+    }
+
+    while (end - p >= 32) {
+        _stripe (d->v, p);
+        p += 32;
+    }
+
+    if (p < end) {
+        memcpy (d->mem, p, end - p);
+        d->memlen = end - p;
+    }
+}
+
+uint64_t digest_final (const struct digest *d)
+{
+    const unsigned char *p = d->mem;
+    const unsigned char *end = p + d->memlen;
+    uint64_t h;
+
+    if (d->total >= 32) {
+        h = ROTL64 (d->v[0], 1)  + ROTL64 (d->v[1], 7)
+          + ROTL64 (d->v[2], 12) + ROTL64 (d->v[3], 18);
+        h = _merge_round (h, d->v[0]);
+        h = _merge_round (h, d->v[1]);
+        h = _merge_round (h, d->v[2]);
+        h = _merge_round (h, d->v[3]);
+    } 
+    else
+        h = d->v[2] + PRIME64_5;
+
+    h += d->total;
+
+    while (end - p >= 8) {
+        h ^= _round (0, _read64 (p));
+        h  = ROTL64 (h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t) _read32 (p) * PRIME64_1;
+        h  = ROTL64 (h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * PRIME64_5;
+        h  = ROTL64 (h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return (h);
+}
+
+uint64_t digest_buf (const void *buf, size_t len)
+{
+    struct digest d;
+    digest_init (&d);
+    digest_update (&d, buf, len);
+    return (digest_final (&d));
+}
+
+void digest_zeros (struct digest *d, uint64_t len)
+{
+    static const unsigned char zeros[4096];
+
+    while (len > 0) {
+        size_t n = len < sizeof (zeros) ? (size_t) len : sizeof (zeros);
+        digest_update (d, zeros, n);
+        len -= n;
+    }
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
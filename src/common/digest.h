@@ -0,0 +1,71 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  64-bit non-cryptographic content digest (XXH64 algorithm).
+ *
+ *  Used to detect identical output from many hosts without comparing
+ *   the output itself. Digests may be computed incrementally with
+ *   digest_init(), digest_update() and digest_final(), and the result
+ *   does not depend on how the input was split between updates.
+ */
+
+#ifndef _DIGEST_H
+#define _DIGEST_H
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <stdint.h>
+
+struct digest {
+    uint64_t      total;        /* total bytes hashed so far               */
+    uint64_t      v[4];         /* accumulators                            */
+    unsigned char mem[32];      /* pending input less than one stripe      */
+    unsigned int  memlen;
+};
+
+void     digest_init   (struct digest *d);
+void     digest_update (struct digest *d, const void *buf, size_t len);
+uint64_t digest_final  (const struct digest *d);
+
+/*
+ *  Digest of a single buffer.
+ */
+uint64_t digest_buf    (const void *buf, size_t len);
+
+/*
+ *  Add `len' zero bytes to the digest, e.g. for holes in a file.
+ */
+void     digest_zeros  (struct digest *d, uint64_t len);
+
+#endif /* !_DIGEST_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -85,6 +85,35 @@ void err_cleanup(void)
     Free((void **) &host);
 }
 
+/*
+ * Growable buffer for _verr_format(). Literal text between conversions
+ * is appended in a single copy rather than a character at a time.
+ */
+struct fmtbuf {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static void _fmt_append(struct fmtbuf *fb, const char *s, size_t n)
+{
+    if (fb->len + n + 1 > fb->size) {
+        while (fb->len + n + 1 > fb->size)
+            fb->size *= 2;
+        Realloc((void **) &fb->buf, fb->size);
+    }
+    memcpy(fb->buf + fb->len, s, n);
+    fb->len += n;
+    fb->buf[fb->len] = '\0';
+}
+
+static void _fmt_appends(struct fmtbuf *fb, const char *s)
+{
+    if (s == NULL)
+        s = "(null)";
+    _fmt_append(fb, s, strlen(s));
+}
+
 /* 
  * _verr() is like vfprintf, but handles (only) the following formats:
  * following formats:
@@ -98,62 +127,107 @@ void err_cleanup(void)
  * %P   program name
  * %H   hostname for this host
  */
-static void _verr(FILE * stream, char *format, va_list ap)
+static char *_verr_format(char *format, va_list ap)
 {
-    char *buf = NULL;
-    char *q;
-    int percent = 0;
-    char tmpstr[LINEBUFSIZE];
-
-    /* Note: snprintf silently truncates if argument exceeds size of tmpstr */
+    struct fmtbuf fb;
+    char *q, *s;
+    char c;
+    char tmpstr[64];
 
     assert(prog != NULL && host != NULL);
-    while (format && *format) { /* iterate thru chars */
-        if (percent == 1) {
-            percent = 0;
-            if (*format == 's') {       /* %s - string */
-                xstrcat(&buf, va_arg(ap, char *));
-            } else if (*format == 'S') {        /* %S - string, trunc */
-                snprintf(tmpstr, sizeof(tmpstr), "%s", va_arg(ap, char *));
-                if (  !isdigit(*tmpstr) 
-                   && !keep_host_domain 
-                   && (q = strchr(tmpstr, '.')))
-                    *q = '\0';
-                xstrcat(&buf, tmpstr);
-            } else if (*format == 'z') {        /* %z - same as %.3d */
-                snprintf(tmpstr, sizeof(tmpstr), "%.3d", va_arg(ap, int));
-                xstrcat(&buf, tmpstr);
-            } else if (*format == 'c') {        /* %c - character */
-                xstrcatchar(&buf, va_arg(ap, int));
-            } else if (*format == 'd') {        /* %d - integer */
-                snprintf(tmpstr, sizeof(tmpstr), "%d", va_arg(ap, int));
-                xstrcat(&buf, tmpstr);
-            } else if (*format == 'm') {        /* %m - error code */
-                xstrerrorcat(&buf);
-            } else if (*format == 'P') {        /* %P - prog name */
-                assert(prog != NULL);
-                xstrcat(&buf, prog);
-            } else if (*format == 'H') {        /* %H - this host */
-                assert(host != NULL);
-                xstrcat(&buf, host);
-            } else if (*format == 'p') {        /* %p - prog@host */
-                assert(prog != NULL);
-                assert(host != NULL);
-                snprintf(tmpstr, sizeof(tmpstr), "%s@%s", prog, host);
-                xstrcat(&buf, tmpstr);
-            } else              /* pass thru */
-                xstrcatchar(&buf, *format);
-        } else if (*format == '%')
-            percent = 1;        /* remember % */
-        else
-            xstrcatchar(&buf, *format); /* pass thru */
+
+    fb.size = 128;
+    fb.len = 0;
+    fb.buf = Malloc(fb.size);
+    fb.buf[0] = '\0';
+
+    while (format && *format) {
+        /* copy literal text up to the next conversion */
+        if ((q = strchr(format, '%')) == NULL) {
+            _fmt_appends(&fb, format);
+            break;
+        }
+        _fmt_append(&fb, format, q - format);
+        format = q + 1;
+
+        switch (c = *format) {
+        case '\0':
+            continue;
+        case 's':       /* %s - string */
+            _fmt_appends(&fb, va_arg(ap, char *));
+            break;
+        case 'S':       /* %S - string, trunc */
+            s = va_arg(ap, char *);
+            if (  s != NULL
+               && !isdigit(*s) 
+               && !keep_host_domain 
+               && (q = strchr(s, '.')))
+                _fmt_append(&fb, s, q - s);
+            else
+                _fmt_appends(&fb, s);
+            break;
+        case 'z':       /* %z - same as %.3d */
+            snprintf(tmpstr, sizeof(tmpstr), "%.3d", va_arg(ap, int));
+            _fmt_appends(&fb, tmpstr);
+            break;
+        case 'c':       /* %c - character */
+            c = (char) va_arg(ap, int);
+            _fmt_append(&fb, &c, 1);
+            break;
+        case 'd':       /* %d - integer */
+            snprintf(tmpstr, sizeof(tmpstr), "%d", va_arg(ap, int));
+            _fmt_appends(&fb, tmpstr);
+            break;
+        case 'm':       /* %m - error code */
+            s = NULL;
+            xstrerrorcat(&s);
+            _fmt_appends(&fb, s);
+            Free((void **) &s);
+            break;
+        case 'P':       /* %P - prog name */
+            _fmt_appends(&fb, prog);
+            break;
+        case 'H':       /* %H - this host */
+            _fmt_appends(&fb, host);
+            break;
+        case 'p':       /* %p - prog@host */
+            _fmt_appends(&fb, prog);
+            _fmt_append(&fb, "@", 1);
+            _fmt_appends(&fb, host);
+            break;
+        default:        /* pass thru */
+            _fmt_append(&fb, format, 1);
+            break;
+        }
         format++;
     }
 
+    return fb.buf;
+}
+
+static void _verr(FILE * stream, char *format, va_list ap)
+{
+    char *buf = _verr_format(format, ap);
+
     fputs(buf, stream);         /* print it */
     Free((void **) &buf);       /* clean up */
 }
 
+/*
+ * Format a string as err() would print it. Caller must Free() result.
+ */
+char *err_format(char *format, ...)
+{
+    va_list ap;
+    char *buf;
+
+    va_start(ap, format);
+    buf = _verr_format(format, ap);
+    va_end(ap);
+
+    return buf;
+}
+
 void err(char *format, ...)
 {
     va_list ap;
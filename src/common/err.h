@@ -36,6 +36,7 @@ void err(char *, ...);
 void out(char *, ...);
 void errx(char *, ...);
 void errf(FILE *, char *, va_list);
+char *err_format(char *, ...);
 void err_cleanup(void);
 
 #endif
@@ -96,6 +96,10 @@
 /* number of elements to allocate when extending the hostlist array */
 #define HOSTLIST_CHUNK    16
 
+/* number of lookups in a hostlist, without changes to it, which pays
+ * for building its index (see hostlist_index_want()) */
+#define HOSTLIST_INDEX_MIN    8
+
 /* max host range: anything larger will be assumed to be an error */
 #define MAX_RANGE    16384    /* 16K Hosts */
 
@@ -171,6 +175,36 @@ struct hostlist {
     /* list of iterators */
     struct hostlist_iterator *ilist;
 
+    /* index of the ranges by prefix, or NULL if not built since
+     * the last change to the list (see hostlist_index_create()) */
+    struct hostlist_index *index;
+
+    /* lookups of hosts since the last change to the list */
+    int nlookups;
+
+};
+
+/* The hostlist index: the ranges of a hostlist sorted by prefix, then 
+ * by lowest suffix, with a hash of each prefix to its run of ranges. 
+ * A host is then found by a binary search of the run for its prefix,
+ * rather than by comparing it with every range in the list.
+ */
+struct hostlist_entry {
+    hostrange_t hr;         /* range hl->hr[idx] */
+    int idx;
+    unsigned long maxhi;    /* greatest `hi' of the run up to here */
+};
+
+struct hostlist_slot {
+    const char *prefix;     /* prefix of the run, or NULL if slot free */
+    int start, end;         /* run of entries with this prefix */
+};
+
+struct hostlist_index {
+    int *pos;               /* number of hosts before each range */
+    struct hostlist_entry *entry;
+    struct hostlist_slot *slot;
+    int nslots;             /* size of hash table, a power of two */
 };
 
 
@@ -250,6 +284,17 @@ static hostlist_t _hostlist_create(const char *, char *, char *);
 static void        hostlist_shift_iterators(hostlist_t, int, int, int);
 static int        _attempt_range_join(hostlist_t, int);
 static int        _is_bracket_needed(hostlist_t, int);
+static void        hostlist_delete_at(hostlist_t, int, int);
+static int         hostlist_delete_hn(hostlist_t, hostname_t);
+static int         hostlist_find_range(hostlist_t, hostname_t, int *, int *);
+static char *     _hostrange_string(hostrange_t, int);
+
+static struct hostlist_index *hostlist_index_create(hostlist_t);
+static void        hostlist_index_destroy(struct hostlist_index *);
+static void        hostlist_index_clear(hostlist_t);
+static void        hostlist_index_want(hostlist_t, int);
+static int         hostlist_index_find(struct hostlist_index *, hostname_t,
+                                       int *);
 
 static hostlist_iterator_t hostlist_iterator_new(void);
 static void               _iterator_advance(hostlist_iterator_t);
@@ -967,6 +1012,12 @@ static int hostrange_hn_within(hostrange_t hr, hostname_t hn)
         return rc;
     }
 
+    /*
+     *  Otherwise the prefixes must be the same: f3 is not in foo[1-5]
+     */
+    if (len_hn != len_hr)
+        return -1;
+
 
     /*
      *  Finally, check whether [hn], with a valid numeric suffix,
@@ -1076,6 +1127,8 @@ static hostlist_t hostlist_new(void)
     new->nranges = 0;
     new->nhosts = 0;
     new->ilist = NULL;
+    new->index = NULL;
+    new->nlookups = 0;
     return new;
 
   fail2:
@@ -1132,6 +1185,7 @@ static int hostlist_push_range(hostlist_t hl, hostrange_t hr)
 
     assert(hr != NULL);
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
 
     tail = (hl->nranges > 0) ? hl->hr[hl->nranges-1] : hl->hr[0];
 
@@ -1193,6 +1247,8 @@ static int hostlist_insert_range(hostlist_t hl, hostrange_t hr, int n)
     if (hl->size == hl->nranges && !hostlist_expand(hl))
         return 0;
 
+    hostlist_index_clear(hl);
+
     /* copy new hostrange into slot "n" in array */
     tmp = hl->hr[n];
     hl->hr[n] = hostrange_copy(hr);
@@ -1226,6 +1282,7 @@ static void hostlist_delete_range(hostlist_t hl, int n)
     assert(hl->magic == HOSTLIST_MAGIC);
     assert(n < hl->nranges && n >= 0);
 
+    hostlist_index_clear(hl);
     old = hl->hr[n];
     for (i = n; i < hl->nranges - 1; i++)
         hl->hr[i] = hl->hr[i + 1];
@@ -1239,6 +1296,285 @@ static void hostlist_delete_range(hostlist_t hl, int n)
     hostrange_destroy(old);
 }
 
+/* Delete the host at offset `offset' of range n from the hostlist,
+ * splitting the range if needed.
+ * Assumes the hostlist lock is already held.
+ */
+static void hostlist_delete_at(hostlist_t hl, int n, int offset)
+{
+    hostrange_t hr = hl->hr[n];
+    hostrange_t new;
+
+    hostlist_index_clear(hl);
+
+    if (hr->singlehost) { /* this wasn't a range */
+        hostlist_delete_range(hl, n);
+    } else if ((new = hostrange_delete_host(hr, hr->lo + offset))) {
+        hostlist_insert_range(hl, new, n + 1);
+        hostrange_destroy(new);
+    } else if (hostrange_empty(hr))
+        hostlist_delete_range(hl, n);
+
+    hl->nhosts--;
+}
+
+/* Find the first range of the hostlist containing the host hn.
+ * Uses the index of the hostlist if it has one, otherwise searches 
+ * the ranges in turn. Returns the index of the range, with the number
+ * of hosts before it in `before', and the offset of hn within it in 
+ * `offset', or -1 if hn is not in the list.
+ * Assumes the hostlist lock is already held.
+ */
+static int hostlist_find_range(hostlist_t hl, hostname_t hn, int *before,
+                               int *offset)
+{
+    int i, count;
+
+    if (hl->index) {
+        if ((i = hostlist_index_find(hl->index, hn, offset)) >= 0)
+            *before = hl->index->pos[i];
+        return i;
+    }
+
+    for (i = 0, count = 0; i < hl->nranges; i++) {
+        if ((*offset = hostrange_hn_within(hl->hr[i], hn)) >= 0) {
+            *before = count;
+            return i;
+        }
+        count += hostrange_count(hl->hr[i]);
+    }
+    return -1;
+}
+
+/* Delete the first host matching hn from the hostlist.
+ * Returns 1 if it was found, otherwise 0.
+ * Assumes the hostlist lock is already held.
+ */
+static int hostlist_delete_hn(hostlist_t hl, hostname_t hn)
+{
+    int i, before, offset;
+
+    if ((i = hostlist_find_range(hl, hn, &before, &offset)) < 0)
+        return 0;
+    hostlist_delete_at(hl, i, offset);
+    return 1;
+}
+
+/* ----[ hostlist index functions ]---- */
+
+/* FNV-1a hash of the first len characters of prefix
+ */
+static unsigned int _prefix_hash(const char *prefix, size_t len)
+{
+    unsigned int h = 2166136261U;
+
+    while (len-- > 0) {
+        h ^= (unsigned char) *prefix++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+/* Sort index entries by prefix, single hosts first, then by lowest
+ * suffix, then by their position in the hostlist.
+ */
+static int _entry_cmp(const void *e1, const void *e2)
+{
+    const struct hostlist_entry *x = e1;
+    const struct hostlist_entry *y = e2;
+    int retval;
+
+    if ((retval = strcmp(x->hr->prefix, y->hr->prefix)) != 0)
+        return retval;
+    if (x->hr->singlehost != y->hr->singlehost)
+        return x->hr->singlehost ? -1 : 1;
+    if (x->hr->lo != y->hr->lo)
+        return x->hr->lo < y->hr->lo ? -1 : 1;
+    return x->idx - y->idx;
+}
+
+/* Return the hash slot of the run of index entries with the prefix 
+ * made of the first len characters of `prefix', or NULL.
+ */
+static struct hostlist_slot *
+_index_slot(struct hostlist_index *x, const char *prefix, size_t len)
+{
+    unsigned int mask = x->nslots - 1;
+    unsigned int i = _prefix_hash(prefix, len) & mask;
+
+    for (; x->slot[i].prefix; i = (i + 1) & mask) {
+        if (strncmp(x->slot[i].prefix, prefix, len) == 0
+            && x->slot[i].prefix[len] == '\0')
+            return &x->slot[i];
+    }
+    return NULL;
+}
+
+/* Build an index of the ranges of hostlist hl, or return NULL if 
+ * out of memory. The index is only valid until hl is changed.
+ * Assumes the hostlist lock is already held.
+ */
+static struct hostlist_index *hostlist_index_create(hostlist_t hl)
+{
+    struct hostlist_index *x;
+    struct hostlist_slot *slot = NULL;
+    int i, count, nprefixes = 0;
+    unsigned int mask;
+
+    if (!(x = malloc(sizeof(*x))))
+        out_of_memory("hostlist index create");
+
+    x->pos = malloc((hl->nranges + 1) * sizeof(int));
+    x->entry = malloc((hl->nranges + 1) * sizeof(struct hostlist_entry));
+    x->slot = NULL;
+    if (!x->pos || !x->entry) {
+        hostlist_index_destroy(x);
+        out_of_memory("hostlist index create");
+    }
+
+    for (i = 0, count = 0; i < hl->nranges; i++) {
+        x->pos[i] = count;
+        count += hostrange_count(hl->hr[i]);
+        x->entry[i].hr = hl->hr[i];
+        x->entry[i].idx = i;
+    }
+    qsort(x->entry, hl->nranges, sizeof(struct hostlist_entry), &_entry_cmp);
+
+    for (i = 0; i < hl->nranges; i++) {
+        struct hostlist_entry *e = &x->entry[i];
+        unsigned long hi = e->hr->singlehost ? 0 : e->hr->hi;
+
+        if (i == 0 || strcmp(e->hr->prefix, e[-1].hr->prefix) != 0) {
+            nprefixes++;
+            e->maxhi = hi;
+        } else
+            e->maxhi = e[-1].maxhi > hi ? e[-1].maxhi : hi;
+    }
+
+    for (x->nslots = 1; x->nslots < 2 * nprefixes; x->nslots <<= 1)
+        ;
+    if (!(x->slot = calloc(x->nslots, sizeof(struct hostlist_slot)))) {
+        hostlist_index_destroy(x);
+        out_of_memory("hostlist index create");
+    }
+    mask = x->nslots - 1;
+
+    for (i = 0; i < hl->nranges; i++) {
+        const char *prefix = x->entry[i].hr->prefix;
+        unsigned int h;
+
+        if (slot && strcmp(slot->prefix, prefix) == 0) {
+            slot->end = i + 1;
+            continue;
+        }
+        h = _prefix_hash(prefix, strlen(prefix)) & mask;
+        while (x->slot[h].prefix)
+            h = (h + 1) & mask;
+        slot = &x->slot[h];
+        slot->prefix = prefix;
+        slot->start = i;
+        slot->end = i + 1;
+    }
+
+    return x;
+}
+
+static void hostlist_index_destroy(struct hostlist_index *x)
+{
+    if (x == NULL)
+        return;
+    free(x->pos);
+    free(x->entry);
+    free(x->slot);
+    free(x);
+}
+
+/* Drop the index of hostlist hl, which is about to change.
+ * Assumes the hostlist lock is already held.
+ */
+static void hostlist_index_clear(hostlist_t hl)
+{
+    hostlist_index_destroy(hl->index);
+    hl->index = NULL;
+    hl->nlookups = 0;
+}
+
+/* Note that n hosts are about to be looked up in hostlist hl, and index
+ * it if enough have been since it last changed. A list which changes
+ * between lookups is searched linearly rather than indexed each time.
+ * Assumes the hostlist lock is already held.
+ */
+static void hostlist_index_want(hostlist_t hl, int n)
+{
+    hl->nlookups += n;
+    if (!hl->index && hl->nlookups >= HOSTLIST_INDEX_MIN)
+        hl->index = hostlist_index_create(hl);
+}
+
+/* Return the index in hl->hr of the first range in hostlist index x
+ * containing hn, with the offset of hn within it in `offset', or -1 if
+ * no range contains hn.
+ */
+static int hostlist_index_find(struct hostlist_index *x, hostname_t hn,
+                               int *offset)
+{
+    struct hostlist_slot *slot;
+    size_t len = strlen(hn->hostname);
+    size_t plen;
+    int best = -1;
+
+    /* a single host range has the whole hostname as its prefix */
+    slot = _index_slot(x, hn->hostname, len);
+    if (slot && x->entry[slot->start].hr->singlehost) {
+        best = x->entry[slot->start].idx;
+        *offset = 0;
+    }
+
+    if (!hostname_suffix_is_valid(hn))
+        return best;
+
+    /*
+     *  The prefix of a range may also take leading digits of the suffix
+     *   of hn, as in f00[1-2] (see hostrange_hn_within()), so try each 
+     *   of them in turn.
+     */
+    for (plen = strlen(hn->prefix); plen < len; plen++) {
+        unsigned long num;
+        int lo, hi, k;
+
+        if (!(slot = _index_slot(x, hn->hostname, plen)))
+            continue;
+        num = strtoul(hn->hostname + plen, NULL, 10);
+
+        /* find the last range of the run starting at or below num */
+        lo = slot->start;
+        hi = slot->end;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (x->entry[mid].hr->lo <= num)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        /* and check back through those which may reach num */
+        for (k = lo - 1; k >= slot->start && x->entry[k].maxhi >= num; k--) {
+            struct hostlist_entry *e = &x->entry[k];
+            int n;
+
+            if (e->hr->singlehost || e->hr->hi < num
+                || (best >= 0 && e->idx > best))
+                continue;
+            if ((n = hostrange_hn_within(e->hr, hn)) >= 0) {
+                best = e->idx;
+                *offset = n;
+            }
+        }
+    }
+
+    return best;
+}
+
 #if WANT_RECKLESS_HOSTRANGE_EXPANSION
 
 /* The reckless hostrange expansion function.
@@ -1593,6 +1929,7 @@ void hostlist_destroy(hostlist_t hl)
     for (i = 0; i < hl->nranges; i++)
         hostrange_destroy(hl->hr[i]);
     free(hl->hr);
+    hostlist_index_destroy(hl->index);
     assert(hl->magic = 0x1);
     UNLOCK_HOSTLIST(hl);
     mutex_destroy(&hl->mutex);
@@ -1666,6 +2003,7 @@ char *hostlist_pop(hostlist_t hl)
     LOCK_HOSTLIST(hl);
     if (hl->nhosts > 0) {
         hostrange_t hr = hl->hr[hl->nranges - 1];
+        hostlist_index_clear(hl);
         host = hostrange_pop(hr);
         hl->nhosts--;
         if (hostrange_empty(hr)) {
@@ -1707,6 +2045,7 @@ char *hostlist_shift(hostlist_t hl)
     if (hl->nhosts > 0) {
         hostrange_t hr = hl->hr[0];
 
+        hostlist_index_clear(hl);
         host = hostrange_shift(hr);
         hl->nhosts--;
 
@@ -1736,6 +2075,7 @@ char *hostlist_pop_range(hostlist_t hl)
         return NULL;
     }
 
+    hostlist_index_clear(hl);
     i = hl->nranges - 2;
     tail = hl->hr[hl->nranges - 1];
     while (i >= 0 && hostrange_within_range(tail, hl->hr[i]))
@@ -1772,6 +2112,7 @@ char *hostlist_shift_range(hostlist_t hl)
         return NULL;
     }
 
+    hostlist_index_clear(hl);
     i = 0;
     do {
         hostlist_push_range(hltmp, hl->hr[i]);
@@ -1797,33 +2138,195 @@ char *hostlist_shift_range(hostlist_t hl)
     return strdup(buf);
 }
 
-/* XXX: Note: efficiency improvements needed */
 int hostlist_delete(hostlist_t hl, const char *hosts)
 {
-    int n = 0;
-    char *hostname = NULL;
+    int n;
     hostlist_t hltmp;
 
     if (!(hltmp = hostlist_create(hosts)))
         seterrno_ret(EINVAL, 0);
 
-    while ((hostname = hostlist_pop(hltmp)) != NULL) {
-        n += hostlist_delete_host(hl, hostname);
-        free(hostname);
-    }
+    n = hostlist_delete_list(hl, hltmp);
     hostlist_destroy(hltmp);
 
     return n;
 }
 
+/* A host to be deleted by hostlist_delete_merge()
+ */
+struct hostlist_del {
+    int idx;        /* range hl->hr[idx] */
+    int offset;     /* offset of the host in the range */
+};
+
+static int _del_cmp(const void *d1, const void *d2)
+{
+    const struct hostlist_del *x = d1;
+    const struct hostlist_del *y = d2;
+
+    if (x->idx != y->idx)
+        return x->idx - y->idx;
+    return x->offset - y->offset;
+}
+
+/* hostname object for the host at `depth' in range hr
+ */
+static hostname_t _hostrange_hn(hostrange_t hr, int depth)
+{
+    char *host = _hostrange_string(hr, depth);
+    hostname_t hn = host ? hostname_create(host) : NULL;
+
+    free(host);
+    return hn;
+}
+
+/* Delete the hosts of dl from hl in one pass: each host is looked up in
+ * the index of hl, then the ranges of hl are rebuilt without the hosts
+ * found. Returns the number of hosts deleted, or -1 if hl has iterators,
+ * which can't follow the ranges, if dl has too few hosts to be worth 
+ * indexing hl, or if memory runs out.
+ * Assumes that both hostlists are locked by the caller.
+ */
+static int hostlist_delete_merge(hostlist_t hl, hostlist_t dl)
+{
+    struct hostlist_del *del;
+    hostrange_t *hr;
+    hostlist_t again = NULL;
+    hostname_t hn;
+    char *host;
+    int i, j, k, size, ndel = 0, nhr = 0, n = 0;
+
+    if (hl->ilist)
+        return -1;
+    hostlist_index_want(hl, dl->nhosts);
+    if (!hl->index)
+        return -1;
+    if (!(del = malloc((dl->nhosts + 1) * sizeof(*del))))
+        return -1;
+    /* each host deleted splits its range in at most two */
+    size = hl->nranges + dl->nhosts + HOSTLIST_CHUNK;
+    if (!(hr = malloc(size * sizeof(hostrange_t)))) {
+        free(del);
+        return -1;
+    }
+
+    for (i = 0; i < dl->nranges; i++) {
+        int count = hostrange_count(dl->hr[i]);
+        for (j = 0; j < count; j++) {
+            if (!(hn = _hostrange_hn(dl->hr[i], j)))
+                continue;
+            k = hostlist_index_find(hl->index, hn, &del[ndel].offset);
+            if (k >= 0)
+                del[ndel++].idx = k;
+            hostname_destroy(hn);
+        }
+    }
+    qsort(del, ndel, sizeof(*del), &_del_cmp);
+
+    for (i = 0, k = 0; i < hl->nranges; i++) {
+        hostrange_t old = hl->hr[i];
+        unsigned long lo = old->lo;
+
+        if (k == ndel || del[k].idx != i) {
+            hr[nhr++] = old;
+            continue;
+        }
+        for (; k < ndel && del[k].idx == i; k++) {
+            if (k > 0 && del[k - 1].idx == i 
+                && del[k - 1].offset == del[k].offset) {
+                /* deleted twice: the next copy of it goes later */
+                if ((again || (again = hostlist_new()))
+                    && (host = _hostrange_string(old, del[k].offset))) {
+                    hostlist_push_host(again, host);
+                    free(host);
+                }
+                continue;
+            }
+            n++;
+            if (!old->singlehost && old->lo + del[k].offset > lo)
+                hr[nhr++] = hostrange_create(old->prefix, lo, 
+                                             old->lo + del[k].offset - 1,
+                                             old->width);
+            lo = old->lo + del[k].offset + 1;
+        }
+        if (!old->singlehost && lo <= old->hi)
+            hr[nhr++] = hostrange_create(old->prefix, lo, old->hi, 
+                                         old->width);
+        hostrange_destroy(old);
+    }
+
+    hostlist_index_clear(hl);
+    for (i = nhr; i < size; i++)
+        hr[i] = NULL;
+    free(hl->hr);
+    hl->hr = hr;
+    hl->size = size;
+    hl->nranges = nhr;
+    hl->nhosts -= n;
+    free(del);
+
+    if (again) {
+        while ((host = hostlist_shift(again))) {
+            if ((hn = hostname_create(host))) {
+                n += hostlist_delete_hn(hl, hn);
+                hostname_destroy(hn);
+            }
+            free(host);
+        }
+        hostlist_destroy(again);
+    }
+
+    return n;
+}
+
+int hostlist_delete_list(hostlist_t hl, hostlist_t dl)
+{
+    hostname_t hn;
+    int i, j, n;
+
+    if (dl == NULL)
+        return 0;
+
+    LOCK_HOSTLIST(dl);
+    LOCK_HOSTLIST(hl);
+
+    if ((n = hostlist_delete_merge(hl, dl)) < 0) {
+        /* one host at a time, in order */
+        n = 0;
+        for (i = 0; i < dl->nranges; i++) {
+            int count = hostrange_count(dl->hr[i]);
+            for (j = 0; j < count; j++) {
+                if ((hn = _hostrange_hn(dl->hr[i], j))) {
+                    n += hostlist_delete_hn(hl, hn);
+                    hostname_destroy(hn);
+                }
+            }
+        }
+    }
+
+    UNLOCK_HOSTLIST(hl);
+    UNLOCK_HOSTLIST(dl);
+
+    return n;
+}
+
 
-/* XXX watch out! poor implementation follows! (fix it at some point) */
 int hostlist_delete_host(hostlist_t hl, const char *hostname)
 {
-    int n = hostlist_find(hl, hostname);
-    if (n >= 0)
-        hostlist_delete_nth(hl, n);
-    return n >= 0 ? 1 : 0;
+    hostname_t hn;
+    int n;
+
+    if (!hostname)
+        return 0;
+
+    hn = hostname_create(hostname);
+
+    LOCK_HOSTLIST(hl);
+    n = hostlist_delete_hn(hl, hn);
+    UNLOCK_HOSTLIST(hl);
+
+    hostname_destroy(hn);
+    return n;
 }
 
 
@@ -1873,30 +2376,18 @@ int hostlist_delete_nth(hostlist_t hl, int n)
 
     for (i = 0; i < hl->nranges; i++) {
         int num_in_range = hostrange_count(hl->hr[i]);
-        hostrange_t hr = hl->hr[i];
 
         if (n <= (num_in_range - 1 + count)) {
-            unsigned long num = hr->lo + n - count;
-            hostrange_t new;
-
-            if (hr->singlehost) { /* this wasn't a range */
-                hostlist_delete_range(hl, i);
-            } else if ((new = hostrange_delete_host(hr, num))) {
-                hostlist_insert_range(hl, new, i + 1);
-                hostrange_destroy(new);
-            } else if (hostrange_empty(hr))
-                hostlist_delete_range(hl, i);
-
-            goto done;
+            hostlist_delete_at(hl, i, n - count);
+            UNLOCK_HOSTLIST(hl);
+            return 1;
         } else
             count += num_in_range;
 
     }
 
-  done:
-    hl->nhosts--;
     UNLOCK_HOSTLIST(hl);
-    return 1;
+    return 0;
 }
 
 int hostlist_count(hostlist_t hl)
@@ -1910,7 +2401,7 @@ int hostlist_count(hostlist_t hl)
 
 int hostlist_find(hostlist_t hl, const char *hostname)
 {
-    int i, count, ret = -1;
+    int before, offset, ret = -1;
     hostname_t hn;
 
     if (!hostname)
@@ -1920,15 +2411,9 @@ int hostlist_find(hostlist_t hl, const char *hostname)
 
     LOCK_HOSTLIST(hl);
 
-    for (i = 0, count = 0; i < hl->nranges; i++) {
-        int offset = hostrange_hn_within(hl->hr[i], hn);
-        if (offset >= 0) {
-            ret = count + offset;
-            break;
-        }
-        else
-            count += hostrange_count(hl->hr[i]);
-    }
+    hostlist_index_want(hl, 1);
+    if (hostlist_find_range(hl, hn, &before, &offset) >= 0)
+        ret = before + offset;
 
     UNLOCK_HOSTLIST(hl);
     hostname_destroy(hn);
@@ -1956,6 +2441,7 @@ void hostlist_sort(hostlist_t hl)
         return;
     }
 
+    hostlist_index_clear(hl);
     qsort(hl->hr, hl->nranges, sizeof(hostrange_t), &_cmp);
 
     /* reset all iterators */
@@ -1977,6 +2463,7 @@ static void hostlist_collapse(hostlist_t hl)
     int i;
 
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
     for (i = hl->nranges - 1; i > 0; i--) {
         hostrange_t hprev = hl->hr[i - 1];
         hostrange_t hnext = hl->hr[i];
@@ -2000,6 +2487,7 @@ static void hostlist_coalesce(hostlist_t hl)
     hostrange_t new;
 
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
 
     for (i = hl->nranges - 1; i > 0; i--) {
 
@@ -2072,6 +2560,7 @@ void hostlist_uniq(hostlist_t hl)
         UNLOCK_HOSTLIST(hl);
         return;
     }
+    hostlist_index_clear(hl);
     qsort(hl->hr, hl->nranges, sizeof(hostrange_t), &_cmp);
 
     while (i < hl->nranges) {
@@ -2201,6 +2690,23 @@ ssize_t hostlist_ranged_string(hostlist_t hl, size_t n, char *buf)
     return truncated ? -1 : len;
 }
 
+char *hostlist_ranged_string_malloc(hostlist_t hl)
+{
+    size_t n = 256;
+    char *buf = malloc(n);
+
+    while (buf && hostlist_ranged_string(hl, n, buf) < 0) {
+        char *new;
+        n *= 2;
+        if (!(new = realloc(buf, n)))
+            free(buf);
+        buf = new;
+    }
+    if (!buf)
+        out_of_memory("hostlist_ranged_string_malloc");
+    return buf;
+}
+
 /* ----[ hostlist iterator functions ]---- */
 
 static hostlist_iterator_t hostlist_iterator_new(void)
@@ -2364,6 +2870,7 @@ int hostlist_remove(hostlist_iterator_t i)
     assert(i != NULL);
     assert(i->magic == HOSTLIST_MAGIC);
     LOCK_HOSTLIST(i->hl);
+    hostlist_index_clear(i->hl);
     new = hostrange_delete_host(i->hr, i->hr->lo + i->depth);
     if (new) {
         hostlist_insert_range(i->hl, new, i->idx + 1);
@@ -2443,6 +2950,7 @@ static int hostset_insert_range(hostset_t set, hostrange_t hr)
     if (hl->size == hl->nranges && !hostlist_expand(hl))
         return 0;
 
+    hostlist_index_clear(hl);
     nhosts = hostrange_count(hr);
 
     for (i = 0; i < hl->nranges; i++) {
@@ -2499,22 +3007,18 @@ int hostset_insert(hostset_t set, const char *hosts)
 }
 
 
-/* linear search through N ranges for hostname "host"
+/* search through the index of the set for hostname "host"
  * */
 static int hostset_find_host(hostset_t set, const char *host)
 {
-    int i;
+    int before, offset;
     int retval = 0;
     hostname_t hn;
     LOCK_HOSTLIST(set->hl);
     hn = hostname_create(host);
-    for (i = 0; i < set->hl->nranges; i++) {
-        if (hostrange_hn_within(set->hl->hr[i], hn) >= 0) {
-            retval = 1;
-            goto done;
-        }
-    }
-  done:
+    hostlist_index_want(set->hl, 1);
+    if (hostlist_find_range(set->hl, hn, &before, &offset) >= 0)
+        retval = 1;
     UNLOCK_HOSTLIST(set->hl);
     hostname_destroy(hn);
     return retval;
@@ -220,6 +220,17 @@ int hostlist_find(hostlist_t hl, const char *hostname);
 int hostlist_delete(hostlist_t hl, const char *hosts);
 
 
+/* hostlist_delete_list():
+ *
+ * Deletes the first host that matches each host of hostlist dl from
+ * the hostlist hl (which must be a different list), in one pass over
+ * hl rather than one for each host.
+ *
+ * Returns the number of hosts successfully deleted
+ */
+int hostlist_delete_list(hostlist_t hl, hostlist_t dl);
+
+
 /* hostlist_delete_host():
  *
  * Deletes the first host that matches `hostname' from the hostlist hl.
@@ -283,6 +294,13 @@ void hostlist_uniq(hostlist_t hl);
 ssize_t hostlist_ranged_string(hostlist_t hl, size_t n, char *buf);
 ssize_t hostset_ranged_string(hostset_t hs, size_t n, char *buf);
 
+/* hostlist_ranged_string_malloc():
+ *
+ * Return the bracketed string representation of the hostlist hl in
+ * a buffer allocated with malloc(), which the caller must free().
+ */
+char *hostlist_ranged_string_malloc(hostlist_t hl);
+
 /* hostlist_deranged_string():
  *
  * Writes the string representation of the hostlist hl into buf,
@@ -100,6 +100,7 @@ struct pdsh_module pdsh_module_info = {
   &dshgroup_module_ops,
   &dshgroup_rcmd_ops,
   &dshgroup_module_options[0],
+  NULL,
 };
 
 static int dshgroup_process_opt(opt_t *pdsh_opt, int opt, char *arg)
@@ -190,16 +191,7 @@ static hostlist_t read_groupfile(opt_t *opt)
 static int
 _delete_all (hostlist_t hl, hostlist_t dl)
 {
-    int                 rc   = 0;
-    char *              host = NULL;
-    hostlist_iterator_t i    = hostlist_iterator_create (dl);
-
-    while ((host = hostlist_next (i))) {
-        rc += hostlist_delete_host (hl, host);
-        free (host);
-    }
-    hostlist_iterator_destroy (i);
-    return (rc);
+    return (hostlist_delete_list (hl, dl));
 }
 
 static int dshgroup_postop (opt_t *opt)
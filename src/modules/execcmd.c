@@ -112,6 +112,7 @@ struct pdsh_module pdsh_module_info = {
   &execcmd_module_ops,
   &execcmd_rcmd_ops,
   &execcmd_module_options[0],
+  NULL,
 };
 
 
@@ -144,6 +144,7 @@ struct pdsh_module pdsh_module_info = {
     &genders_module_ops,
     &genders_rcmd_ops,
     &genders_module_options[0],
+    NULL,
 };
 
 /*
@@ -665,16 +666,7 @@ register_genders_rcmd_types (opt_t *opt)
 static int 
 _delete_all (hostlist_t hl, hostlist_t dl)
 {
-    int                 rc   = 0;
-    char *              host = NULL;
-    hostlist_iterator_t i    = hostlist_iterator_create (dl);
-
-    while ((host = hostlist_next (i))) {
-        rc += hostlist_delete_host (hl, host);
-        free (host);
-    }
-    hostlist_iterator_destroy (i);
-    return (rc);
+    return (hostlist_delete_list (hl, dl));
 }
 
 /*
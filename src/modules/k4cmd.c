@@ -146,6 +146,7 @@ struct pdsh_module pdsh_module_info = {
     &k4cmd_module_ops,
     &k4cmd_rcmd_ops,
     &k4cmd_module_options[0],
+    NULL,
 };
 
 static int k4cmd_init(opt_t * opt)
@@ -85,6 +85,7 @@ struct pdsh_module pdsh_module_info = {
   &machines_module_ops,
   &machines_rcmd_ops,
   &machines_module_options[0],
+  NULL,
 };
 
 static int machines_opt_a(opt_t *pdsh_opt, int opt, char *arg)
@@ -197,6 +197,7 @@ struct pdsh_module pdsh_module_info = {
     &mcmd_module_ops,
     &mcmd_rcmd_ops,
     &mcmd_module_options[0],
+    NULL,
 };
 
 static int
@@ -215,6 +215,7 @@ struct pdsh_module pdsh_module_info = {
     &mqcmd_module_ops,
     &mqcmd_rcmd_ops,
     &mqcmd_module_options[0],
+    NULL,
 };
 
 static int
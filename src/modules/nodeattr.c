@@ -131,6 +131,7 @@ struct pdsh_module pdsh_module_info = {
   &nodeattr_module_ops,
   NULL,
   &nodeattr_module_options[0],
+  NULL,
 };
 
 
@@ -314,16 +315,7 @@ _read_genders (List attrs, int iopt)
 static int 
 _delete_all (hostlist_t hl, hostlist_t dl)
 {
-    int                 rc   = 0;
-    char *              host = NULL;
-    hostlist_iterator_t i    = hostlist_iterator_create (dl);
-
-    while ((host = hostlist_next (i))) {
-        rc += hostlist_delete_host (hl, host);
-        free (host);
-    }
-    hostlist_iterator_destroy (i);
-    return (rc);
+    return (hostlist_delete_list (hl, dl));
 }
 
 /*
@@ -95,6 +95,7 @@ struct pdsh_module pdsh_module_info = {
   &nodeupdown_module_ops,
   &nodeupdown_rcmd_ops,
   &nodeupdown_module_options[0],
+  NULL,
 };
 
 static int nodeupdown_opt_v(opt_t *pdsh_opt, int opt, char *arg)
@@ -0,0 +1,289 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  "output/files" module: write the output of each host to a 
+ *   separate file in a directory given with -D dir. Stdout of
+ *   host "foo" is appended to dir/foo, and stderr (if any) to
+ *   dir/foo.err.  This is equivalent to `pdsh ... | dshbak -d dir`
+ *   without a second pass over the output stream.
+ *
+ *  Files are opened with O_APPEND and output is accumulated per host
+ *   and stream, so that each write(2) carries up to OUTFILES_BUFSIZ
+ *   bytes of output.
+ */
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include "src/common/err.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/common/fd.h"
+#include "src/pdsh/mod.h"
+#include "src/pdsh/output.h"
+
+#if STATIC_MODULES
+#  define pdsh_module_info outfiles_module_info
+#  define pdsh_module_priority outfiles_module_priority
+#endif
+
+#define OUTFILES_BUFSIZ 65536
+
+int pdsh_module_priority = DEFAULT_MODULE_PRIORITY;
+
+static int outfiles_opt_D (opt_t *, int, char *);
+static int outfiles_init (opt_t *);
+static void * outfiles_start (const char *, int);
+static int outfiles_line (void *, int, const char *, int);
+static int outfiles_exit (void *, int, bool);
+
+static char *outdir = NULL;
+
+struct outfile {
+    char *path;
+    int   fd;
+    int   len;
+    char  buf[OUTFILES_BUFSIZ];
+};
+
+struct outfiles_host {
+    char *         host;
+    struct outfile out;
+    struct outfile err;
+};
+
+/*
+ *  Export generic pdsh module operations
+ */
+struct pdsh_module_operations outfiles_module_ops = {
+    (ModInitF)       NULL,
+    (ModExitF)       NULL,
+    (ModReadWcollF)  NULL,
+    (ModPostOpF)     NULL,
+};
+
+/*
+ *  Export output module operations
+ */
+struct pdsh_output_operations outfiles_output_ops = {
+    (OutputInitF)    outfiles_init,
+    (OutputStartF)   outfiles_start,
+    (OutputLineF)    outfiles_line,
+    (OutputDataF)    NULL,
+    (OutputExitF)    outfiles_exit,
+    (OutputFiniF)    NULL,
+};
+
+/*
+ *  Export module options
+ */
+struct pdsh_module_option outfiles_module_options[] =
+ { { 'D', "dir", "write output of each host to a file in directory \"dir\"",
+     DSH, (optFunc) outfiles_opt_D },
+   PDSH_OPT_TABLE_END
+ };
+
+/*
+ *  Outfiles module info
+ */
+struct pdsh_module pdsh_module_info = {
+  "output",
+  "files",
+  "Mark Grondona <mgrondona@llnl.gov>",
+  "Write output of each host to a separate file",
+  DSH,
+
+  &outfiles_module_ops,
+  NULL,
+  &outfiles_module_options[0],
+  &outfiles_output_ops,
+};
+
+static int outfiles_opt_D (opt_t *pdsh_opts, int opt, char *arg)
+{
+    if (outdir)
+        Free ((void **) &outdir);
+    outdir = Strdup (arg);
+    return (0);
+}
+
+static int outfiles_init (opt_t *opt)
+{
+    struct stat st;
+
+    if (outdir == NULL)
+        return (0);
+
+    if ((mkdir (outdir, 0755) < 0) && (errno != EEXIST)) {
+        err ("%p: Unable to create output directory \"%s\": %m\n", outdir);
+        return (-1);
+    }
+
+    if ((stat (outdir, &st) < 0) || !S_ISDIR (st.st_mode)) {
+        err ("%p: Output path \"%s\" is not a directory\n", outdir);
+        return (-1);
+    }
+
+    return (1);
+}
+
+static void outfile_init (struct outfile *f, const char *host, 
+                          const char *suffix)
+{
+    f->path = NULL;
+    xstrcat (&f->path, outdir);
+    xstrcat (&f->path, "/");
+    xstrcat (&f->path, (char *) host);
+    if (suffix)
+        xstrcat (&f->path, (char *) suffix);
+    f->fd = -1;
+    f->len = 0;
+}
+
+static int outfile_open (struct outfile *f)
+{
+    if (f->fd >= 0)
+        return (0);
+
+    f->fd = open (f->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (f->fd < 0) {
+        err ("%p: open %s: %m\n", f->path);
+        return (-1);
+    }
+    fd_set_close_on_exec (f->fd);
+    return (0);
+}
+
+static int outfile_write (struct outfile *f, const char *buf, int len)
+{
+    if (outfile_open (f) < 0)
+        return (-1);
+
+    if (fd_write_n (f->fd, (void *) buf, len) < 0) {
+        err ("%p: write %s: %m\n", f->path);
+        return (-1);
+    }
+    return (0);
+}
+
+static int outfile_flush (struct outfile *f)
+{
+    int rc = 0;
+
+    if (f->len > 0)
+        rc = outfile_write (f, f->buf, f->len);
+    f->len = 0;
+    return (rc);
+}
+
+static int outfile_append (struct outfile *f, const char *buf, int len)
+{
+    if (f->len + len > OUTFILES_BUFSIZ) {
+        if (outfile_flush (f) < 0)
+            return (-1);
+        /*
+         *  Don't bother copying data that would fill the buffer anyway
+         */
+        if (len >= OUTFILES_BUFSIZ)
+            return (outfile_write (f, buf, len));
+    }
+
+    memcpy (f->buf + f->len, buf, len);
+    f->len += len;
+    return (0);
+}
+
+static void outfile_close (struct outfile *f)
+{
+    if (f->fd >= 0)
+        close (f->fd);
+    f->fd = -1;
+    Free ((void **) &f->path);
+}
+
+static void * outfiles_start (const char *host, int nodeid)
+{
+    struct outfiles_host *h = Malloc (sizeof (*h));
+
+    h->host = Strdup (host);
+    outfile_init (&h->out, host, NULL);
+    outfile_init (&h->err, host, ".err");
+
+    /*
+     *  Always create the stdout file so that every host that was
+     *   run has an entry in the output directory. The stderr file
+     *   is only created if there is something to write to it.
+     */
+    if (outfile_open (&h->out) < 0) {
+        outfile_close (&h->out);
+        outfile_close (&h->err);
+        Free ((void **) &h->host);
+        Free ((void **) &h);
+        return (NULL);
+    }
+
+    return (h);
+}
+
+static int outfiles_line (void *arg, int stream, const char *buf, int len)
+{
+    struct outfiles_host *h = arg;
+
+    if (stream == OUTPUT_STDERR)
+        return (outfile_append (&h->err, buf, len));
+    return (outfile_append (&h->out, buf, len));
+}
+
+static int outfiles_exit (void *arg, int rc, bool failed)
+{
+    struct outfiles_host *h = arg;
+    int retval = 0;
+
+    if (outfile_flush (&h->out) < 0 || outfile_flush (&h->err) < 0)
+        retval = -1;
+
+    outfile_close (&h->out);
+    outfile_close (&h->err);
+    Free ((void **) &h->host);
+    Free ((void **) &h);
+
+    return (retval);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
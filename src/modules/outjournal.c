@@ -0,0 +1,460 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  "output/journal" module: record the output of all hosts in an
+ *   append-only journal given with -J file.
+ *
+ *  The journal ("file") is a log of records. Output of each host is
+ *   accumulated into chunks of up to JOURNAL_CHUNKSIZ bytes, which are
+ *   appended to the log along with a pointer to the previous chunk
+ *   written for the same host. When a host finishes, a record with the
+ *   host name is appended to the log, and a fixed size entry pointing
+ *   at the host's last chunk and name is appended to the index file
+ *   ("file.idx").  The output of one host can thus be recovered by
+ *   walking its chain of chunks without reading the rest of the log.
+ *
+ *  A digest of each stream is kept as output arrives, so that hosts
+ *   with identical output can be found from the index alone. At exit,
+ *   a hash table of host names is appended to the index. See
+ *   src/pdsh/journal.h for the file format.
+ */
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include "src/common/err.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/common/fd.h"
+#include "src/common/digest.h"
+#include "src/pdsh/mod.h"
+#include "src/pdsh/output.h"
+#include "src/pdsh/journal.h"
+
+#if STATIC_MODULES
+#  define pdsh_module_info outjournal_module_info
+#  define pdsh_module_priority outjournal_module_priority
+#endif
+
+#define JOURNAL_CHUNKSIZ    65536
+
+int pdsh_module_priority = DEFAULT_MODULE_PRIORITY;
+
+static int journal_opt_J (opt_t *, int, char *);
+static int journal_init (opt_t *);
+static void * journal_start (const char *, int);
+static int journal_line (void *, int, const char *, int);
+static int journal_data (void *, int, const char *, int);
+static int journal_exit (void *, int, bool);
+static int journal_fini (void);
+
+struct journal_host {
+    char *   host;
+    uint32_t hostid;
+    uint64_t last;
+    uint64_t nbytes;
+    uint64_t nlines;
+    struct digest digest[2];    /* running digests of stdout and stderr    */
+    int      stream;            /* stream of buffered data                 */
+    int      len;
+    char     buf[JOURNAL_CHUNKSIZ];
+};
+
+static char *journal_path = NULL;
+static int journal_fd = -1;
+static int index_fd = -1;
+static uint64_t journal_off = 0;
+static uint64_t *name_hashes = NULL;   /* host name digest of each entry  */
+static uint32_t nentries = 0;
+static uint32_t maxentries = 0;
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  Export generic pdsh module operations
+ */
+struct pdsh_module_operations journal_module_ops = {
+    (ModInitF)       NULL,
+    (ModExitF)       NULL,
+    (ModReadWcollF)  NULL,
+    (ModPostOpF)     NULL,
+};
+
+/*
+ *  Export output module operations
+ */
+struct pdsh_output_operations journal_output_ops = {
+    (OutputInitF)    journal_init,
+    (OutputStartF)   journal_start,
+    (OutputLineF)    journal_line,
+    (OutputDataF)    journal_data,
+    (OutputExitF)    journal_exit,
+    (OutputFiniF)    journal_fini,
+};
+
+/*
+ *  Export module options
+ */
+struct pdsh_module_option journal_module_options[] =
+ { { 'J', "file", "record output of all hosts in journal \"file\"",
+     DSH, (optFunc) journal_opt_J },
+   PDSH_OPT_TABLE_END
+ };
+
+/*
+ *  Journal module info
+ */
+struct pdsh_module pdsh_module_info = {
+  "output",
+  "journal",
+  "Mark Grondona <mgrondona@llnl.gov>",
+  "Record output of all hosts in an indexed journal",
+  DSH,
+
+  &journal_module_ops,
+  NULL,
+  &journal_module_options[0],
+  &journal_output_ops,
+};
+
+static int journal_opt_J (opt_t *pdsh_opts, int opt, char *arg)
+{
+    if (journal_path)
+        Free ((void **) &journal_path);
+    journal_path = Strdup (arg);
+    return (0);
+}
+
+static int _create (const char *path)
+{
+    int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        err ("%p: journal: open %s: %m\n", path);
+        return (-1);
+    }
+    fd_set_close_on_exec (fd);
+    return (fd);
+}
+
+static int journal_init (opt_t *opt)
+{
+    struct journal_header hdr;
+    struct journal_index_header ihdr;
+    char *idx = NULL;
+
+    if (journal_path == NULL)
+        return (0);
+
+    xstrcat (&idx, journal_path);
+    xstrcat (&idx, ".idx");
+
+    if ((journal_fd = _create (journal_path)) < 0 
+       || (index_fd = _create (idx)) < 0) {
+        Free ((void **) &idx);
+        return (-1);
+    }
+    Free ((void **) &idx);
+
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, JOURNAL_MAGIC, sizeof (hdr.magic));
+    hdr.version = JOURNAL_VERSION;
+    hdr.ctime = (int64_t) time (NULL);
+
+    memset (&ihdr, 0, sizeof (ihdr));
+    memcpy (ihdr.magic, JOURNAL_IDX_MAGIC, sizeof (ihdr.magic));
+    ihdr.version = JOURNAL_VERSION;
+    ihdr.entry_size = sizeof (struct journal_index_entry);
+
+    if (fd_write_n (journal_fd, &hdr, sizeof (hdr)) < 0
+       || fd_write_n (index_fd, &ihdr, sizeof (ihdr)) < 0) {
+        err ("%p: journal: write %s: %m\n", journal_path);
+        return (-1);
+    }
+    journal_off = sizeof (hdr);
+
+    return (1);
+}
+
+/*
+ *  Append a record and its data to the log. Returns the offset
+ *   of the record, or 0 on failure. Must be called with 
+ *   journal_mutex held.
+ */
+static uint64_t _append_record (struct journal_record *rec, const void *data)
+{
+    static const char pad[8] = { 0 };
+    struct iovec iov[3];
+    uint64_t off = journal_off;
+    int padlen = (8 - (rec->len & 7)) & 7;
+    size_t total = sizeof (*rec) + rec->len + padlen;
+    ssize_t n;
+
+    iov[0].iov_base = rec;
+    iov[0].iov_len  = sizeof (*rec);
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len  = rec->len;
+    iov[2].iov_base = (void *) pad;
+    iov[2].iov_len  = padlen;
+
+    /*
+     *  Regular file writes are not expected to be short, so treat
+     *   a short write as failure rather than trying to resume.
+     */
+    while ((n = writev (journal_fd, iov, 3)) < 0 && errno == EINTR)
+        ;
+    if (n != (ssize_t) total) {
+        err ("%p: journal: write %s: %m\n", journal_path);
+        return (0);
+    }
+
+    journal_off += total;
+    return (off);
+}
+
+static int _flush_chunk (struct journal_host *h)
+{
+    struct journal_record rec;
+    uint64_t off;
+
+    if (h->len == 0)
+        return (0);
+
+    memset (&rec, 0, sizeof (rec));
+    rec.type = JOURNAL_REC_DATA;
+    rec.hostid = h->hostid;
+    rec.stream = h->stream;
+    rec.len = h->len;
+    rec.prev = h->last;
+
+    pthread_mutex_lock (&journal_mutex);
+    off = _append_record (&rec, h->buf);
+    pthread_mutex_unlock (&journal_mutex);
+
+    h->len = 0;
+    if (off == 0)
+        return (-1);
+    h->last = off;
+    return (0);
+}
+
+static void * journal_start (const char *host, int nodeid)
+{
+    struct journal_host *h = Malloc (sizeof (*h));
+
+    h->host = Strdup (host);
+    h->hostid = nodeid;
+    h->last = 0;
+    h->nbytes = 0;
+    h->nlines = 0;
+    digest_init (&h->digest[0]);
+    digest_init (&h->digest[1]);
+    h->stream = OUTPUT_STDOUT;
+    h->len = 0;
+
+    return (h);
+}
+
+static int journal_data (void *arg, int stream, const char *buf, int len)
+{
+    struct journal_host *h = arg;
+
+    h->nbytes += len;
+    digest_update (&h->digest[stream == OUTPUT_STDERR], buf, len);
+
+    while (len > 0) {
+        int n;
+
+        /*
+         *  A chunk holds data from only one stream
+         */
+        if ((h->len > 0 && h->stream != stream) 
+           || (h->len == JOURNAL_CHUNKSIZ)) {
+            if (_flush_chunk (h) < 0)
+                return (-1);
+        }
+        h->stream = stream;
+
+        n = MIN (len, JOURNAL_CHUNKSIZ - h->len);
+        memcpy (h->buf + h->len, buf, n);
+        h->len += n;
+        buf += n;
+        len -= n;
+    }
+
+    return (0);
+}
+
+static int journal_line (void *arg, int stream, const char *buf, int len)
+{
+    struct journal_host *h = arg;
+    h->nlines++;
+    return (journal_data (arg, stream, buf, len));
+}
+
+/*
+ *  Remember digest of host name for index entry `nentries'. 
+ *   Must be called with journal_mutex held.
+ */
+static void _add_name_hash (uint64_t hash)
+{
+    if (nentries == maxentries) {
+        maxentries = maxentries ? 2 * maxentries : 256;
+        if (name_hashes == NULL)
+            name_hashes = Malloc (maxentries * sizeof (uint64_t));
+        else
+            Realloc ((void **) &name_hashes, maxentries * sizeof (uint64_t));
+    }
+    name_hashes[nentries++] = hash;
+}
+
+/*
+ *  Append hash table of host names and trailer to the index.
+ */
+static int _write_trailer (void)
+{
+    struct journal_trailer t;
+    uint32_t nbuckets = 2;      /* keeps trailer 8 byte aligned            */
+    uint32_t *table;
+    uint32_t i;
+    int rc = 0;
+
+    while (nbuckets < 2 * nentries)
+        nbuckets <<= 1;
+
+    table = Malloc (nbuckets * sizeof (uint32_t));
+    memset (table, 0, nbuckets * sizeof (uint32_t));
+
+    for (i = 0; i < nentries; i++) {
+        uint32_t slot = name_hashes[i] & (nbuckets - 1);
+        while (table[slot] != 0)
+            slot = (slot + 1) & (nbuckets - 1);
+        table[slot] = i + 1;
+    }
+
+    memset (&t, 0, sizeof (t));
+    memcpy (t.magic, JOURNAL_TRAILER_MAGIC, sizeof (t.magic));
+    t.nentries = nentries;
+    t.nbuckets = nbuckets;
+    t.table_off = sizeof (struct journal_index_header) 
+                + (uint64_t) nentries * sizeof (struct journal_index_entry);
+
+    if (fd_write_n (index_fd, table, nbuckets * sizeof (uint32_t)) < 0
+       || fd_write_n (index_fd, &t, sizeof (t)) < 0) {
+        err ("%p: journal: write index: %m\n");
+        rc = -1;
+    }
+
+    Free ((void **) &table);
+    return (rc);
+}
+
+static int journal_exit (void *arg, int rc, bool failed)
+{
+    struct journal_host *h = arg;
+    struct journal_record rec;
+    struct journal_index_entry e;
+    uint64_t off;
+    int retval = 0;
+
+    if (_flush_chunk (h) < 0)
+        retval = -1;
+
+    memset (&rec, 0, sizeof (rec));
+    rec.type = JOURNAL_REC_HOST;
+    rec.hostid = h->hostid;
+    rec.len = strlen (h->host);
+    rec.prev = h->last;
+
+    memset (&e, 0, sizeof (e));
+    e.last = h->last;
+    e.nbytes = h->nbytes;
+    e.nlines = h->nlines;
+    e.digest[0] = digest_final (&h->digest[0]);
+    e.digest[1] = digest_final (&h->digest[1]);
+    e.name_len = rec.len;
+    e.hostid = h->hostid;
+    e.rc = rc;
+    e.flags = failed ? JOURNAL_HOST_FAILED : 0;
+
+    pthread_mutex_lock (&journal_mutex);
+    if ((off = _append_record (&rec, h->host)) == 0)
+        retval = -1;
+    else {
+        e.name_off = off + sizeof (rec);
+        if (fd_write_n (index_fd, &e, sizeof (e)) < 0) {
+            err ("%p: journal: write index: %m\n");
+            retval = -1;
+        }
+        else
+            _add_name_hash (digest_buf (h->host, e.name_len));
+    }
+    pthread_mutex_unlock (&journal_mutex);
+
+    Free ((void **) &h->host);
+    Free ((void **) &h);
+
+    return (retval);
+}
+
+static int journal_fini (void)
+{
+    int rc = 0;
+
+    if (index_fd >= 0 && _write_trailer () < 0)
+        rc = -1;
+    if (name_hashes)
+        Free ((void **) &name_hashes);
+    nentries = maxentries = 0;
+
+    if (journal_fd >= 0 && close (journal_fd) < 0)
+        rc = -1;
+    if (index_fd >= 0 && close (index_fd) < 0)
+        rc = -1;
+    journal_fd = index_fd = -1;
+
+    if (rc < 0)
+        err ("%p: journal: close %s: %m\n", journal_path);
+
+    return (rc);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
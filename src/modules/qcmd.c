@@ -190,6 +190,7 @@ struct pdsh_module pdsh_module_info = {
   &qcmd_module_ops,
   &qcmd_rcmd_ops,
   &qcmd_module_options[0],
+  NULL,
 };
 
 static int
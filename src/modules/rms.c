@@ -96,6 +96,7 @@ struct pdsh_module pdsh_module_info = {
   &rms_module_ops,
   &rms_rcmd_ops,
   &rms_module_options[0],
+  NULL,
 };
 
 /*
@@ -102,6 +102,7 @@ struct pdsh_module pdsh_module_info = {
   &sdr_module_ops,
   NULL,
   &sdr_module_options[0],
+  NULL,
 };
 
 
@@ -110,6 +110,7 @@ struct pdsh_module pdsh_module_info = {
   &slurm_module_ops,
   NULL,
   &slurm_module_options[0],
+  NULL,
 };
 
 
@@ -133,6 +133,7 @@ struct pdsh_module pdsh_module_info = {
   &sshcmd_module_ops,
   &sshcmd_rcmd_ops,
   &sshcmd_module_options[0],
+  NULL,
 };
 
 static char **ssh_argv_create (List arg_list, const char **remote_argv)
@@ -115,6 +115,7 @@ struct pdsh_module pdsh_module_info = {
   &torque_module_ops,
   NULL,
   &torque_module_options[0],
+  NULL,
 };
 
 
@@ -120,6 +120,7 @@ struct pdsh_module pdsh_module_info = {
   &xcpucmd_module_ops,
   &xcpucmd_xcpucmd_ops,
   &xcpucmd_module_options[0],
+  NULL,
 };
 
 static int xcpucmd_init(opt_t * opt)
@@ -164,6 +164,7 @@ struct pdsh_module pdsh_module_info = {
   &xrcmd_module_ops,
   &xrcmd_rcmd_ops,
   &xrcmd_module_options[0],
+  NULL,
 };
 
 static int xrcmd_init(opt_t * opt)
@@ -67,6 +67,7 @@
 #include <sys/wait.h>
 #include <sys/poll.h>
 #include <sys/time.h>
+#include <sys/stat.h>
 #if	HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -114,8 +115,15 @@
 #include "opt.h"
 #include "pcp_client.h"
 #include "pcp_server.h"
+#include "pcp_source.h"
+#include "pcp_chain.h"
+#include "pcp_walk.h"
+#include "pcp_resume.h"
+#include "pcp_rate.h"
+#include "pcp_stats.h"
 #include "wcoll.h"
 #include "rcmd.h"
+#include "output.h"
 
 static int debug = 0;
 
@@ -148,14 +156,44 @@ static int connect_timeout, command_timeout;
  */
 static int sigint_terminates = 0;
 
+/*
+ *  Grouped output (-o group): output of each host is held in spillbufs
+ *   until the host completes, then printed in completion order or in
+ *   hostlist order. In hostlist order, group_next is the index of the
+ *   next host to print.
+ */
+static group_order_t group_order = GROUP_NONE;
+static pthread_mutex_t group_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int group_next = 0;
+
+/*
+ *  Content store shared by all rpdcp server threads (-o dedup).
+ */
+static pcp_store_t pcp_store = NULL;
+
+/*
+ *  Lock held while writing lines of output to stdout or stderr.
+ */
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  -o progress: the progress thread prints a line every `progress_secs'
+ *   seconds until progress_done is set.
+ */
+static pthread_mutex_t progress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t progress_cond = PTHREAD_COND_INITIALIZER;
+static bool progress_done = false;
+static int progress_secs = 0;
+
 /*
  *  Buffered output prototypes:
  */
-typedef void (* out_f) (const char *, ...);
-static int _do_output (int fd, cbuf_t cb, out_f outf, bool read_rc, thd_t *t);
+static int _do_output (int fd, cbuf_t cb, int stream, bool read_rc, 
+                       thd_t *t);
 static int _handle_rcmd_stderr (thd_t *t);
 static int _handle_rcmd_stdout (thd_t *t);
-static void _flush_output (cbuf_t cb, out_f outf, thd_t *t);
+static void _flush_output (cbuf_t cb, int stream, thd_t *t);
+static void _write_output (int stream, const char *buf, size_t len);
 
 /*
  * Emulate signal() but with BSD semantics (i.e. don't restore signal to
@@ -364,22 +402,83 @@ static state_t _update_connect_state (thd_t *a)
     return (a->state);
 }
 
+/*
+ * Ask the remote pdcp to use the pipelined protocol (-o pipeline).
+ * The remote side confirms this in its first response.
+ */
+static void _pcp_append_window (char **cmd, int window)
+{
+    char buf[32];
+    snprintf (buf, sizeof (buf), " -o pipeline=%d", window);
+    xstrcat (cmd, buf);
+}
+
 static int _pcp_server (thd_t *th)
 {
     struct pcp_server svr[1];
+    char *hostdir = NULL;
+    int rc;
 
     svr->infd =          th->rcmd->fd;
     svr->outfd =         svr->infd;
     svr->preserve =      th->pcp_popt;
     svr->target_is_dir = th->pcp_yopt;
     svr->outfile =       th->outfile_name;
+    svr->pipeline =      (th->pcp_window > 0);
+    svr->store =         th->pcp_store;
+    svr->verify =        false;
+    svr->stats =         th->pcp_stats;
+    svr->prealloc =      false;
+    svr->direct =        false;
+    svr->nocache =       false;
+    svr->fsync =         false;
 
-    return (pcp_server (svr));
+    /* 
+     *  With -o hostdir the files of each host go into a directory named 
+     *   after it (errors are reported by the server, which checks it).
+     */
+    if (th->pcp_hostdir) {
+        xstrcat (&hostdir, th->outfile_name);
+        xstrcat (&hostdir, "/");
+        xstrcat (&hostdir, th->host);
+        (void) mkdir (hostdir, 0777);
+        svr->outfile = hostdir;
+    }
+
+    pcp_stats_begin (svr->stats);
+    rc = pcp_server (svr);
+    pcp_stats_end (svr->stats);
+
+    if (hostdir)
+        Free ((void **) &hostdir);
+    return (rc);
+}
+
+/*
+ *  Open the content store for rpdcp -o dedup, which must be on the same
+ *   filesystem as the destination for files to be linked into it.
+ */
+static pcp_store_t _pcp_store_open (opt_t *opt)
+{
+    struct stat st, dst;
+    pcp_store_t s;
+
+    if (!(s = pcp_store_create (opt->pcp_dedup)))
+        errx ("%p: -o dedup: %s: %m\n", opt->pcp_dedup);
+    if (stat (opt->pcp_dedup, &st) < 0)
+        errx ("%p: -o dedup: %s: %m\n", opt->pcp_dedup);
+    if (stat (opt->outfile_name, &dst) < 0)
+        errx ("%p: %s: %m\n", opt->outfile_name);
+    if (st.st_dev != dst.st_dev)
+        errx ("%p: -o dedup: %s is not on the same filesystem as %s\n",
+              opt->pcp_dedup, opt->outfile_name);
+    return (s);
 }
 
 static int _pcp_client (thd_t *th)
 {
     struct pcp_client pcp[1];
+    int rc;
 
     pcp->infd =       th->rcmd->fd;
     pcp->outfd =      pcp->infd;
@@ -388,8 +487,26 @@ static int _pcp_client (thd_t *th)
     pcp->pcp_client = th->pcp_Zopt;
     pcp->host =       th->host;
     pcp->infiles =    th->pcp_infiles;
-
-    return (pcp_client (pcp));
+    pcp->window =     th->pcp_window;
+    pcp->archive =    th->pcp_archive;
+    pcp->sync =       th->pcp_sync;
+    pcp->compress =   th->pcp_compress;
+    pcp->sparse =     th->pcp_sparse;
+    pcp->verify =     th->pcp_verify;
+    pcp->digest =     NULL;
+    pcp->hostdir =    false;
+    pcp->resume =     th->pcp_resume;
+    pcp->rate =       pcp_rate_create ();
+    pcp->stats =      th->pcp_stats;
+    pcp->queue =      th->pcp_queue;
+
+    pcp_stats_begin (pcp->stats);
+    rc = pcp_client (pcp);
+    pcp_stats_end (pcp->stats);
+    th->pcp_ok = (rc == 0 && pcp->errors == 0);
+    th->pcp_bytes = pcp_rate_stats (pcp->rate, &th->pcp_secs);
+    pcp_rate_destroy (pcp->rate);
+    return (rc);
 }
 
 static int _parallel_copy (thd_t *th)
@@ -432,7 +549,7 @@ static int _parallel_copy (thd_t *th)
          */
         while (_handle_rcmd_stderr (th) > 0)
             ;
-        _flush_output (th->errbuf, (out_f) err, th);
+        _flush_output (th->errbuf, OUTPUT_STDERR, th);
 
     }
 
@@ -491,6 +608,11 @@ static void *_rcp_thread(void *args)
     if ((a->rc == 0) && (rc > 0))
         a->rc = rc;
 
+    /* a rerun with the same -o resume journal skips this host */
+    if (pcp_resume_enabled () && result == DSH_DONE && a->pcp_ok 
+        && a->rc == 0)
+        pcp_resume_host_done (a->host);
+
     /* Signal dsh() so another thread can replace us */
     dsh_mutex_lock(&threadcount_mutex);
     threadcount--;
@@ -520,7 +642,152 @@ static int _extract_rc(char *buf)
 }
 
 
-static int _do_output (int fd, cbuf_t cb, out_f outf, bool read_rc, thd_t *t)
+/*
+ *  Append a line of output to the grouped output of host `t'.
+ */
+static void _group_append (thd_t *t, int stream, const char *line, 
+                           size_t len)
+{
+    spillbuf_t *sbp = (stream == OUTPUT_STDERR) ? &t->group_err 
+                                                : &t->group_out;
+
+    if (*sbp == NULL)
+        *sbp = spillbuf_create ();
+
+    if (spillbuf_append (*sbp, line, len) < 0) {
+        err ("%p: %S: unable to buffer output: %m\n", t->host);
+        _write_output (stream, line, len);
+    }
+}
+
+/*
+ *  Write `len' bytes of output in `buf' to stdout or stderr with a
+ *   single write, holding output_mutex in case the write is short so
+ *   that lines from different hosts are never interleaved.
+ */
+static void _write_output (int stream, const char *buf, size_t len)
+{
+    int fd = (stream == OUTPUT_STDERR) ? STDERR_FILENO : STDOUT_FILENO;
+
+    dsh_mutex_lock (&output_mutex);
+    fd_write_n (fd, (void *) buf, len);
+    dsh_mutex_unlock (&output_mutex);
+}
+
+/*
+ *  Return a pointer to space for `n' bytes of output, plus a newline
+ *   and NUL, in the line buffer of host `t'. The line buffer always
+ *   begins with the host's precomputed label, so that a line read
+ *   into this space may be written out without further copying.
+ */
+static char *_line_reserve (thd_t *t, size_t n)
+{
+    size_t need = t->labellen + n + 2;
+
+    if (need > t->linebuf_size) {
+        while (t->linebuf_size < need)
+            t->linebuf_size *= 2;
+        Realloc ((void **) &t->linebuf, t->linebuf_size);
+    }
+
+    return (t->linebuf + t->labellen);
+}
+
+/*
+ *  Print (or with -o group, buffer) one line of output from host `t',
+ *   which has been stored in the line buffer by _line_reserve(). If 
+ *   `newline' is set, the line is the unterminated remainder of output.
+ */
+static void _print_output (thd_t *t, int stream, bool newline)
+{
+    char *line = t->linebuf + t->labellen;
+    size_t len = t->labellen + strlen (line);
+
+    if (newline)
+        t->linebuf[len++] = '\n';
+
+    if (group_order != GROUP_NONE)
+        _group_append (t, stream, t->linebuf, len);
+    else
+        _write_output (stream, t->linebuf, len);
+}
+
+/*
+ *  Write grouped output of host `th', if not already written.
+ *   Must be called with group_mutex held.
+ */
+static void _group_print (thd_t *th)
+{
+    if (th->group_printed)
+        return;
+    th->group_printed = true;
+
+    fflush (NULL);
+    if (th->group_out) {
+        if (spillbuf_write (th->group_out, STDOUT_FILENO) < 0)
+            err ("%p: %S: write grouped output: %m\n", th->host);
+        spillbuf_destroy (th->group_out);
+        th->group_out = NULL;
+    }
+    if (th->group_err) {
+        if (spillbuf_write (th->group_err, STDERR_FILENO) < 0)
+            err ("%p: %S: write grouped output: %m\n", th->host);
+        spillbuf_destroy (th->group_err);
+        th->group_err = NULL;
+    }
+}
+
+/*
+ *  Called when host `th' completes. Print its grouped output now, or
+ *   in hostlist order, along with the output of any following hosts
+ *   which completed earlier.
+ */
+static void _group_host_done (thd_t *th)
+{
+    dsh_mutex_lock (&group_mutex);
+    th->group_done = true;
+    if (group_order == GROUP_COMPLETION)
+        _group_print (th);
+    else {
+        while (t[group_next].host != NULL 
+              && (t[group_next].group_done 
+                 || t[group_next].state == DSH_CANCELED))
+            _group_print (&t[group_next++]);
+    }
+    dsh_mutex_unlock (&group_mutex);
+}
+
+/*
+ *  Print grouped output of all remaining hosts.
+ */
+static void _group_fini (void)
+{
+    int i;
+
+    dsh_mutex_lock (&group_mutex);
+    for (i = 0; t[i].host != NULL; i++)
+        _group_print (&t[i]);
+    dsh_mutex_unlock (&group_mutex);
+
+    spillbuf_fini ();
+}
+
+/*
+ *  Apply the output filter (-o include, exclude, fields, max-lines) to
+ *   one line of stdout from host `t', possibly rewriting it in place.
+ *   This runs in the host's own thread, so lines which are dropped
+ *   never reach the shared output stream. Output modules are handed
+ *   the unfiltered output.
+ */
+static bool _output_wanted (thd_t *t, int stream, char *buf)
+{
+    if (t->filter == NULL || stream != OUTPUT_STDOUT || buf[0] == '\0')
+        return (true);
+    return (filter_line (t->filter, buf, &t->filter_lines));
+}
+
+static int _do_output (int fd, cbuf_t cb, int stream, bool read_rc, 
+                       thd_t *t)
 {
     char c;
     int n, rc;
@@ -546,43 +813,40 @@ static int _do_output (int fd, cbuf_t cb, out_f outf, bool read_rc, thd_t *t)
         }
 
         /*
-         *  Allocate enough space for line plus NUL character,
-         *   then actually read line data into buffer:
+         *  Read line data directly into the host's line buffer,
+         *   after its label:
          */
-        buf = Malloc (n + 1);
+        buf = _line_reserve (t, n);
         if ((n = cbuf_read (cb, buf, n))) {
             if (n < 0) {
                 err ("%p: %S: Failed to read line from buffer: %m\n", t->host);
                 break;
             }
+            buf[n] = '\0';
             if (read_rc)
                 t->rc = _extract_rc (buf);
-            /*
-             *  We are careful to use a single call to write the line
-             *   to the output stream to avoid interleaved lines of
-             *   output.
-             */
-            if (t->labels)
-                outf ("%S: %s", t->host, buf);
-            else
-                outf ("%s", buf);
-            fflush (NULL);
+            if (t->output && buf[0] != '\0')
+                output_host_line (t->output, stream, buf, strlen (buf));
+            if (_output_wanted (t, stream, buf))
+                _print_output (t, stream, false);
         }
-        Free ((void **)&buf);
     }
 
     return (rc);
 }
 
-static void _flush_output (cbuf_t cb, out_f outf, thd_t *t)
+static void _flush_output (cbuf_t cb, int stream, thd_t *t)
 {
-    char buf[8192];
+    char *buf;
+    int n;
 
-    while (cbuf_read (cb, buf, 8192) > 0) {
-        if (t->labels)
-            outf ("%S: %s\n", t->host, buf);
-        else
-            outf ("%s\n", buf);
+    buf = _line_reserve (t, 8191);
+    while ((n = cbuf_read (cb, buf, 8191)) > 0) {
+        buf[n] = '\0';
+        if (t->output)
+            output_host_data (t->output, stream, buf, n);
+        if (_output_wanted (t, stream, buf))
+            _print_output (t, stream, true);
     }
 
     return;
@@ -605,7 +869,8 @@ static int _die_if_signalled (thd_t *t)
 
 static int _handle_rcmd_stdout (thd_t *th)
 {
-    int rc = _do_output (th->rcmd->fd, th->outbuf, (out_f) out, true, th);
+    int rc = _do_output (th->rcmd->fd, th->outbuf, OUTPUT_STDOUT, 
+                         true, th);
 
     if (rc <= 0) {
         close (th->rcmd->fd);
@@ -617,7 +882,8 @@ static int _handle_rcmd_stdout (thd_t *th)
 
 static int _handle_rcmd_stderr (thd_t *th)
 {
-    int rc = _do_output (th->rcmd->efd, th->errbuf, (out_f) err, false, th);
+    int rc = _do_output (th->rcmd->efd, th->errbuf, OUTPUT_STDERR, 
+                         false, th);
 
     if (rc <= 0) {
         close (th->rcmd->efd);
@@ -647,6 +913,8 @@ static void *_rsh_thread(void *args)
 #endif
     _xsignal (SIGPIPE, SIG_BLOCK);
 
+    a->output = output_host_start (a->host, a->nodeid);
+
     /* establish the connection */
     dsh_mutex_lock(&thd_mutex);
     a->state = DSH_RCMD;
@@ -729,13 +997,19 @@ static void *_rsh_thread(void *args)
     dsh_mutex_unlock(&thd_mutex);
 
     /* flush any pending output */
-    _flush_output (a->outbuf, (out_f) out, a);
-    _flush_output (a->errbuf, (out_f) err, a);
+    _flush_output (a->outbuf, OUTPUT_STDOUT, a);
+    _flush_output (a->errbuf, OUTPUT_STDERR, a);
 
     rv = rcmd_destroy (a->rcmd);
     if ((a->rc == 0) && (rv > 0))
         a->rc = rv;
 
+    output_host_exit (a->output, a->rc, (a->state == DSH_FAILED));
+    a->output = NULL;
+
+    if (group_order != GROUP_NONE)
+        _group_host_done (a);
+
     /* if a single qshell thread fails, terminate whole job */
     if (a->kill_on_fail && a->state == DSH_FAILED) {
         _fwd_signal(SIGTERM);
@@ -750,6 +1024,145 @@ static void *_rsh_thread(void *args)
     return NULL;
 }
 
+/*
+ * -o verify: list the hosts where not all files were written and found
+ *  to match their digests. The reasons were reported as errors by each.
+ *  Returns the number of such hosts.
+ */
+static int _pcp_verify_report (int rshcount)
+{
+    hostlist_t hl = hostlist_create (NULL);
+    char *buf;
+    int n, failed;
+
+    for (n = 0; n < rshcount; n++) {
+        if (!t[n].pcp_ok)
+            hostlist_push_host (hl, t[n].host);
+    }
+    hostlist_uniq (hl);     /* -o streams: a host has several threads */
+    if ((failed = hostlist_count (hl)) > 0) {
+        buf = hostlist_ranged_string_malloc (hl);
+        err ("%p: verify failed on %d host%s: %s\n", failed,
+             failed > 1 ? "s" : "", buf);
+        free (buf);
+    }
+    hostlist_destroy (hl);
+    return (failed);
+}
+
+/*
+ * Rates achieved by the pcp client threads, per host and in aggregate.
+ */
+static void _dump_pcp_rate_stats(int rshcount)
+{
+    double rate, rateTot = 0.0, rateMin = 0.0, rateMax = 0.0;
+    double secs;
+    uint64_t total;
+    char buf[128];
+    int hosts = 0;
+    int n;
+
+    if ((total = pcp_rate_total(&secs)) == 0)
+        return;
+
+    for (n = 0; n < rshcount; n++) {
+        if (t[n].state != DSH_DONE || t[n].pcp_secs <= 0.0)
+            continue;
+        rate = t[n].pcp_bytes / t[n].pcp_secs;
+        rateTot += rate;
+        rateMin = hosts ? MIN(rateMin, rate) : rate;
+        rateMax = MAX(rateMax, rate);
+        hosts++;
+    }
+    /* err() has no floating point conversions */
+    if (hosts) {
+        snprintf(buf, sizeof(buf), 
+                 "Avg: %.2f MB/s, Min: %.2f MB/s, Max: %.2f MB/s",
+                 rateTot / hosts / 1e6, rateMin / 1e6, rateMax / 1e6);
+        err("Send rate:     %s\n", buf);
+    }
+    snprintf(buf, sizeof(buf), "%llu bytes in %.1f sec (%.2f MB/s)",
+             (unsigned long long) total, secs, 
+             secs > 0.0 ? total / secs / 1e6 : 0.0);
+    err("Sent:          %s\n", buf);
+}
+
+static int _cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x < y ? -1 : x > y);
+}
+
+/*
+ * Files and throughput of the pcp threads, with the spread of the
+ * per-host throughput, and the time they were blocked waiting for the
+ * remote host (for acks with pdcp, data with rpdcp) and in writes.
+ */
+static void _dump_pcp_stats(int rshcount)
+{
+    struct pcp_stats_info info;
+    double *rates = Malloc(rshcount * sizeof(double) + 1);
+    double waitTot = 0.0, waitMax = 0.0, writeTot = 0.0, writeMax = 0.0;
+    unsigned long files = 0;
+    uint64_t bytes = 0;
+    char buf[256];
+    int hosts = 0;
+    int n, k;
+
+    /* with -o streams, the threads of a host are added up */
+    for (n = 0; n < rshcount; n = k) {
+        double wait = 0.0, write = 0.0, secs = 0.0;
+        uint64_t hbytes = 0;
+        bool ok = true;
+
+        for (k = n; k < rshcount && (k == n || t[k].pcp_stream > 0); k++) {
+            if (t[k].pcp_stats == NULL || t[k].state != DSH_DONE) {
+                ok = false;
+                continue;
+            }
+            pcp_stats_get(t[k].pcp_stats, &info);
+            files += info.files;
+            bytes += info.bytes;
+            hbytes += info.bytes;
+            wait += info.wait;
+            write += info.write;
+            secs = MAX(secs, info.secs);
+        }
+        if (!ok)
+            continue;
+        waitTot += wait;
+        waitMax = MAX(waitMax, wait);
+        writeTot += write;
+        writeMax = MAX(writeMax, write);
+        rates[hosts++] = secs > 0.0 ? hbytes / secs : 0.0;
+    }
+    if (hosts == 0) {
+        Free((void **) &rates);
+        return;
+    }
+
+    /* nearest rank percentiles of the per-host throughput */
+    qsort(rates, hosts, sizeof(double), _cmp_double);
+    snprintf(buf, sizeof(buf), "%lu (%llu bytes)", files, 
+             (unsigned long long) bytes);
+    err("Files:         %s\n", buf);
+    snprintf(buf, sizeof(buf), 
+             "p10: %.2f MB/s, p50: %.2f MB/s, p90: %.2f MB/s, "
+             "Max: %.2f MB/s",
+             rates[(hosts * 10 + 99) / 100 - 1] / 1e6, 
+             rates[(hosts * 50 + 99) / 100 - 1] / 1e6,
+             rates[(hosts * 90 + 99) / 100 - 1] / 1e6, 
+             rates[hosts - 1] / 1e6);
+    err("Throughput:    %s\n", buf);
+    snprintf(buf, sizeof(buf), "Avg: %.2f sec, Max: %.2f sec",
+             waitTot / hosts, waitMax);
+    err("%s %s\n", t[0].pcp_Popt ? "Read wait:    " : "Ack wait:     ", buf);
+    snprintf(buf, sizeof(buf), "Avg: %.2f sec, Max: %.2f sec",
+             writeTot / hosts, writeMax);
+    err("Write time:    %s\n", buf);
+    Free((void **) &rates);
+}
+
 #define TIME_T_YEAR	60*60*24*7*52
 
 /*
@@ -793,6 +1206,8 @@ static void _dump_debug_stats(int rshcount)
     err("Failures:      %d\n", failed);
     if (canceled)
         err("Canceled:      %d\n", canceled);
+    _dump_pcp_rate_stats(rshcount);
+    _dump_pcp_stats(rshcount);
 }
 
 /*
@@ -844,6 +1259,26 @@ static void _increase_nofile_limit (opt_t *opt)
     return;
 }
 
+/*
+ *  Format the label of host `th' once, at the start of its line buffer,
+ *   rather than for each line of output. Must be called after it is
+ *   known whether domains are stripped from labels.
+ */
+static void _thd_init_label (thd_t *th)
+{
+    char *label = th->labels ? err_format ("%S: ", th->host) : NULL;
+
+    th->labellen = label ? strlen (label) : 0;
+    th->linebuf_size = 256;
+    while (th->linebuf_size < th->labellen + 2)
+        th->linebuf_size *= 2;
+    th->linebuf = Malloc (th->linebuf_size);
+    if (label) {
+        memcpy (th->linebuf, label, th->labellen);
+        Free ((void **) &label);
+    }
+}
+
 static int _thd_init (thd_t *th, opt_t *opt, List pcp_infiles, int i)
 { 
     th->luser = opt->luser;        /* general */
@@ -854,6 +1289,13 @@ static int _thd_init (thd_t *th, opt_t *opt, List pcp_infiles, int i)
     th->cmd = opt->cmd;
     th->dsh_sopt = opt->separate_stderr;  /* dsh-specific */
     th->rc = 0;
+    th->output = NULL;
+    th->group_out = NULL;
+    th->group_err = NULL;
+    th->group_done = false;
+    th->group_printed = false;
+    th->filter = opt->filter ? filter_clone (opt->filter) : NULL;
+    th->filter_lines = 0;
     th->pcp_infiles = pcp_infiles;        /* pcp-specific */
     th->pcp_outfile = opt->outfile_name;
     th->pcp_popt = opt->preserve;
@@ -862,6 +1304,23 @@ static int _thd_init (thd_t *th, opt_t *opt, List pcp_infiles, int i)
     th->pcp_Popt = opt->reverse_copy;
     th->pcp_Zopt = opt->pcp_client;
     th->pcp_progname = opt->progname;
+    th->pcp_window = opt->pcp_window;
+    th->pcp_archive = opt->pcp_archive;
+    th->pcp_sync = opt->pcp_sync;
+    th->pcp_compress = opt->pcp_compress;
+    th->pcp_sparse = opt->pcp_sparse;
+    th->pcp_verify = opt->pcp_verify;
+    th->pcp_hostdir = opt->pcp_hostdir;
+    th->pcp_store = pcp_store;
+    th->pcp_resume = opt->pcp_resume;
+    th->pcp_ok = false;
+    th->pcp_bytes = 0;
+    th->pcp_secs = 0.0;
+    th->pcp_stream = 0;
+    th->pcp_queue = NULL;
+    th->pcp_stats = NULL;
+    if (pdsh_personality () == PCP)
+        th->pcp_stats = pcp_stats_create ();
     th->outfile_name = opt->outfile_name;
     th->kill_on_fail = opt->kill_on_fail;
     th->outbuf = cbuf_create (64, 131072);
@@ -977,6 +1436,95 @@ _signals_thread (void *arg)
     return NULL;
 }
 
+/*
+ * -o progress: print the hosts done, the files and bytes copied so far,
+ *  the rate over the last `secs' seconds, and the hosts which have been
+ *  blocked waiting for the remote pdcp for a whole interval.
+ */
+static void _pcp_progress_line (uint64_t *lastp, double secs)
+{
+    struct pcp_stats_info info;
+    hostlist_t waiting = hostlist_create (NULL);
+    unsigned long files = 0;
+    uint64_t bytes = 0;
+    int count = 0, done = 0, failed = 0, n;
+    bool host_done = false, host_failed = false;
+    char buf[256], *hosts;
+    int len;
+
+    dsh_mutex_lock (&thd_mutex);
+
+    /* with -o streams, a host is done when all its threads are */
+    for (n = 0; t[n].host != NULL; n++) {
+        if (t[n].pcp_stream == 0) {
+            done += host_done && !host_failed;
+            failed += host_failed;
+            host_done = true;
+            host_failed = false;
+            count++;
+        }
+        host_done = host_done && t[n].state == DSH_DONE;
+        host_failed = host_failed || t[n].state == DSH_FAILED 
+                      || t[n].state == DSH_CANCELED;
+        pcp_stats_get (t[n].pcp_stats, &info);
+        files += info.files;
+        bytes += info.bytes;
+        if (info.waiting >= progress_secs)
+            hostlist_push_host (waiting, t[n].host);
+    }
+    done += host_done && !host_failed;
+    failed += host_failed;
+
+    dsh_mutex_unlock (&thd_mutex);
+
+    hostlist_uniq (waiting);
+
+    /* err() has no floating point conversions */
+    len = snprintf (buf, sizeof (buf), "%d/%d hosts done", done, count);
+    if (failed)
+        len += snprintf (buf + len, sizeof (buf) - len, ", %d failed", 
+                         failed);
+    snprintf (buf + len, sizeof (buf) - len, 
+              ", %lu files, %.1f MB, %.1f MB/s", files, bytes / 1e6,
+              secs > 0.0 ? (bytes - *lastp) / secs / 1e6 : 0.0);
+    *lastp = bytes;
+
+    if (hostlist_count (waiting) > 0) {
+        hosts = hostlist_ranged_string_malloc (waiting);
+        err ("%p: progress: %s, waiting on %s\n", buf, hosts);
+        free (hosts);
+    } else
+        err ("%p: progress: %s\n", buf);
+    hostlist_destroy (waiting);
+}
+
+static void *
+_pcp_progress_thread (void *arg)
+{
+    double last = pcp_stats_now (), next = last + progress_secs, now;
+    uint64_t bytes = 0;
+    struct timespec ts;
+
+    dsh_mutex_lock (&progress_mutex);
+    while (!progress_done) {
+        ts.tv_sec = (time_t) next;
+        ts.tv_nsec = (long) ((next - ts.tv_sec) * 1e9);
+        if (pthread_cond_timedwait (&progress_cond, &progress_mutex, &ts)
+            != ETIMEDOUT)
+            continue;
+        dsh_mutex_unlock (&progress_mutex);
+
+        now = pcp_stats_now ();
+        _pcp_progress_line (&bytes, now - last);
+        last = now;
+        next += progress_secs;
+
+        dsh_mutex_lock (&progress_mutex);
+    }
+    dsh_mutex_unlock (&progress_mutex);
+    return NULL;
+}
+
 /* 
  * Run command on a list of hosts, keeping 'fanout' number of connections 
  * active concurrently.
@@ -987,9 +1535,11 @@ int dsh(opt_t * opt)
     int rv, rshcount;
     pthread_t thread_wdog;
     pthread_t thread_sig;
+    pthread_t thread_progress;
     pthread_attr_t attr_wdog;
     pthread_attr_t attr_sig;
     List pcp_infiles = NULL;
+    char **chain_cmds = NULL;
     hostlist_iterator_t itr;
     const char *domain = NULL;
     bool domain_in_label = false;
@@ -1004,6 +1554,14 @@ int dsh(opt_t * opt)
 		exit(1);
     }
 
+    /*
+     *   ... and any output modules
+     */
+    if (output_init(opt) < 0) {
+        err("%p: unable to initialize output modules\n");
+        exit(1);
+    }
+
     _increase_nofile_limit (opt);
 
     /* install signal handlers */
@@ -1038,25 +1596,40 @@ int dsh(opt_t * opt)
 
     /* build PCP command */
     if (pdsh_personality() == PCP && !opt->reverse_copy) {
-        char *cmd = NULL;
-
         /* expand directories, if any, and verify access for all files */
         if (!(pcp_infiles = pcp_expand_dirs(opt->infile_names))) {
             err("%p: unable to build file copy list\n");
             exit(1);
         }
 
-        xstrcat(&cmd, opt->remote_program_path);
-        if (opt->recursive)
-            xstrcat(&cmd, " -r");
-        if (opt->preserve)
-            xstrcat(&cmd, " -p");
-        if (list_count(pcp_infiles) > 1)     /* outfile must be directory */
-            xstrcat(&cmd, " -y");
-        xstrcat(&cmd, " -z ");               /* invoke pcp server */
-        xstrcat(&cmd, opt->outfile_name);    /* outfile is remote target */
+        /* outfile must be a directory if there are several files */
+        opt->cmd = pcp_server_cmd(opt, list_count(pcp_infiles) > 1, NULL);
 
-        opt->cmd = cmd;
+        /* hosts which have all files from an earlier run are done */
+        if (opt->pcp_resume_journal) {
+            pcp_resume_init (opt->pcp_resume_journal, pcp_infiles, 
+                             opt->outfile_name, opt->preserve, opt->wcoll);
+            rshcount = hostlist_count (opt->wcoll);
+        }
+
+        /* each thread copies to the first host of a chain */
+        if (opt->pcp_chains) {
+            chain_cmds = pcp_chain_split (opt, list_count(pcp_infiles) > 1);
+            rshcount = hostlist_count (opt->wcoll);
+        }
+
+        /* each of the threads to a host has its own connection */
+        if (opt->pcp_streams)
+            rshcount *= opt->pcp_streams;
+
+        if (opt->source_cache)
+            pcp_source_cache_init (opt->source_cache);
+        if (opt->pcp_rate || opt->pcp_host_rate)
+            pcp_rate_init (opt->pcp_rate, opt->pcp_host_rate);
+#if HAVE_ZLIB
+        if (opt->pcp_compress)
+            pcp_source_cache_set_filter (pcp_compress_chunk);
+#endif
     }
 
     if (pdsh_personality() == PCP && opt->reverse_copy) {
@@ -1070,6 +1643,18 @@ int dsh(opt_t * opt)
             xstrcat(&cmd, " -r");
         if (opt->preserve)
             xstrcat(&cmd, " -p");
+        if (opt->pcp_window)
+            _pcp_append_window(&cmd, opt->pcp_window);
+        if (opt->pcp_sync)
+            xstrcat(&cmd, " -o sync");
+        else if (opt->pcp_archive)
+            xstrcat(&cmd, " -o archive");
+        if (opt->pcp_compress)
+            xstrcat(&cmd, " -o compress");
+        if (opt->pcp_sparse)
+            xstrcat(&cmd, " -o sparse");
+        if (opt->pcp_hostdir)
+            xstrcat(&cmd, " -o hostdir");    /* don't append host to names */
         xstrcat(&cmd, " -Z ");               /* invoke pcp client */
 
         i = list_iterator_create(opt->infile_names);
@@ -1081,12 +1666,20 @@ int dsh(opt_t * opt)
 
         /* The 'host' will be appended to the cmd in _rcp_thread */
         opt->cmd = cmd;
+
+        if (opt->pcp_dedup)
+            pcp_store = _pcp_store_open (opt);
     }
 
     /* set debugging flag for this module */
     if (opt->debug)
         debug = 1;
 
+    if (pdsh_personality() == DSH && opt->group_order != GROUP_NONE) {
+        group_order = opt->group_order;
+        spillbuf_set_memory_limit (opt->group_memory);
+    }
+
     /* build thread array--terminated with t[i].host == NULL */
     t = (thd_t *) Malloc(sizeof(thd_t) * (rshcount + 1));
 
@@ -1095,10 +1688,26 @@ int dsh(opt_t * opt)
     i = 0;
     while ((t[i].host = hostlist_next(itr))) {
         char *d;
+        int s;
         
         assert(i < rshcount);
 
         _thd_init (&t[i], opt, pcp_infiles, i);
+        if (chain_cmds)
+            t[i].cmd = chain_cmds[i];
+
+        /* -o streams: the other connections to the host follow it */
+        if (opt->pcp_streams && pcp_infiles) {
+            t[i].pcp_queue = pcp_queue_create ();
+            for (s = 1; s < opt->pcp_streams; s++) {
+                assert(i + s < rshcount);
+                t[i + s].host = strdup (t[i].host);
+                _thd_init (&t[i + s], opt, pcp_infiles, i + s);
+                t[i + s].pcp_stream = s;
+                t[i + s].pcp_queue = t[i].pcp_queue;
+            }
+            i += opt->pcp_streams - 1;
+        }
 
         /*
          * Require domain names in labels if hosts have 
@@ -1119,6 +1728,12 @@ int dsh(opt_t * opt)
     if (domain_in_label)
         err_no_strip_domain ();
 
+    for (i = 0; i < rshcount; i++)
+        _thd_init_label (&t[i]);
+
+    /* lines of output are written directly to stdout and stderr */
+    fflush (NULL);
+
     /* set timeout values for _wdog() */
     connect_timeout = opt->connect_timeout;
     command_timeout = opt->command_timeout;
@@ -1131,6 +1746,14 @@ int dsh(opt_t * opt)
     _dsh_attr_init (&attr_sig, DSH_THREAD_STACKSIZE);
     rv = pthread_create(&thread_sig, &attr_sig, _signals_thread, (void *) t);
 
+    /* start the progress thread (-o progress) */
+    if (pdsh_personality() == PCP && opt->pcp_progress) {
+        progress_secs = opt->pcp_progress;
+        if ((rv = pthread_create(&thread_progress, NULL, 
+                                 _pcp_progress_thread, NULL)))
+            errx("%p: pthread_create progress: %S\n", strerror(rv));
+    }
+
     /* start all the other threads (at most 'fanout' active at once) */
     for (i = 0; i < rshcount; i++) {
 
@@ -1177,9 +1800,35 @@ int dsh(opt_t * opt)
     while (threadcount > 0)
         pthread_cond_wait(&threadcount_cond, &threadcount_mutex);
 
+    if (group_order != GROUP_NONE)
+        _group_fini();
+
+    if (pcp_source_cache_enabled ())
+        pcp_source_cache_fini ();
+
+    if (progress_secs) {
+        dsh_mutex_lock (&progress_mutex);
+        progress_done = true;
+        pthread_cond_signal (&progress_cond);
+        dsh_mutex_unlock (&progress_mutex);
+        pthread_join (thread_progress, NULL);
+    }
+
+    if (opt->pcp_verify && _pcp_verify_report (rshcount) > 0)
+        rc = 1;
+
+    if (pcp_infiles) {
+        pcp_check_unchanged (pcp_infiles);
+        list_destroy (pcp_infiles);
+        pcp_walk_fini ();
+    }
+
     if (debug)
         _dump_debug_stats(rshcount);
 
+    if (output_fini() < 0)
+        rc = 1;
+
     /*
      * Cancel signals thread and unblock SIGINT/SIGTSTP
      */
@@ -1204,9 +1853,20 @@ int dsh(opt_t * opt)
         free(t[i].host);
         cbuf_destroy (t[i].outbuf);
         cbuf_destroy (t[i].errbuf);
+        Free ((void **) &t[i].linebuf);
+        if (t[i].filter)
+            filter_destroy (t[i].filter);
+        pcp_stats_destroy (t[i].pcp_stats);
+        if (t[i].pcp_queue && t[i].pcp_stream == 0)
+            pcp_queue_destroy (t[i].pcp_queue);
     }
 
     Free((void **) &t);         /* cleanup */
+    if (chain_cmds)
+        pcp_chain_cmds_destroy (chain_cmds);
+    if (pcp_store)
+        pcp_store_destroy (pcp_store);
+    pcp_resume_fini ();
 
     return rc;
 }
@@ -35,11 +35,19 @@
 #include <pthread.h>
 #endif
 
+#include <stdint.h>
+
 #include "src/common/macros.h"
 #include "src/common/list.h"
 #include "src/pdsh/opt.h"
 #include "src/pdsh/cbuf.h"
 #include "src/pdsh/rcmd.h"
+#include "src/pdsh/output.h"
+#include "src/pdsh/spillbuf.h"
+#include "src/pdsh/filter.h"
+#include "src/pdsh/pcp_store.h"
+#include "src/pdsh/pcp_stats.h"
+#include "src/pdsh/pcp_client.h"
 
 #define INTR_TIME		1       /* secs */
 #define WDOG_POLL 		2       /* secs */
@@ -78,17 +86,42 @@ typedef struct thd {
     bool pcp_Popt;              /* reverse copy */
     bool pcp_Zopt;              /* pcp client */
     char *pcp_progname;         /* program name */
+    int pcp_window;             /* -o pipeline window, 0 if not pipelined */
+    bool pcp_archive;           /* -o archive */
+    bool pcp_sync;              /* -o sync */
+    bool pcp_compress;          /* -o compress */
+    bool pcp_sparse;            /* -o sparse */
+    bool pcp_verify;            /* -o verify */
+    bool pcp_hostdir;           /* -o hostdir */
+    pcp_store_t pcp_store;      /* -o dedup content store, or NULL */
+    bool pcp_resume;            /* -o resume */
+    bool pcp_ok;                /* all files copied without error */
+    uint64_t pcp_bytes;         /* bytes sent by pcp client */
+    double pcp_secs;            /* seconds pcp client ran */
+    pcp_stats_t pcp_stats;      /* pcp progress counters, or NULL */
+    int pcp_stream;             /* -o streams: index of the connection */
+    pcp_queue_t pcp_queue;      /* -o streams: shared by the connections */
     char *outfile_name;         /* outfile name */
     int rc;                     /* remote return code (-S) */
     int nodeid;                 /* node index */
     int nnodes;                 /* number of nodes in job */
     
     struct rcmd_info *rcmd;     /* rcmd connection info */
+    struct output_host *output; /* output module handles (may be NULL) */
 
     cbuf_t outbuf;              /* output buffer */
     cbuf_t errbuf;              /* stderr buffer  */
+    spillbuf_t group_out;       /* grouped stdout (-o group) */
+    spillbuf_t group_err;       /* grouped stderr (-o group) */
+    bool group_done;            /* host finished, grouped output ready */
+    bool group_printed;         /* grouped output has been printed */
+    filter_t filter;            /* output filter (-o include, etc.) */
+    int filter_lines;           /* lines passed by output filter */
 
     bool labels;                /* display host: labels */
+    size_t labellen;            /* length of "host: " label, if any */
+    char *linebuf;              /* label followed by current output line */
+    size_t linebuf_size;        /* allocated size of linebuf */
     char addr[IP_ADDR_LEN];     /* IP address */
 } thd_t;
 
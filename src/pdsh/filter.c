@@ -0,0 +1,319 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+#include <regex.h>
+
+#include "src/common/err.h"
+#include "src/common/xmalloc.h"
+#include "filter.h"
+
+struct range {
+    int lo;
+    int hi;
+};
+
+struct pattern {
+    char *          text;
+    regex_t         re;
+};
+
+struct filter {
+    struct pattern *include;
+    int             ninclude;
+    struct pattern *exclude;
+    int             nexclude;
+    struct range *  fields;
+    int             nfields;
+    char            delim;      /* field delimiter, or 0 for blanks        */
+    int             max_lines;
+};
+
+filter_t filter_create (void)
+{
+    filter_t f = Malloc (sizeof (*f));
+    memset (f, 0, sizeof (*f));
+    return (f);
+}
+
+void filter_destroy (filter_t f)
+{
+    int i;
+
+    for (i = 0; i < f->ninclude; i++) {
+        regfree (&f->include[i].re);
+        Free ((void **) &f->include[i].text);
+    }
+    for (i = 0; i < f->nexclude; i++) {
+        regfree (&f->exclude[i].re);
+        Free ((void **) &f->exclude[i].text);
+    }
+    if (f->include)
+        Free ((void **) &f->include);
+    if (f->exclude)
+        Free ((void **) &f->exclude);
+    if (f->fields)
+        Free ((void **) &f->fields);
+    Free ((void **) &f);
+}
+
+int filter_add_regex (filter_t f, const char *pattern, bool exclude)
+{
+    struct pattern **vp = exclude ? &f->exclude : &f->include;
+    int *np = exclude ? &f->nexclude : &f->ninclude;
+    regex_t re;
+    int rc;
+
+    if ((rc = regcomp (&re, pattern, REG_EXTENDED | REG_NOSUB)) != 0) {
+        char msg [4096];
+        regerror (rc, &re, msg, sizeof (msg));
+        err ("%p: Error %s output pattern \"%s\": %s\n",
+             exclude ? "excluding" : "matching", pattern, msg);
+        return (-1);
+    }
+
+    if (*vp == NULL)
+        *vp = Malloc (sizeof (struct pattern));
+    else
+        Realloc ((void **) vp, (*np + 1) * sizeof (struct pattern));
+    (*vp)[*np].text = Strdup (pattern);
+    (*vp)[*np].re = re;
+    (*np)++;
+
+    return (0);
+}
+
+filter_t filter_clone (filter_t f)
+{
+    filter_t new = filter_create ();
+    int i;
+
+    /*
+     *  Patterns were validated when first added, so recompiling
+     *   them cannot fail here.
+     */
+    for (i = 0; i < f->ninclude; i++)
+        filter_add_regex (new, f->include[i].text, false);
+    for (i = 0; i < f->nexclude; i++)
+        filter_add_regex (new, f->exclude[i].text, true);
+
+    if (f->nfields) {
+        new->fields = Malloc (f->nfields * sizeof (struct range));
+        memcpy (new->fields, f->fields, f->nfields * sizeof (struct range));
+        new->nfields = f->nfields;
+    }
+    new->delim = f->delim;
+    new->max_lines = f->max_lines;
+
+    return (new);
+}
+
+static int _parse_int (const char *s, char **endp)
+{
+    long n;
+
+    if (!isdigit ((int) *s))
+        return (-1);
+    n = strtol (s, endp, 10);
+    if (n < 1 || n > INT_MAX)
+        return (-1);
+    return ((int) n);
+}
+
+int filter_set_fields (filter_t f, const char *spec)
+{
+    const char *p = spec;
+    char *q;
+
+    f->nfields = 0;
+
+    while (*p) {
+        struct range r;
+
+        if (*p == '-') {
+            r.lo = 1;
+            q = (char *) p;
+        }
+        else if ((r.lo = _parse_int (p, &q)) < 0)
+            goto bad;
+
+        if (*q == '-') {
+            p = q + 1;
+            if (*p == ',' || *p == '\0') {
+                r.hi = INT_MAX;
+                q = (char *) p;
+            }
+            else if ((r.hi = _parse_int (p, &q)) < r.lo)
+                goto bad;
+        }
+        else
+            r.hi = r.lo;
+
+        if (*q == ',' && q[1] != '\0')
+            q++;
+        else if (*q != '\0')
+            goto bad;
+
+        if (f->fields == NULL)
+            f->fields = Malloc (sizeof (r));
+        else
+            Realloc ((void **) &f->fields, (f->nfields + 1) * sizeof (r));
+        f->fields[f->nfields++] = r;
+
+        p = q;
+    }
+
+    if (f->nfields > 0)
+        return (0);
+bad:
+    err ("%p: Invalid field list \"%s\"\n", spec);
+    f->nfields = 0;
+    return (-1);
+}
+
+void filter_set_delimiter (filter_t f, char c)
+{
+    f->delim = c;
+}
+
+void filter_set_max_lines (filter_t f, int n)
+{
+    f->max_lines = n;
+}
+
+static bool _field_selected (filter_t f, int n)
+{
+    int i;
+    for (i = 0; i < f->nfields; i++) {
+        if (n >= f->fields[i].lo && n <= f->fields[i].hi)
+            return (true);
+    }
+    return (false);
+}
+
+static bool _is_delim (filter_t f, char c)
+{
+    return (f->delim ? (c == f->delim) : (c == ' ' || c == '\t'));
+}
+
+/*
+ *  Rewrite `line' (without trailing newline) in place to hold only the
+ *   selected fields. Since the result is never longer than the input,
+ *   fields may be copied down as they are found.
+ */
+static void _select_fields (filter_t f, char *line)
+{
+    char sep = f->delim ? f->delim : ' ';
+    char *src = line;
+    char *dst = line;
+    int n = 0;
+
+    for (;;) {
+        char *start;
+
+        if (f->delim == 0) {
+            while (*src && _is_delim (f, *src))
+                src++;
+            if (*src == '\0')
+                break;
+        }
+
+        start = src;
+        while (*src && !_is_delim (f, *src))
+            src++;
+
+        if (_field_selected (f, ++n)) {
+            if (dst != line)
+                *dst++ = sep;
+            memmove (dst, start, src - start);
+            dst += src - start;
+        }
+
+        if (*src == '\0')
+            break;
+        src++;
+    }
+
+    *dst = '\0';
+}
+
+static bool _matches_any (struct pattern *v, int n, const char *line)
+{
+    int i;
+    for (i = 0; i < n; i++) {
+        if (regexec (&v[i].re, line, 0, NULL, 0) == 0)
+            return (true);
+    }
+    return (false);
+}
+
+bool filter_line (filter_t f, char *line, int *nlines)
+{
+    size_t len = strlen (line);
+    bool newline = (len > 0 && line[len - 1] == '\n');
+    bool keep = true;
+
+    if (f->max_lines && *nlines >= f->max_lines)
+        return (false);
+
+    /*
+     *  Match against the line without its newline, so that patterns
+     *   anchored with `$' work as expected.
+     */
+    if (newline)
+        line[--len] = '\0';
+
+    if (f->nexclude && _matches_any (f->exclude, f->nexclude, line))
+        keep = false;
+    else if (f->ninclude && !_matches_any (f->include, f->ninclude, line))
+        keep = false;
+    else if (f->nfields) {
+        _select_fields (f, line);
+        len = strlen (line);
+    }
+
+    if (newline) {
+        line[len] = '\n';
+        line[len + 1] = '\0';
+    }
+
+    if (keep)
+        (*nlines)++;
+
+    return (keep);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,89 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Output filter: selects and transforms lines of output from remote
+ *   hosts before they are printed. A filter is built from options
+ *   once, then cloned for each host thread, so that lines are filtered
+ *   in parallel before reaching the shared output stream. Each thread
+ *   needs its own copy since regexec() locks the compiled pattern.
+ */
+
+#ifndef _HAVE_FILTER_H
+#define _HAVE_FILTER_H
+
+#include "src/common/macros.h"
+
+typedef struct filter * filter_t;
+
+filter_t filter_create (void);
+void filter_destroy (filter_t f);
+
+/*
+ *  Return a new filter with the same settings as `f', with its own
+ *   compiled copy of every pattern.
+ */
+filter_t filter_clone (filter_t f);
+
+/*
+ *  Add an extended regular expression which lines must match (or with
+ *   `exclude' set, must not match) to be printed. A line is printed if it
+ *   matches none of the exclude patterns and, if any include patterns
+ *   are given, at least one include pattern.
+ *   Returns -1 and prints an error if the pattern is invalid.
+ */
+int filter_add_regex (filter_t f, const char *pattern, bool exclude);
+
+/*
+ *  Print only the fields in `spec', a comma separated list of field
+ *   numbers and ranges (e.g. "1,3-5,7-") counted from 1.
+ *   Returns -1 and prints an error if `spec' is invalid.
+ */
+int filter_set_fields (filter_t f, const char *spec);
+
+/*
+ *  Set field delimiter. By default fields are separated by runs of
+ *   blanks, and printed separated by a single space.
+ */
+void filter_set_delimiter (filter_t f, char c);
+
+/*
+ *  Print at most `n' lines from each host (0 for no limit)
+ */
+void filter_set_max_lines (filter_t f, int n);
+
+/*
+ *  Apply filter `f' to NUL terminated `line', which may be modified in
+ *   place. `nlines' points to the count of lines printed so far for the
+ *   host, and is updated. Returns true if the line should be printed.
+ */
+bool filter_line (filter_t f, char *line, int *nlines);
+
+#endif /* !_HAVE_FILTER_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
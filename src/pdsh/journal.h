@@ -0,0 +1,122 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  On-disk format of the output journal written by the "output/journal"
+ *   module (-J file) and read by pdjournal(1).
+ *
+ *  The journal consists of two files:
+ *
+ *  "file" is an append-only log, beginning with a journal_header and
+ *   followed by records. Each record is a journal_record followed by
+ *   `len' bytes of data, padded so that every record begins on an 8 byte
+ *   boundary. Output of a host is stored in DATA records holding data of
+ *   one stream each, which are chained to the previous DATA record of the
+ *   same host through `prev'. When a host completes, a HOST record holding
+ *   the host name is appended.
+ *
+ *  "file.idx" begins with a journal_index_header, followed by one
+ *   journal_index_entry per host, appended as each host completes. When
+ *   pdsh exits normally, a hash table of host names and a journal_trailer
+ *   are appended, so that a host's entry can be found without scanning
+ *   the index. Readers must handle an index without a trailer (e.g. an
+ *   interrupted pdsh) by scanning the entries.
+ *
+ *  All offsets are relative to the start of the file they refer to, and
+ *   all values are in host byte order.
+ */
+
+#ifndef _HAVE_JOURNAL_H
+#define _HAVE_JOURNAL_H
+
+#include <stdint.h>
+
+#define JOURNAL_MAGIC         "PDSHJRNL"
+#define JOURNAL_IDX_MAGIC     "PDSHJIDX"
+#define JOURNAL_TRAILER_MAGIC "PDSHJEND"
+#define JOURNAL_VERSION       1
+
+#define JOURNAL_REC_DATA      1
+#define JOURNAL_REC_HOST      2
+
+#define JOURNAL_HOST_FAILED   0x1
+
+/*
+ *  Round record data length up to next 8 byte boundary
+ */
+#define JOURNAL_ALIGN(n)      (((n) + 7) & ~((uint64_t) 7))
+
+struct journal_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t flags;
+    int64_t  ctime;
+};
+
+struct journal_record {
+    uint32_t type;              /* JOURNAL_REC_DATA or JOURNAL_REC_HOST    */
+    uint32_t hostid;            /* pdsh node index                         */
+    uint32_t stream;            /* OUTPUT_STDOUT or OUTPUT_STDERR          */
+    uint32_t len;               /* length of data following this record    */
+    uint64_t prev;              /* offset of previous chunk for host or 0  */
+};
+
+struct journal_index_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+};
+
+struct journal_index_entry {
+    uint64_t name_off;          /* offset of host name in the log          */
+    uint64_t last;              /* offset of last chunk record for host    */
+    uint64_t nbytes;            /* total bytes of output                   */
+    uint64_t nlines;            /* total lines of output                   */
+    uint64_t digest[2];         /* digest of stdout and stderr output      */
+    uint32_t name_len;
+    uint32_t hostid;
+    int32_t  rc;                /* remote return code                      */
+    uint32_t flags;             /* JOURNAL_HOST_FAILED                     */
+};
+
+/*
+ *  Hash table of host names: `nbuckets' (a power of two) uint32_t slots
+ *   at `table_off' in the index, each holding 0 for an empty slot or
+ *   1 + the number of an index entry. The entry for a host is found by
+ *   linear probing from slot digest_buf(host) & (nbuckets - 1).
+ */
+struct journal_trailer {
+    char     magic[8];
+    uint32_t nentries;
+    uint32_t nbuckets;
+    uint64_t table_off;
+};
+
+#endif /* !_HAVE_JOURNAL_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -56,6 +56,8 @@
 #include "mod.h"
 #include "pcp_client.h"
 #include "pcp_server.h"
+#include "pcp_chain.h"
+#include "pcp_walk.h"
 #include "privsep.h"
 
 extern const char *pdsh_module_dir;
@@ -404,13 +406,24 @@ static int _pcp_remote_server (opt_t *opt)
     svr->preserve =      opt->preserve;
     svr->target_is_dir = opt->target_is_directory;
     svr->outfile =       opt->outfile_name;
-
+    svr->pipeline =      (opt->pcp_window > 0);
+    svr->store =         NULL;
+    svr->verify =        opt->pcp_verify;
+    svr->stats =         NULL;
+    svr->prealloc =      opt->pcp_prealloc;
+    svr->direct =        opt->pcp_direct;
+    svr->nocache =       opt->pcp_nocache;
+    svr->fsync =         opt->pcp_fsync;
+
+    if (opt->pcp_chain_next)
+        return (pcp_chain_server (svr, opt));
     return (pcp_server (svr));
 }
 
 static int _pcp_remote_client (opt_t *opt)
 {
     struct pcp_client pcp[1];
+    int rc;
 
     pcp->infd =  STDIN_FILENO;
     pcp->outfd = STDOUT_FILENO;
@@ -420,8 +433,31 @@ static int _pcp_remote_client (opt_t *opt)
     pcp->host =       opt->pcp_client_host;
     pcp->preserve =   opt->preserve;
     pcp->pcp_client = opt->pcp_client;
+    pcp->window =     opt->pcp_window;
+    pcp->archive =    opt->pcp_archive;
+    pcp->sync =       opt->pcp_sync;
+    pcp->compress =   opt->pcp_compress;
+    pcp->sparse =     opt->pcp_sparse;
+    pcp->verify =     false;
+    pcp->digest =     NULL;
+    pcp->hostdir =    opt->pcp_hostdir;
+    pcp->resume =     false;
+    pcp->rate =       NULL;
+    pcp->stats =      NULL;
+    pcp->queue =      NULL;
+
+#if HAVE_ZLIB
+    if (opt->pcp_compress) {
+        pcp_source_cache_init (opt->source_cache);
+        pcp_source_cache_set_filter (pcp_compress_chunk);
+    }
+#endif
 
-    return (pcp_client (pcp));
+    rc = pcp_client (pcp);
+    pcp_check_unchanged (pcp->infiles);
+    list_destroy (pcp->infiles);
+    pcp_walk_fini ();
+    return (rc);
 }
 
 
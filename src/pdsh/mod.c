@@ -643,6 +643,15 @@ mod_get_rcmd_destroy (mod_t mod)
         return NULL;
 }
 
+struct pdsh_output_operations *
+mod_get_output_ops (mod_t mod)
+{
+    assert (mod != NULL);
+    assert (mod->pmod != NULL);
+
+    return (mod->pmod->output_ops);
+}
+
 
 int 
 mod_process_opt(opt_t *opt, int c, char *optarg)
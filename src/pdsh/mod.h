@@ -158,6 +158,18 @@ typedef int        (*RcmdF)         (char *, char *, char *, char *, char *,
                                      int, int *, void **);
 typedef int        (*RcmdDestroyF)  (void *);
 
+/*
+ * Functions that may be exported by any output module
+ *   via a pdsh_output_operations structure. See output.h
+ *   for a description of each event.
+ */
+typedef int        (*OutputInitF)   (opt_t *);
+typedef void *     (*OutputStartF)  (const char *, int);
+typedef int        (*OutputLineF)   (void *, int, const char *, int);
+typedef int        (*OutputDataF)   (void *, int, const char *, int);
+typedef int        (*OutputExitF)   (void *, int, bool);
+typedef int        (*OutputFiniF)   (void);
+
 /*
  *  Module accessor functions. Return module name, type, and
  *    look up additional exported symbols in given module.
@@ -171,6 +183,7 @@ RcmdInitF    mod_get_rcmd_init(mod_t mod);
 RcmdSigF     mod_get_rcmd_signal(mod_t mod);
 RcmdF        mod_get_rcmd(mod_t mod);
 RcmdDestroyF mod_get_rcmd_destroy(mod_t mod);
+struct pdsh_output_operations * mod_get_output_ops(mod_t mod);
 
 
 /* 
@@ -197,6 +210,19 @@ struct pdsh_rcmd_operations {
     RcmdDestroyF rcmd_destroy;
 };
 
+/* 
+ * Stores all output operations of a module 
+ */
+struct pdsh_output_operations {
+    OutputInitF  output_init;   /* Called once per job. Return 1 to
+                                   receive events, 0 to stay idle.         */
+    OutputStartF output_start;  /* Host started, returns per-host handle   */
+    OutputLineF  output_line;   /* One complete line of host output        */
+    OutputDataF  output_data;   /* Unterminated data flushed at host exit  */
+    OutputExitF  output_exit;   /* Host finished, handle may be freed      */
+    OutputFiniF  output_fini;   /* Called once all hosts have finished     */
+};
+
 /* 
  * Stores all information about a module 
  */
@@ -210,6 +236,7 @@ struct pdsh_module {
     struct pdsh_module_operations *mod_ops;
     struct pdsh_rcmd_operations   *rcmd_ops;
     struct pdsh_module_option     *opt_table;
+    struct pdsh_output_operations *output_ops;
 };
 
 #endif /* !_MOD_H */
@@ -45,6 +45,7 @@
 
 #include <regex.h>
 #include <ctype.h>
+#include <limits.h>             /* INT_MAX */
 
 #include "src/common/hostlist.h"
 #include "src/common/err.h"
@@ -57,6 +58,7 @@
 #include "wcoll.h"
 #include "mod.h"
 #include "rcmd.h"
+#include "pcp_source.h"
 
 /*
  *  Fallback maximum username length if sysconf(_SC_LOGIN_NAME_MAX) not
@@ -107,6 +109,7 @@ Usage: rpdcp [-options] src [src2...] dir\n\
 -R name           set rcmd module to name\n\
 -M name,...       select one or more misc modules to initialize first\n\
 -N                disable hostname: labels on output lines\n\
+-o opt[=value]    set extended option (-o help for a list)\n\
 -L                list info on all loaded modules and exit\n"
 /* undocumented "-T testcase" option */
 /* undocumented "-Q" option */
@@ -118,7 +121,7 @@ Usage: rpdcp [-options] src [src2...] dir\n\
 #define DSH_ARGS    "S"
 #endif
 #define PCP_ARGS	"pryzZe:"
-#define GEN_ARGS	"hLNKR:M:t:cqf:w:x:l:u:bI:dVT:Q"
+#define GEN_ARGS	"hLNKR:M:t:cqf:w:x:l:u:bI:dVT:Qo:"
 
 
 /*
@@ -165,6 +168,7 @@ static List regex_list = NULL;
 
 static void _usage(opt_t * opt);
 static void _show_version(void);
+static void _process_extended_option (opt_t *opt, char *arg);
 static int wcoll_args_process (opt_t *opt, char *args);
 static void wcoll_apply_regex (opt_t *opt, List regexs);
 static void wcoll_apply_excluded (opt_t *opt, List excludes);
@@ -376,6 +380,9 @@ void opt_default(opt_t * opt, char *argv0)
     opt->altnames = false;
     opt->debug = false;
     opt->labels = true;
+    opt->group_order = GROUP_NONE;
+    opt->group_memory = 64 * 1024 * 1024;
+    opt->filter = NULL;
 
     opt->rcmd_name = NULL;
     opt->misc_modules = NULL;
@@ -418,6 +425,27 @@ void opt_default(opt_t * opt, char *argv0)
     opt->target_is_directory = false;
     opt->pcp_client = false;
     opt->pcp_client_host = NULL;
+    opt->source_cache = 0;
+    opt->pcp_window = 0;
+    opt->pcp_archive = false;
+    opt->pcp_sync = false;
+    opt->pcp_compress = false;
+    opt->pcp_sparse = false;
+    opt->pcp_verify = false;
+    opt->pcp_prealloc = false;
+    opt->pcp_direct = false;
+    opt->pcp_nocache = false;
+    opt->pcp_fsync = false;
+    opt->pcp_chains = 0;
+    opt->pcp_streams = 0;
+    opt->pcp_chain_next = NULL;
+    opt->pcp_hostdir = false;
+    opt->pcp_dedup = NULL;
+    opt->pcp_resume = false;
+    opt->pcp_resume_journal = NULL;
+    opt->pcp_rate = 0;
+    opt->pcp_host_rate = 0;
+    opt->pcp_progress = 0;
 
     return;
 }
@@ -437,6 +465,38 @@ static int string_to_int (const char *val, int *p2int)
     return (0);
 }
 
+/*
+ *  Convert `val' of the form N[KMG] to a number of bytes
+ */
+static int string_to_size (const char *val, size_t *p2size)
+{
+    char *p;
+    unsigned long long n;
+
+    errno = 0;
+    n = strtoull (val, &p, 10);
+    if (errno || p == val)
+        return (-1);
+
+    switch (*p) {
+    case 'g': case 'G': 
+        n *= 1024;
+        /* fall through */
+    case 'm': case 'M': 
+        n *= 1024;
+        /* fall through */
+    case 'k': case 'K': 
+        n *= 1024;
+        p++;
+    }
+    if (*p != '\0')
+        return (-1);
+
+    *p2size = (size_t) n;
+
+    return (0);
+}
+
 /*
  * Override default options with environment variables.
  *	opt (IN/OUT)	option struct	
@@ -654,6 +714,9 @@ void opt_args(opt_t * opt, int argc, char *argv[])
         case 'K':              /* don't strip host domain in output */
             err_no_strip_domain (); 
             break;
+        case 'o':              /* extended option */
+            _process_extended_option (opt, optarg);
+            break;
         case 'y':
             if (pdsh_personality() == PCP)
                 opt->target_is_directory = true;  /* is target a dir? */
@@ -885,6 +948,85 @@ bool opt_verify(opt_t * opt)
         }
     }
 
+    /* PCP: the hosts where files failed to verify are listed by pdcp */
+    if (personality == PCP && opt->pcp_verify && opt->reverse_copy) {
+        err("%p: -o verify cannot be used with rpdcp\n");
+        verified = false;
+    }
+
+    /* PCP: rpdcp writes with the local pdcp server, which has no tuning */
+    if (personality == PCP && opt->reverse_copy && (opt->pcp_prealloc 
+        || opt->pcp_direct || opt->pcp_nocache || opt->pcp_fsync)) {
+        err("%p: -o prealloc, direct, nocache and fsync cannot be used "
+            "with rpdcp\n");
+        verified = false;
+    }
+
+    /* PCP: sync errors are reported with the final ack of an archive */
+    if (personality == PCP && opt->pcp_fsync && !opt->pcp_server)
+        opt->pcp_archive = true;
+
+    /* PCP: only data sent by pdcp is shaped */
+    if (personality == PCP && (opt->pcp_rate || opt->pcp_host_rate) 
+        && opt->reverse_copy) {
+        err("%p: -o rate and -o host-rate cannot be used with rpdcp\n");
+        verified = false;
+    }
+
+    /* PCP: the journal records hosts which received files from pdcp */
+    if (personality == PCP && opt->pcp_resume && opt->reverse_copy) {
+        err("%p: -o resume cannot be used with rpdcp\n");
+        verified = false;
+    }
+
+    /* PCP: a chained copy sends an archive stream down each chain */
+    if (personality == PCP && opt->pcp_chains) {
+        if (opt->reverse_copy || opt->pcp_sync) {
+            err("%p: -o chain cannot be used with rpdcp or -o sync\n");
+            verified = false;
+        }
+        opt->pcp_archive = true;
+    }
+
+    /* PCP: the connections to a host share the files of an archive stream */
+    if (personality == PCP && opt->pcp_streams) {
+        if (opt->reverse_copy || opt->pcp_sync || opt->pcp_chains) {
+            err("%p: -o streams cannot be used with rpdcp, -o sync "
+                "or -o chain\n");
+            verified = false;
+        }
+        opt->pcp_archive = true;
+    }
+
+    /* PCP: gathered files are linked into the store, not patched */
+    if (personality == PCP && opt->pcp_dedup && opt->reverse_copy) {
+        if (opt->pcp_sync) {
+            err("%p: -o dedup cannot be used with -o sync\n");
+            verified = false;
+        }
+        if (*opt->pcp_dedup == '\0' && opt->outfile_name) {
+            Free((void **) &opt->pcp_dedup);
+            xstrcat(&opt->pcp_dedup, opt->outfile_name);
+            xstrcat(&opt->pcp_dedup, "/.pdcp-store");
+        }
+    }
+
+    /* PCP: hostdir and dedup apply to files gathered by rpdcp */
+    if (personality == PCP && !opt->reverse_copy) {
+        if (opt->pcp_dedup) {
+            err("%p: -o dedup can only be used with rpdcp\n");
+            verified = false;
+        }
+        if (opt->pcp_hostdir && !opt->pcp_client) {
+            err("%p: -o hostdir can only be used with rpdcp\n");
+            verified = false;
+        }
+    }
+
+    /* PCP: the archive stream has no per-file acks to pipeline */
+    if (personality == PCP && opt->pcp_archive)
+        opt->pcp_window = 0;
+
     /* PCP: server and client sanity check */
     if (personality == PCP && opt->pcp_server && opt->pcp_client) {
         err("%p: pcp server and pcp client cannot both be set\n");
@@ -968,6 +1110,10 @@ void opt_list(opt_t * opt)
         out("Path prepended to cmd	%s\n", STRORNULL(opt->dshpath));
         out("Appended to cmd         %s\n", STRORNULL(opt->getstat));
         out("Command:		%s\n", STRORNULL(opt->cmd));
+        out("Grouped output		%s\n", 
+            opt->group_order == GROUP_HOSTLIST ? "hostlist order" :
+            opt->group_order == GROUP_COMPLETION ? "completion order" : "No");
+        out("Output filter		%s\n", BOOLSTR(opt->filter != NULL));
     } else {
         char infiles [4096];
         out("-- PCP-specific options --\n");
@@ -976,6 +1122,42 @@ void opt_list(opt_t * opt)
         out("Outfile			%s\n", STRORNULL(opt->outfile_name));
         out("Recursive		%s\n", BOOLSTR(opt->recursive));
         out("Preserve mod time/mode	%s\n", BOOLSTR(opt->preserve));
+        if (opt->source_cache) {
+            char size [64];
+            snprintf (size, sizeof (size), "%lu", 
+                      (unsigned long) opt->source_cache);
+            out("Shared source cache	%s bytes\n", size);
+        }
+        if (opt->pcp_window)
+            out("Pipeline window		%d records\n", opt->pcp_window);
+        out("Archive stream		%s\n", BOOLSTR(opt->pcp_archive));
+        out("Sync changed files	%s\n", BOOLSTR(opt->pcp_sync));
+        out("Compress file data	%s\n", BOOLSTR(opt->pcp_compress));
+        out("Sparse files		%s\n", BOOLSTR(opt->pcp_sparse));
+        out("Verify digests		%s\n", BOOLSTR(opt->pcp_verify));
+        out("Preallocate files	%s\n", BOOLSTR(opt->pcp_prealloc));
+        out("Direct I/O		%s\n", BOOLSTR(opt->pcp_direct));
+        out("Drop from cache		%s\n", BOOLSTR(opt->pcp_nocache));
+        out("Sync target		%s\n", BOOLSTR(opt->pcp_fsync));
+        if (opt->pcp_chains)
+            out("Chains			%d\n", opt->pcp_chains);
+        if (opt->pcp_streams)
+            out("Streams per host	%d\n", opt->pcp_streams);
+        if (opt->reverse_copy) {
+            out("Per-host directories	%s\n", BOOLSTR(opt->pcp_hostdir));
+            out("Dedup store		%s\n", STRORNULL(opt->pcp_dedup));
+        }
+        out("Resume copy		%s\n", BOOLSTR(opt->pcp_resume));
+        if (opt->pcp_resume_journal)
+            out("Resume journal		%s\n", opt->pcp_resume_journal);
+        if (opt->pcp_rate)
+            out("Send rate limit		%lu bytes/s\n", 
+                (unsigned long) opt->pcp_rate);
+        if (opt->pcp_host_rate)
+            out("Per host rate limit	%lu bytes/s\n", 
+                (unsigned long) opt->pcp_host_rate);
+        if (opt->pcp_progress)
+            out("Progress interval	%d sec\n", opt->pcp_progress);
         if (opt->pcp_server) {
             out("pcp server         	%s\n", BOOLSTR(opt->pcp_server));
             out("target is directory	%s\n", BOOLSTR(opt->target_is_directory));
@@ -1026,6 +1208,12 @@ void opt_free(opt_t * opt)
         Free((void **) &opt->cmd);
     if (opt->rcmd_name != NULL)
         Free((void **) &opt->rcmd_name);
+    if (opt->pcp_chain_next != NULL)
+        Free((void **) &opt->pcp_chain_next);
+    if (opt->pcp_dedup != NULL)
+        Free((void **) &opt->pcp_dedup);
+    if (opt->pcp_resume_journal != NULL)
+        Free((void **) &opt->pcp_resume_journal);
     if (opt->misc_modules != NULL)
         Free((void **) &opt->misc_modules);
     if (pdsh_options)
@@ -1042,6 +1230,8 @@ void opt_free(opt_t * opt)
         Free((void **) &opt->luser);
     if (opt->ruser)
         Free((void **) &opt->ruser);
+    if (opt->filter)
+        filter_destroy(opt->filter);
 
     rcmd_exit();
 }
@@ -1111,6 +1301,440 @@ done:
     return buf;
 }
 
+/*
+ *  Extended options, given as "-o name[=value]". These are options
+ *   which do not merit a single option character of their own.
+ */
+typedef int (*extOptFunc) (opt_t *opt, const char *name, const char *val);
+
+struct ext_option {
+    char *     name;
+    char *     arginfo;     /* descr of value, NULL if none, "[..]" if optional */
+    char *     descr;
+    int        personality;
+    extOptFunc f;
+};
+
+static int _ext_group (opt_t *opt, const char *name, const char *val)
+{
+    if (val == NULL || strcmp (val, "hostlist") == 0)
+        opt->group_order = GROUP_HOSTLIST;
+    else if (strcmp (val, "completion") == 0)
+        opt->group_order = GROUP_COMPLETION;
+    else {
+        err ("%p: -o %s: order must be \"hostlist\" or \"completion\"\n",
+             name);
+        return (-1);
+    }
+    return (0);
+}
+
+static int _ext_size (const char *name, const char *val, size_t *p)
+{
+    if (string_to_size (val, p) < 0) {
+        err ("%p: -o %s: invalid size `%s'\n", name, val);
+        return (-1);
+    }
+    return (0);
+}
+
+static int _ext_group_memory (opt_t *opt, const char *name, const char *val)
+{
+    return (_ext_size (name, val, &opt->group_memory));
+}
+
+static filter_t _filter (opt_t *opt)
+{
+    if (opt->filter == NULL)
+        opt->filter = filter_create ();
+    return (opt->filter);
+}
+
+static int _ext_match (opt_t *opt, const char *name, const char *val)
+{
+    bool exclude = (strcmp (name, "exclude") == 0);
+    return (filter_add_regex (_filter (opt), val, exclude));
+}
+
+static int _ext_fields (opt_t *opt, const char *name, const char *val)
+{
+    return (filter_set_fields (_filter (opt), val));
+}
+
+static int _ext_delimiter (opt_t *opt, const char *name, const char *val)
+{
+    if (strlen (val) != 1 || val[0] == '\n') {
+        err ("%p: -o %s: delimiter must be a single character\n", name);
+        return (-1);
+    }
+    filter_set_delimiter (_filter (opt), val[0]);
+    return (0);
+}
+
+static int _ext_max_lines (opt_t *opt, const char *name, const char *val)
+{
+    char *p;
+    long n = strtol (val, &p, 10);
+
+    if (*p != '\0' || n < 0 || n > INT_MAX) {
+        err ("%p: -o %s: invalid number of lines `%s'\n", name, val);
+        return (-1);
+    }
+    filter_set_max_lines (_filter (opt), (int) n);
+    return (0);
+}
+
+static int _ext_source_cache (opt_t *opt, const char *name, const char *val)
+{
+    if (val == NULL) {
+        opt->source_cache = 64 * 1024 * 1024;
+        return (0);
+    }
+    if (_ext_size (name, val, &opt->source_cache) < 0)
+        return (-1);
+    if (opt->source_cache < PCP_SOURCE_CHUNK_SIZE) {
+        err ("%p: -o %s: size must be at least 1M\n", name);
+        return (-1);
+    }
+    return (0);
+}
+
+static int _ext_pipeline (opt_t *opt, const char *name, const char *val)
+{
+    char *p;
+    long n;
+
+    if (val == NULL) {
+        opt->pcp_window = 32;
+        return (0);
+    }
+    n = strtol (val, &p, 10);
+    if (*p != '\0' || n < 1 || n > 64) {
+        err ("%p: -o %s: window must be between 1 and 64\n", name);
+        return (-1);
+    }
+    opt->pcp_window = (int) n;
+    return (0);
+}
+
+static int _ext_archive (opt_t *opt, const char *name, const char *val)
+{
+    opt->pcp_archive = true;
+    if (strcmp (name, "sync") == 0)
+        opt->pcp_sync = true;
+    return (0);
+}
+
+static int _ext_sparse (opt_t *opt, const char *name, const char *val)
+{
+    opt->pcp_sparse = true;
+    return (0);
+}
+
+static int _ext_verify (opt_t *opt, const char *name, const char *val)
+{
+    opt->pcp_verify = true;
+    return (0);
+}
+
+static int _ext_write (opt_t *opt, const char *name, const char *val)
+{
+    if (strcmp (name, "prealloc") == 0)
+        opt->pcp_prealloc = true;
+    else if (strcmp (name, "direct") == 0)
+        opt->pcp_direct = true;
+    else if (strcmp (name, "nocache") == 0)
+        opt->pcp_nocache = true;
+    else
+        opt->pcp_fsync = true;
+    return (0);
+}
+
+static int _ext_compress (opt_t *opt, const char *name, const char *val)
+{
+#if HAVE_ZLIB
+    /* each chunk is compressed once, in the shared source cache */
+    opt->pcp_compress = true;
+    if (opt->source_cache == 0)
+        opt->source_cache = 64 * 1024 * 1024;
+    return (0);
+#else
+    err ("%p: -o %s: pdcp was built without zlib\n", name);
+    return (-1);
+#endif
+}
+
+static int _ext_chain (opt_t *opt, const char *name, const char *val)
+{
+    char *p;
+    long n;
+
+    if (val == NULL) {
+        opt->pcp_chains = 4;
+        return (0);
+    }
+    n = strtol (val, &p, 10);
+    if (*p != '\0' || n < 1 || n > INT_MAX) {
+        err ("%p: -o %s: invalid number of chains `%s'\n", name, val);
+        return (-1);
+    }
+    opt->pcp_chains = (int) n;
+    return (0);
+}
+
+static int _ext_streams (opt_t *opt, const char *name, const char *val)
+{
+    char *p;
+    long n;
+
+    n = strtol (val, &p, 10);
+    if (*p != '\0' || n < 1 || n > 64) {
+        err ("%p: -o %s: invalid number of streams `%s'\n", name, val);
+        return (-1);
+    }
+    opt->pcp_streams = n > 1 ? (int) n : 0;
+    return (0);
+}
+
+static int _ext_chain_next (opt_t *opt, const char *name, const char *val)
+{
+    if (opt->pcp_chain_next)
+        Free ((void **) &opt->pcp_chain_next);
+    opt->pcp_chain_next = Strdup (val);
+    return (0);
+}
+
+static int _ext_hostdir (opt_t *opt, const char *name, const char *val)
+{
+    opt->pcp_hostdir = true;
+    return (0);
+}
+
+static int _ext_dedup (opt_t *opt, const char *name, const char *val)
+{
+    if (opt->pcp_dedup)
+        Free ((void **) &opt->pcp_dedup);
+    opt->pcp_dedup = val ? Strdup (val) : Strdup ("");
+    return (0);
+}
+
+static int _ext_resume (opt_t *opt, const char *name, const char *val)
+{
+    /* the blocks each host already has are found with -o sync */
+    opt->pcp_resume = true;
+    opt->pcp_archive = true;
+    opt->pcp_sync = true;
+    if (opt->pcp_resume_journal)
+        Free ((void **) &opt->pcp_resume_journal);
+    if (val)
+        opt->pcp_resume_journal = Strdup (val);
+    return (0);
+}
+
+static int _ext_rate (opt_t *opt, const char *name, const char *val)
+{
+    size_t *p = strcmp (name, "rate") == 0 ? &opt->pcp_rate 
+                                             : &opt->pcp_host_rate;
+    char *size = Strdup (val);
+    size_t len = strlen (size);
+    int rc;
+
+    /* accept "SIZE/s" as well as "SIZE" */
+    if (len > 2 && strcmp (size + len - 2, "/s") == 0)
+        size[len - 2] = '\0';
+    rc = _ext_size (name, size, p);
+    Free ((void **) &size);
+    if (rc == 0 && *p == 0) {
+        err ("%p: -o %s: rate must be greater than zero\n", name);
+        rc = -1;
+    }
+    return (rc);
+}
+
+static int _ext_progress (opt_t *opt, const char *name, const char *val)
+{
+    char *p;
+    long n;
+
+    if (val == NULL) {
+        opt->pcp_progress = 10;
+        return (0);
+    }
+    n = strtol (val, &p, 10);
+    if (*p != '\0' || n < 1 || n > INT_MAX) {
+        err ("%p: -o %s: invalid interval `%s'\n", name, val);
+        return (-1);
+    }
+    opt->pcp_progress = (int) n;
+    return (0);
+}
+
+static struct ext_option ext_options[] = {
+    { "group", "[order]", 
+      "print output of each host together when it completes, in\n"
+      "                      \"hostlist\" (default) or \"completion\" order",
+      DSH, _ext_group },
+    { "group-memory", "size", 
+      "memory used to hold grouped output before spilling to a\n"
+      "                      temporary file (default 64M)",
+      DSH, _ext_group_memory },
+    { "include", "regex",
+      "print only lines of output matching extended regular\n"
+      "                      expression `regex' (may be repeated)",
+      DSH, _ext_match },
+    { "exclude", "regex",
+      "do not print lines of output matching `regex'\n"
+      "                      (may be repeated)",
+      DSH, _ext_match },
+    { "fields", "list",
+      "print only fields in `list' of each line of output,\n"
+      "                      e.g. \"1,3-5\"",
+      DSH, _ext_fields },
+    { "delimiter", "c",
+      "use `c' as field delimiter instead of blanks",
+      DSH, _ext_delimiter },
+    { "max-lines", "n",
+      "print at most `n' lines of output from each host",
+      DSH, _ext_max_lines },
+    { "source-cache", "[size]",
+      "read each source file once into a cache shared by all\n"
+      "                      hosts, using at most size memory (default 64M)",
+      PCP, _ext_source_cache },
+    { "pipeline", "[window]",
+      "send files without waiting for the remote pdcp to\n"
+      "                      acknowledge each one, with at most `window'\n"
+      "                      records outstanding (default 32)",
+      PCP, _ext_pipeline },
+    { "archive", NULL,
+      "send all files as one stream, without waiting for\n"
+      "                      the remote pdcp between files",
+      PCP, _ext_archive },
+    { "sync", NULL,
+      "like archive, but send only files and blocks of large\n"
+      "                      files which differ on the remote host",
+      PCP, _ext_archive },
+    { "compress", NULL,
+      "compress file data sent over the network, once for\n"
+      "                      all hosts (implies source-cache)",
+      PCP, _ext_compress },
+    { "sparse", NULL,
+      "send only the data of files with holes, and recreate\n"
+      "                      the holes on the remote host",
+      PCP, _ext_sparse },
+    { "verify", NULL,
+      "check each file received against a digest of the data\n"
+      "                      sent, and list the hosts where this failed",
+      PCP, _ext_verify },
+    { "prealloc", NULL,
+      "allocate the full size of each file on the remote host\n"
+      "                      before writing its data",
+      PCP, _ext_write },
+    { "direct", NULL,
+      "write files of 64M or more on the remote host with\n"
+      "                      O_DIRECT, bypassing its page cache",
+      PCP, _ext_write },
+    { "nocache", NULL,
+      "drop the files written from the page cache of the\n"
+      "                      remote host at the end of the copy",
+      PCP, _ext_write },
+    { "fsync", NULL,
+      "sync the files to disk on the remote host at the end of\n"
+      "                      the copy, with one syncfs (implies archive)",
+      PCP, _ext_write },
+    { "chain", "[n]",
+      "split the hosts into `n' chains (default 4), sending to the\n"
+      "                      first host of each, which passes the files on\n"
+      "                      to the next (implies archive)",
+      PCP, _ext_chain },
+    { "chain-next", "hosts", NULL,            /* internal, see pcp_chain.c */
+      PCP, _ext_chain_next },
+    { "streams", "n",
+      "copy to each host over `n' connections, which share the\n"
+      "                      files and chunks of large files (implies archive)",
+      PCP, _ext_streams },
+    { "resume", "[journal]",
+      "like sync, but also send the rest of partially copied\n"
+      "                      files, and skip hosts which `journal' records\n"
+      "                      as complete from an earlier run of the copy",
+      PCP, _ext_resume },
+    { "hostdir", NULL,
+      "rpdcp: write the files of each host into a directory\n"
+      "                      named after the host, below the destination",
+      PCP, _ext_hostdir },
+    { "dedup", "[dir]",
+      "rpdcp: store files with identical contents once, hard\n"
+      "                      linked from a store in `dir' (default\n"
+      "                      dest/.pdcp-store)",
+      PCP, _ext_dedup },
+    { "rate", "size",
+      "send at most `size' bytes per second to all hosts\n"
+      "                      together, e.g. 100M or 100M/s",
+      PCP, _ext_rate },
+    { "host-rate", "size",
+      "send at most `size' bytes per second to each host",
+      PCP, _ext_rate },
+    { "progress", "[secs]",
+      "print the progress of the copy every `secs' seconds\n"
+      "                      (default 10), with the hosts it is waiting on",
+      PCP, _ext_progress },
+    { NULL, NULL, NULL, 0, NULL }
+};
+
+static void _ext_usage (void)
+{
+    struct ext_option *e;
+
+    out ("Extended options (-o name[=value]):\n");
+    for (e = ext_options; e->name; e++) {
+        char buf[64];
+
+        if (!(e->personality & personality) || e->descr == NULL)
+            continue;
+
+        if (e->arginfo == NULL)
+            snprintf (buf, sizeof (buf), "%s", e->name);
+        else if (*e->arginfo == '[')
+            snprintf (buf, sizeof (buf), "%s[=%.*s]", e->name, 
+                      (int) strlen (e->arginfo) - 2, e->arginfo + 1);
+        else
+            snprintf (buf, sizeof (buf), "%s=%s", e->name, e->arginfo);
+
+        out ("  %s\n", buf);
+        out ("                      %s\n", e->descr);
+    }
+    exit (0);
+}
+
+static void _process_extended_option (opt_t *opt, char *arg)
+{
+    struct ext_option *e;
+    char *name = Strdup (arg);
+    char *val = strchr (name, '=');
+
+    if (val)
+        *val++ = '\0';
+
+    if (strcmp (name, "help") == 0)
+        _ext_usage ();
+
+    for (e = ext_options; e->name; e++) {
+        if ((e->personality & personality) && strcmp (e->name, name) == 0)
+            break;
+    }
+
+    if (e->name == NULL)
+        errx ("%p: Unknown option \"-o %s\" (see -o help)\n", name);
+    if (e->arginfo == NULL && val != NULL)
+        errx ("%p: Option \"-o %s\" does not take a value\n", name);
+    if (e->arginfo && *e->arginfo != '[' && (val == NULL || *val == '\0'))
+        errx ("%p: Option \"-o %s\" requires a value\n", name);
+
+    if ((*e->f) (opt, name, val) < 0)
+        exit (1);
+
+    Free ((void **) &name);
+}
+
 /*
  * Spit out all the options and their one-line synopsis for the user, 
  * then exit.
@@ -1277,7 +1901,7 @@ static void list_push_hostlist (List l, hostlist_t hl)
     size_t n = 4096;
     char *s = Malloc (n);
 
-    while ((hostlist_ranged_string (hl, n-1, s) < 0) && (n*=2 < 0x7fffff)) {
+    while ((hostlist_ranged_string (hl, n-1, s) < 0) && ((n *= 2) < 0x7fffff)) {
         Realloc ((void **) &s, n);
     }
 
@@ -1394,18 +2018,22 @@ static void wcoll_apply_regex (opt_t *opt, List regexs)
 static void wcoll_apply_excluded (opt_t *opt, List excludes)
 {
     ListIterator i;
+    hostlist_t hl;
     char *arg;
 
     if (!opt->wcoll || !excludes)
         return;
 
     /*
-     *  filter explicitly excluded hosts:
+     *  filter explicitly excluded hosts, all in one pass:
      */
+    hl = hostlist_create ("");
     i = list_iterator_create (excludes);
     while ((arg = list_next (i)))
-        hostlist_delete (opt->wcoll, arg);
+        hostlist_push (hl, arg);
     list_iterator_destroy (i);
+    hostlist_delete_list (opt->wcoll, hl);
+    hostlist_destroy (hl);
 }
 
 /*
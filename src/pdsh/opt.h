@@ -36,6 +36,7 @@
 #include "src/common/macros.h"
 #include "src/common/list.h"
 #include "src/common/hostlist.h"
+#include "src/pdsh/filter.h"
 
 #define MAX_GENDATTR	64
 
@@ -46,6 +47,9 @@
 /* set to 0x1 and 0x2 so we can do bitwise operations with DSH and PCP */
 typedef enum { DSH = 0x1, PCP = 0x2} pers_t;
 
+/* order in which grouped output (-o group) is printed */
+typedef enum { GROUP_NONE, GROUP_HOSTLIST, GROUP_COMPLETION } group_order_t;
+
 typedef struct {
 
     /* common options */
@@ -79,6 +83,9 @@ typedef struct {
     char *getstat;              /* optional echo $? appended to cmd */
     bool ret_remote_rc;         /* -S: return largest remote return val */
     bool labels;                /* display host: before output */
+    group_order_t group_order;  /* -o group: print output per host */
+    size_t group_memory;        /* -o group-memory: buffer before spilling */
+    filter_t filter;            /* -o include, exclude, fields, max-lines */
 
     /* PCP-specific options */
     bool preserve;              /* -p */
@@ -92,6 +99,27 @@ typedef struct {
     char *local_program_path;   /* absolute path to program on local node   */
     char *remote_program_path;  /* absolute path to program on remote nodes */
     bool reverse_copy;          /* rpdcp: reverse copy */
+    size_t source_cache;        /* -o source-cache: shared source memory */
+    int pcp_window;             /* -o pipeline: max unacked records or 0 */
+    bool pcp_archive;           /* -o archive: send files as one stream */
+    bool pcp_sync;              /* -o sync: send only changed files */
+    bool pcp_compress;          /* -o compress: compress file data */
+    bool pcp_sparse;            /* -o sparse: send only data of holey files */
+    bool pcp_verify;            /* -o verify: compare digests of files */
+    int pcp_chains;             /* -o chain: number of chains, or 0 */
+    int pcp_streams;            /* -o streams: connections per host, or 0 */
+    char *pcp_chain_next;       /* -o chain-next: later hosts of chain */
+    bool pcp_hostdir;           /* -o hostdir: rpdcp into dest/host/ */
+    char *pcp_dedup;            /* -o dedup: rpdcp content store or NULL */
+    bool pcp_resume;            /* -o resume: send only missing blocks */
+    char *pcp_resume_journal;   /* -o resume: completed hosts, or NULL */
+    size_t pcp_rate;            /* -o rate: bytes/s sent to all hosts */
+    size_t pcp_host_rate;       /* -o host-rate: bytes/s sent to each host */
+    int pcp_progress;           /* -o progress: secs between lines, or 0 */
+    bool pcp_prealloc;          /* -o prealloc: allocate files up front */
+    bool pcp_direct;            /* -o direct: write large files O_DIRECT */
+    bool pcp_nocache;           /* -o nocache: drop files from page cache */
+    bool pcp_fsync;             /* -o fsync: sync target at end of copy */
 } opt_t;
 
 
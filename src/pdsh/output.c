@@ -0,0 +1,250 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Dispatch of per-host output events to "output" type modules.
+ *
+ *  Each active output module (sink) returns an opaque handle from
+ *   its output_start function for every host. Line, data and exit
+ *   events for the host are then passed to each sink along with that
+ *   handle. Since all events for one host come from that host's
+ *   thread, sinks only need to lock state shared between hosts.
+ */
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "src/common/err.h"
+#include "src/common/xmalloc.h"
+#include "src/common/list.h"
+#include "opt.h"
+#include "mod.h"
+#include "output.h"
+
+struct output_module {
+    char *              name;
+    mod_t               mod;
+    OutputInitF         init;
+    OutputStartF        start;
+    OutputLineF         line;
+    OutputDataF         data;
+    OutputExitF         exit;
+    OutputFiniF         fini;
+};
+
+struct output_host {
+    char *              host;
+    void **             args;   /* per-sink handles, indexed as sinks[] */
+    bool *              failed; /* sink returned an error for this host */
+};
+
+static struct output_module *sinks = NULL;
+static int nsinks = 0;
+
+static int output_module_create (struct output_module *omod, mod_t mod)
+{
+    struct pdsh_output_operations *ops = mod_get_output_ops (mod);
+
+    memset (omod, 0, sizeof (*omod));
+
+    omod->mod  = mod;
+    omod->name = mod_get_name (mod);
+
+    if (!ops || !ops->output_start || !ops->output_exit) {
+        err ("%p: Unable to resolve output operations in module \"%s\"\n",
+             omod->name);
+        return (-1);
+    }
+
+    if (!ops->output_line && !ops->output_data) {
+        err ("%p: Output module \"%s\" exports no line or data function\n",
+             omod->name);
+        return (-1);
+    }
+
+    omod->init  = ops->output_init;
+    omod->start = ops->output_start;
+    omod->line  = ops->output_line;
+    omod->data  = ops->output_data;
+    omod->exit  = ops->output_exit;
+    omod->fini  = ops->output_fini;
+
+    return (0);
+}
+
+int output_init (opt_t *opt)
+{
+    List l;
+    ListIterator i;
+    char *name;
+
+    if (sinks != NULL)
+        return (nsinks);
+
+    if (!(l = mod_get_module_names ("output")))
+        return (-1);
+
+    sinks = Malloc ((list_count (l) + 1) * sizeof (*sinks));
+    nsinks = 0;
+
+    i = list_iterator_create (l);
+    while ((name = list_next (i))) {
+        struct output_module *omod = &sinks[nsinks];
+        mod_t mod = mod_get_module ("output", name);
+        int rc = 1;
+
+        if (!mod || output_module_create (omod, mod) < 0)
+            continue;
+
+        if (omod->init && (rc = (*omod->init) (opt)) < 0) {
+            err ("%p: Failed to initialize output module \"%s\"\n", name);
+            list_iterator_destroy (i);
+            list_destroy (l);
+            return (-1);
+        }
+
+        /*
+         *  Modules returning 0 from init have nothing to do this time
+         */
+        if (rc > 0)
+            nsinks++;
+    }
+    list_iterator_destroy (i);
+    list_destroy (l);
+
+    return (nsinks);
+}
+
+struct output_host * output_host_start (const char *host, int nodeid)
+{
+    struct output_host *h;
+    int i;
+
+    if (nsinks == 0)
+        return (NULL);
+
+    h = Malloc (sizeof (*h));
+    h->host = Strdup (host);
+    h->args = Malloc (nsinks * sizeof (void *));
+    h->failed = Malloc (nsinks * sizeof (bool));
+
+    for (i = 0; i < nsinks; i++) {
+        h->failed[i] = false;
+        if (!(h->args[i] = (*sinks[i].start) (host, nodeid))) {
+            err ("%p: %S: output module \"%s\" failed to start\n", 
+                 host, sinks[i].name);
+            h->failed[i] = true;
+        }
+    }
+
+    return (h);
+}
+
+static void _sink_error (struct output_host *h, int i)
+{
+    err ("%p: %S: output module \"%s\" failed, dropping further output\n",
+         h->host, sinks[i].name);
+    h->failed[i] = true;
+}
+
+void output_host_line (struct output_host *h, int stream, 
+                       const char *buf, int len)
+{
+    int i;
+
+    if (h == NULL)
+        return;
+
+    for (i = 0; i < nsinks; i++) {
+        OutputLineF f = sinks[i].line ? sinks[i].line : sinks[i].data;
+
+        if (!h->failed[i] && (*f) (h->args[i], stream, buf, len) < 0)
+            _sink_error (h, i);
+    }
+}
+
+void output_host_data (struct output_host *h, int stream, 
+                       const char *buf, int len)
+{
+    int i;
+
+    if (h == NULL)
+        return;
+
+    for (i = 0; i < nsinks; i++) {
+        OutputDataF f = sinks[i].data ? sinks[i].data : sinks[i].line;
+
+        if (!h->failed[i] && (*f) (h->args[i], stream, buf, len) < 0)
+            _sink_error (h, i);
+    }
+}
+
+void output_host_exit (struct output_host *h, int rc, bool failed)
+{
+    int i;
+
+    if (h == NULL)
+        return;
+
+    for (i = 0; i < nsinks; i++) {
+        if (h->args[i] && (*sinks[i].exit) (h->args[i], rc, failed) < 0)
+            err ("%p: %S: output module \"%s\" failed to finish\n",
+                 h->host, sinks[i].name);
+    }
+
+    Free ((void **) &h->failed);
+    Free ((void **) &h->args);
+    Free ((void **) &h->host);
+    Free ((void **) &h);
+}
+
+int output_fini (void)
+{
+    int i;
+    int rc = 0;
+
+    for (i = 0; i < nsinks; i++) {
+        if (sinks[i].fini && (*sinks[i].fini) () < 0) {
+            err ("%p: output module \"%s\" failed to finalize\n", 
+                 sinks[i].name);
+            rc = -1;
+        }
+    }
+
+    if (sinks)
+        Free ((void **) &sinks);
+    nsinks = 0;
+
+    return (rc);
+}
+
+/*
+ * vi: ts=4 sw=4 expandtab
+ */
@@ -0,0 +1,92 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_OUTPUT_H
+#define _HAVE_OUTPUT_H
+
+#include "opt.h"
+
+/*
+ *  Stream identifiers passed to output module line and data events.
+ */
+#define OUTPUT_STDOUT 1
+#define OUTPUT_STDERR 2
+
+/*
+ *  Opaque per-host collection of output module handles.
+ */
+struct output_host;
+
+/*
+ *  Initialize all loaded output modules for this job. Each module's
+ *   output_init function decides whether it will receive events
+ *   (e.g. based on options it has processed).
+ *
+ *  Returns the number of active output sinks, or -1 on error.
+ */
+int output_init (opt_t *opt);
+
+/*
+ *  Notify active output sinks that "host" has started. Returns
+ *   NULL if no output sinks are active, in which case none of
+ *   the per-host functions below need be called.
+ *
+ *  All events for a given host must be issued from a single thread.
+ */
+struct output_host * output_host_start (const char *host, int nodeid);
+
+/*
+ *  Pass one complete line of output (including trailing newline)
+ *   on "stream" to all active sinks. Sinks which export only a
+ *   data function receive the line through that function.
+ */
+void output_host_line (struct output_host *h, int stream, 
+                       const char *buf, int len);
+
+/*
+ *  Pass a chunk of unterminated output data to active sinks. Sinks
+ *   that export only a line function receive the chunk as a line.
+ */
+void output_host_data (struct output_host *h, int stream, 
+                       const char *buf, int len);
+
+/*
+ *  Notify sinks that host has finished with return code "rc."
+ *   "failed" is true if the connection or command failed.
+ *   Frees "h."
+ */
+void output_host_exit (struct output_host *h, int rc, bool failed);
+
+/*
+ *  Finalize all active output sinks.
+ */
+int output_fini (void);
+
+#endif /* !_HAVE_OUTPUT_H */
+
+/*
+ * vi: ts=4 sw=4 expandtab
+ */
@@ -0,0 +1,450 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/poll.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "src/common/err.h"
+#include "src/common/fd.h"
+#include "src/common/hostlist.h"
+#include "src/common/list.h"
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "rcmd.h"
+#include "pcp_client.h"
+#include "pcp_chain.h"
+
+#define CHAIN_BUFSIZ        (256 * 1024)
+
+/*
+ *  Acks sent by a pcp server before an archive stream: one when the
+ *   server starts and one for the "A" record. Messages from later hosts
+ *   are held until after these, since the client reads errors only at
+ *   the end of the stream.
+ */
+#define CHAIN_START_ACKS    2
+
+/*
+ *  First byte of a message from a later host, which already starts with
+ *   the name of that host and is passed up the chain unchanged.
+ */
+#define CHAIN_MSG           '\03'
+
+struct chain {
+    char *             next;        /* next host                         */
+    char *             later;       /* all later hosts, for messages     */
+    struct rcmd_info * rcmd;        /* connection to next host, or NULL  */
+    int                upin;        /* stream from previous host         */
+    int                upout;       /* responses to previous host        */
+    int                in[2];       /* stream to local pcp server        */
+    int                out[2];      /* responses from local pcp server   */
+    List               held;        /* messages from later hosts         */
+};
+
+/*
+ *  Responses from a pcp server: a NUL byte for an ack, or a message of
+ *   one line, starting with a nonzero byte. On the stderr connection
+ *   of the next host, each line is a message.
+ */
+struct responses {
+    int    fd;
+    bool   lines;
+    bool   eof;
+    size_t len;
+    char   buf[BUFSIZ];
+};
+
+char **pcp_chain_split (opt_t *opt, bool target_is_dir)
+{
+    int n = hostlist_count (opt->wcoll);
+    int k = MIN (opt->pcp_chains, n);
+    hostlist_t heads = hostlist_create (NULL);
+    char **cmds = Malloc ((k + 1) * sizeof (char *));
+    int i, j;
+
+    for (i = 0; i < k; i++) {
+        int len = (i + 1) * n / k - i * n / k;
+        hostlist_t rest = hostlist_create (NULL);
+        char *host = hostlist_shift (opt->wcoll);
+        char *next = NULL;
+
+        for (j = 1; j < len; j++) {
+            char *h = hostlist_shift (opt->wcoll);
+            hostlist_push_host (rest, h);
+            free (h);
+        }
+        if (len > 1)
+            next = hostlist_ranged_string_malloc (rest);
+
+        cmds[i] = pcp_server_cmd (opt, target_is_dir, next);
+        hostlist_push_host (heads, host);
+
+        if (next)
+            free (next);
+        hostlist_destroy (rest);
+        free (host);
+    }
+    cmds[k] = NULL;
+
+    hostlist_destroy (opt->wcoll);
+    opt->wcoll = heads;
+
+    return (cmds);
+}
+
+void pcp_chain_cmds_destroy (char **cmds)
+{
+    char **p;
+
+    for (p = cmds; *p; p++)
+        Free ((void **) p);
+    Free ((void **) &cmds);
+}
+
+static void _chain_free (void *x)
+{
+    Free (&x);
+}
+
+/*
+ *  Hold message `text' of `len' bytes from the next host, prefixing
+ *   it with the host name unless it comes from a host further down.
+ */
+static void _chain_hold (struct chain *c, const char *text, size_t len, 
+                         bool prefixed)
+{
+    size_t n = prefixed ? 0 : strlen (c->next) + 2;
+    char *msg = Malloc (n + len + 2);
+
+    while (len > 0 && text[len - 1] == '\n')
+        len--;
+    msg[0] = CHAIN_MSG;
+    if (!prefixed)
+        sprintf (msg + 1, "%s: ", c->next);
+    memcpy (msg + 1 + n, text, len);
+    memcpy (msg + 1 + n + len, "\n", 2);
+
+    list_append (c->held, msg);
+}
+
+static void _chain_flush (struct chain *c)
+{
+    char *msg;
+
+    while ((msg = list_pop (c->held))) {
+        (void) fd_write_n (c->upout, msg, strlen (msg));
+        Free ((void **) &msg);
+    }
+}
+
+static void _chain_lost (struct chain *c, const char *what)
+{
+    char buf[1024];
+
+    snprintf (buf, sizeof (buf), "%s, copy to %s incomplete", what, 
+              c->later);
+    _chain_hold (c, buf, strlen (buf), false);
+}
+
+/*
+ *  Connect to the next host, running the pcp server for the rest of
+ *   the chain there. On failure, hold a message for the previous host.
+ */
+static void _chain_connect (struct chain *c, opt_t *opt)
+{
+    hostlist_t hl = hostlist_create (opt->pcp_chain_next);
+    char addr[IP_ADDR_LEN];
+    char *host, *rest = NULL, *cmd;
+
+    c->later = hostlist_ranged_string_malloc (hl);
+    host = hostlist_shift (hl);
+    c->next = Strdup (host ? host : "(none)");
+    if (host)
+        free (host);
+    if (hostlist_count (hl) > 0)
+        rest = hostlist_ranged_string_malloc (hl);
+    hostlist_destroy (hl);
+
+    if (rcmd_init (opt) < 0 || !(c->rcmd = rcmd_create (c->next))) {
+        _chain_lost (c, "no rcmd module");
+        goto done;
+    }
+
+    memset (addr, 0, sizeof (addr));
+    if (c->rcmd->opts->resolve_hosts) {
+        struct hostent *hp = gethostbyname (c->next);
+        if (hp == NULL) {
+            _chain_lost (c, "unknown host");
+            goto fail;
+        }
+        memcpy (addr, hp->h_addr_list[0], IP_ADDR_LEN);
+    }
+
+    cmd = pcp_server_cmd (opt, opt->target_is_directory, rest);
+    rcmd_connect (c->rcmd, c->next, addr, opt->luser, opt->ruser, cmd, 0, 
+                  true);
+    Free ((void **) &cmd);
+    if (c->rcmd->fd < 0) {
+        _chain_lost (c, "can't connect");
+        goto fail;
+    }
+    goto done;
+
+fail:
+    rcmd_destroy (c->rcmd);
+    c->rcmd = NULL;
+done:
+    if (rest)
+        free (rest);
+}
+
+/*
+ *  Copy the stream from the previous host to the next host and to the
+ *   local pcp server. A failed next host is reported by 
+ *   _chain_responses(), and the local server may stop reading early
+ *   after a protocol error; in both cases the rest of the stream still
+ *   goes to the other one.
+ */
+static void *_chain_forward (void *arg)
+{
+    struct chain *c = arg;
+    char *buf = Malloc (CHAIN_BUFSIZ);
+    int down = c->rcmd ? c->rcmd->fd : -1;
+    ssize_t n;
+
+    for (;;) {
+        if ((n = read (c->upin, buf, CHAIN_BUFSIZ)) < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        if (down >= 0 && fd_write_n (down, buf, n) < 0)
+            down = -1;
+        if (c->in[1] >= 0 && fd_write_n (c->in[1], buf, n) < 0) {
+            close (c->in[1]);
+            c->in[1] = -1;
+        }
+    }
+    if (down >= 0)
+        shutdown (down, SHUT_WR);
+    if (c->in[1] >= 0)
+        close (c->in[1]);
+    c->in[1] = -1;
+
+    Free ((void **) &buf);
+    return (NULL);
+}
+
+static void _responses_init (struct responses *r, int fd, bool lines)
+{
+    r->fd = fd;
+    r->lines = lines;
+    r->eof = (fd < 0);
+    r->len = 0;
+}
+
+static void _responses_read (struct responses *r)
+{
+    ssize_t n;
+
+    do
+        n = read (r->fd, r->buf + r->len, sizeof (r->buf) - r->len);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        r->eof = true;
+    else
+        r->len += n;
+}
+
+/*
+ *  Return the length of the next complete response in `r', or 0.
+ */
+static size_t _response_len (struct responses *r)
+{
+    char *nl;
+
+    if (r->len == 0)
+        return (0);
+    if (!r->lines && r->buf[0] == '\0')
+        return (1);
+    if ((nl = memchr (r->buf, '\n', r->len)))
+        return (nl - r->buf + 1);
+    if (r->eof || r->len == sizeof (r->buf))
+        return (r->len);
+    return (0);
+}
+
+static void _response_consume (struct responses *r, size_t n)
+{
+    memmove (r->buf, r->buf + n, r->len - n);
+    r->len -= n;
+}
+
+/*
+ *  Pass the responses of the local pcp server to the previous host,
+ *   sending each ack only once the next host has sent the same ack, so
+ *   that the final ack means the whole rest of the chain is done.
+ */
+static void *_chain_responses (void *arg)
+{
+    struct chain *c = arg;
+    struct responses local[1], down[1], derr[1];
+    unsigned long local_acks = 0, down_acks = 0, sent = 0;
+    bool lost = (c->rcmd == NULL);
+
+    _responses_init (local, c->out[0], false);
+    _responses_init (down, c->rcmd ? c->rcmd->fd : -1, false);
+    _responses_init (derr, c->rcmd ? c->rcmd->efd : -1, true);
+
+    while (!local->eof || !down->eof || !derr->eof) {
+        struct responses *r[3];
+        struct pollfd pfd[3];
+        int i, nfds = 0;
+        size_t n;
+
+        if (!local->eof)
+            r[nfds++] = local;
+        if (!down->eof)
+            r[nfds++] = down;
+        if (!derr->eof)
+            r[nfds++] = derr;
+        for (i = 0; i < nfds; i++) {
+            pfd[i].fd = r[i]->fd;
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+        if (poll (pfd, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            err ("%p: pcp chain: poll: %m\n");
+            break;
+        }
+        for (i = 0; i < nfds; i++) {
+            if (pfd[i].revents)
+                _responses_read (r[i]);
+        }
+
+        while ((n = _response_len (local))) {
+            if (local->buf[0] == '\0')
+                local_acks++;
+            else
+                (void) fd_write_n (c->upout, local->buf, n);
+            _response_consume (local, n);
+        }
+        while ((n = _response_len (down))) {
+            if (down->buf[0] == '\0')
+                down_acks++;
+            else
+                _chain_hold (c, down->buf + 1, n - 1, 
+                             down->buf[0] == CHAIN_MSG);
+            _response_consume (down, n);
+        }
+        while ((n = _response_len (derr))) {
+            _chain_hold (c, derr->buf, n, false);
+            _response_consume (derr, n);
+        }
+
+        while (sent < local_acks 
+               && (sent < down_acks || (down->eof && derr->eof))) {
+            if (sent >= down_acks && !lost) {
+                _chain_lost (c, "lost connection");
+                lost = true;
+            }
+            if (sent >= CHAIN_START_ACKS)
+                _chain_flush (c);
+            (void) fd_write_n (c->upout, "", 1);
+            sent++;
+        }
+    }
+    _chain_flush (c);
+
+    return (NULL);
+}
+
+int pcp_chain_server (struct pcp_server *svr, opt_t *opt)
+{
+    struct chain c[1];
+    pthread_t forward, responses;
+    int rc = -1;
+
+    memset (c, 0, sizeof (*c));
+    c->upin = svr->infd;
+    c->upout = svr->outfd;
+    c->held = list_create (_chain_free);
+
+    /* errors writing to a closed connection are handled */
+    signal (SIGPIPE, SIG_IGN);
+
+    _chain_connect (c, opt);
+
+    if (pipe (c->in) < 0 || pipe (c->out) < 0) {
+        err ("%p: pcp_chain_server: pipe: %m\n");
+        goto done;
+    }
+    svr->infd = c->in[0];
+    svr->outfd = c->out[1];
+
+    if ((errno = pthread_create (&forward, NULL, _chain_forward, c))
+        || (errno = pthread_create (&responses, NULL, _chain_responses, c))) 
+    {
+        err ("%p: pcp_chain_server: pthread_create: %m\n");
+        exit (1);
+    }
+
+    rc = pcp_server (svr);
+
+    /* the forward thread may still be writing to the local server */
+    close (c->in[0]);
+    close (c->out[1]);
+    pthread_join (forward, NULL);
+    pthread_join (responses, NULL);
+    close (c->out[0]);
+
+done:
+    if (c->rcmd)
+        rcmd_destroy (c->rcmd);
+    list_destroy (c->held);
+    Free ((void **) &c->next);
+    free (c->later);
+    return (rc);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
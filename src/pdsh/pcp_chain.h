@@ -0,0 +1,66 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Chained copy for pdcp (-o chain): the hosts are split into chains,
+ *   and pdcp sends the archive stream (see pcp_server.c) only to the
+ *   first host of each chain. The pdcp server on that host writes the
+ *   stream locally while copying it to the next host of the chain, over
+ *   its own rcmd connection, and so on down the chain, so that the
+ *   source host sends each byte once per chain instead of once per host.
+ */
+
+#ifndef _PCP_CHAIN_H
+#define _PCP_CHAIN_H
+
+#include "src/pdsh/opt.h"
+#include "src/pdsh/pcp_server.h"
+
+/*
+ *  Split opt->wcoll into opt->pcp_chains chains of consecutive hosts,
+ *   replacing it with the first host of each chain. Returns the pcp
+ *   server command for each of these hosts, in order, in a NULL
+ *   terminated array.
+ */
+char **pcp_chain_split (opt_t *opt, bool target_is_dir);
+
+/*
+ *  Free the array returned by pcp_chain_split().
+ */
+void pcp_chain_cmds_destroy (char **cmds);
+
+/*
+ *  Run pcp server `svr' on a host which forwards the stream to the
+ *   hosts in opt->pcp_chain_next. Errors from later hosts are reported
+ *   along with those of this host, at the end of the archive stream.
+ */
+int pcp_chain_server (struct pcp_server *svr, opt_t *opt);
+
+#endif /* !_PCP_CHAIN_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -59,6 +59,8 @@
 # include "config.h"
 #endif
 
+#define _GNU_SOURCE        /* SEEK_DATA, SEEK_HOLE */
+
 #include <sys/param.h>     /* roundup() */
 #if HAVE_SYS_SYSMACROS_H
 # include <sys/sysmacros.h>
@@ -66,16 +68,24 @@
 #include <sys/stat.h>
 #include <sys/param.h>
 #include <sys/types.h>
+#include <sys/poll.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <dirent.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
+#if HAVE_SENDFILE && HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#  define USE_SENDFILE 1
+#endif
+#if HAVE_ZLIB
+#  include <zlib.h>
+#endif
 
 #include "src/common/err.h"
 #include "src/common/fd.h"
@@ -83,7 +93,10 @@
 #include "src/common/xstring.h"
 #include "src/common/err.h"
 #include "src/common/xmalloc.h"
+#include "src/common/digest.h"
 #include "pcp_client.h"
+#include "pcp_source.h"
+#include "pcp_walk.h"
 #include "wcoll.h"
 
 #ifndef MAXPATHNAMELEN
@@ -91,100 +104,121 @@
 #endif
 
 
-static void _rexpand_dir(List list, char *name)
+char *pcp_server_cmd(opt_t *opt, bool target_is_dir, char *chain_next)
 {
-    DIR *dir;
-    struct dirent *dp;
-    struct stat sb;
-    char file[MAXPATHNAMELEN];
-    struct pcp_filename *pf = NULL;
-
-    dir = opendir(name);
-    if (dir == NULL)
-        errx("%p: opendir: %s: %m\n", name);
-    while ((dp = readdir(dir))) {
-        if (dp->d_ino == 0)
-            continue;
-        if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, ".."))
-            continue;
-        snprintf(file, sizeof(file), "%s/%s", name, dp->d_name);
-        if (stat(file, &sb) < 0)
-            errx("%p: can't stat %s: %m\n", file);
-        if (access(name, R_OK) < 0)
-            errx("%p: access: %s: %m\n", name);
-        if (!S_ISDIR(sb.st_mode) && !S_ISREG(sb.st_mode))
-            errx("%p: not a regular file or directory: %s\n", file);
-
-        /* XXX: This memleaks */
-        pf = Malloc(sizeof(struct pcp_filename));
-        pf->filename = Strdup(file);
-        pf->file_specified_by_user = 0;
+    char *cmd = NULL;
 
-        list_append(list, pf);
-        if (S_ISDIR(sb.st_mode))
-            _rexpand_dir(list, file);
+    xstrcat(&cmd, opt->remote_program_path);
+    if (opt->recursive)
+        xstrcat(&cmd, " -r");
+    if (opt->preserve)
+        xstrcat(&cmd, " -p");
+    if (target_is_dir)
+        xstrcat(&cmd, " -y");
+    if (opt->pcp_window) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), " -o pipeline=%d", opt->pcp_window);
+        xstrcat(&cmd, buf);
+    }
+    if (opt->pcp_compress)
+        xstrcat(&cmd, " -o compress");   /* fails if remote can't */
+    if (opt->pcp_sparse)
+        xstrcat(&cmd, " -o sparse");     /* likewise */
+    if (opt->pcp_verify)
+        xstrcat(&cmd, " -o verify");
+    if (opt->pcp_prealloc)
+        xstrcat(&cmd, " -o prealloc");
+    if (opt->pcp_direct)
+        xstrcat(&cmd, " -o direct");
+    if (opt->pcp_nocache)
+        xstrcat(&cmd, " -o nocache");
+    if (opt->pcp_fsync)
+        xstrcat(&cmd, " -o fsync");
+    if (chain_next) {
+        /* the host connects to the next one with the same rcmd type */
+        if (opt->rcmd_name) {
+            xstrcat(&cmd, " -R ");
+            xstrcat(&cmd, opt->rcmd_name);
+        }
+        xstrcat(&cmd, " -o 'chain-next=");
+        xstrcat(&cmd, chain_next);
+        xstrcat(&cmd, "'");
     }
-    closedir(dir);
+    xstrcat(&cmd, " -z ");               /* invoke pcp server */
+    xstrcat(&cmd, opt->outfile_name);    /* outfile is remote target */
 
-    /* Since pdcp reads file names and directories only once for
-     * efficiency, we must specify a special flag so we know when
-     * to tell the server to "move up" the directory tree.
-     */
-    
-    /* XXX: This memleaks */
-    pf = Malloc(sizeof(struct pcp_filename));
-    pf->filename = Strdup(EXIT_SUBDIR_FILENAME);
-    pf->file_specified_by_user = 0;
-    list_append(list, pf);
+    return cmd;
 }
 
 List pcp_expand_dirs(List infiles)
 {
     List new = list_create(NULL);
-    struct stat sb;
+    List roots = list_create(NULL);
     char *name;
     ListIterator i;
 
     i = list_iterator_create(infiles);
     while ((name = list_next(i))) {
-        struct pcp_filename *pf = NULL;
+        struct stat sb;
 
         if (access(name, R_OK) < 0)
             errx("%p: access: %s: %m\n", name);
         if (stat(name, &sb) < 0)
             errx("%p: stat: %s: %m\n", name);
-        
-        /* XXX: This memleaks */
-        pf = Malloc(sizeof(struct pcp_filename));
-        pf->filename = name;
-        pf->file_specified_by_user = 1;
-
-        list_append(new, pf);
 
-        /* -r option checked during command line argument checks */
-        if (S_ISDIR(sb.st_mode))
-            _rexpand_dir(new, name);
+        list_append(roots, pcp_walk_entry(name, 1, &sb));
     }
-    
+    list_iterator_destroy(i);
+
+    /* -r option checked during command line argument checks */
+    pcp_walk(roots, new);
+    list_destroy(roots);
+
     return new;
 }
 
+int pcp_check_unchanged(List infiles)
+{
+    struct pcp_filename *pf;
+    struct stat sb;
+    ListIterator i;
+    int changed = 0;
+
+    i = list_iterator_create(infiles);
+    while ((pf = list_next(i))) {
+        if (!S_ISREG(pf->sb.st_mode))
+            continue;
+        if (stat(pf->filename, &sb) < 0 || sb.st_size != pf->sb.st_size
+            || sb.st_mtime != pf->sb.st_mtime) {
+            err("%p: warning: %s changed during copy\n", pf->filename);
+            changed++;
+        }
+    }
+    list_iterator_destroy(i);
+    return changed;
+}
+
 /*
  * Wrapper for the write system call that handles short writes.
  * Not sure if write ever returns short in practice but we have to be sure.
- *	fd (IN)		file descriptor to write to 
+ * With -o rate or -o host-rate, data is written as fast as it is allowed.
+ *	pcp (IN)	client state, with the descriptor to write to 
  *	buf (IN)	data to write
  *	size (IN)	size of buf
  *	RETURN		-1 on failure, size on success
  */
-static int _pcp_write(int fd, char *buf, int size)
+static int _pcp_write(struct pcp_client *pcp, char *buf, int size)
 {
     char *bufp = buf;
     int towrite = size;
     int outbytes;
 
     while (towrite > 0) {
-        outbytes = write(fd, bufp, towrite);
+        int n = pcp->rate ? pcp_rate_take(pcp->rate, towrite) : towrite;
+
+        pcp_stats_write_begin(pcp->stats);
+        outbytes = write(pcp->outfd, bufp, n);
+        pcp_stats_write_end(pcp->stats, MAX(outbytes, 0));
         if (outbytes <= 0) {
             assert(outbytes != 0);
             return -1;
@@ -195,57 +229,446 @@ static int _pcp_write(int fd, char *buf, int size)
     return size;
 }
 
+#if USE_SENDFILE
 /*
- * Write the contents of the named file to the specified file descriptor.
- *	outfd (IN)	file descriptor to write to 
- *	filename (IN)	name of file
- *	host (IN)	name of remote host for error messages
+ * Send `size' bytes of file data from filefd to pcp->outfd with 
+ * sendfile(2), so that the data is not copied through a user space buffer.
+ *	pcp (IN)	client state, with the descriptor to write to 
+ *	filefd (IN)	file descriptor to read from
+ *	size (IN)	bytes to send
+ *	RETURN		-1 on failure, 0 on success, 1 if sendfile() 
+ *			cannot be used with these file descriptors.
+ */
+static int _pcp_sendfile_data(struct pcp_client *pcp, int filefd, off_t size)
+{
+    off_t total = 0;
+    ssize_t n;
+    size_t len;
+
+    for (;;) {
+        if (total == size)
+            return 0;
+        len = MIN(size - total, 0x40000000);
+        if (pcp->rate)
+            len = pcp_rate_take(pcp->rate, len);
+        pcp_stats_write_begin(pcp->stats);
+        n = sendfile(pcp->outfd, filefd, NULL, len);
+        pcp_stats_write_end(pcp->stats, MAX(n, 0));
+        if (n > 0) {
+            total += n;
+            continue;
+        }
+        if (n == 0) {           /* EOF: file shrunk */
+            errno = EIO;
+            return -1;
+        }
+        if (errno == EINTR)
+            continue;
+        if (total == 0 && (errno == EINVAL || errno == ENOSYS))
+            return 1;
+        return -1;
+    }
+}
+#endif /* USE_SENDFILE */
+
+/*
+ * Write `size' bytes from the current offset of filefd to the remote host.
+ * Use sendfile() if possible, otherwise a read/write loop.
+ *	pcp (IN)	client state
+ *	filefd (IN)	file descriptor to read from
+ *	filename (IN)	name of file for error messages
+ *	size (IN)	bytes to send
  *	RETURN		-1 on failure, 0 on success.
  */
-static int _pcp_send_file_data(int outfd, char *filename, char *host)
+static int _pcp_send_fd_data(struct pcp_client *pcp, int filefd, 
+                             char *filename, off_t size)
 {
-    int filefd, inbytes, total = 0;
+    char *host = pcp->host;
+    int inbytes;
+    off_t total = 0;
     char tmpbuf[BUFSIZ];
 
+#if USE_SENDFILE
+    /* data sent with sendfile() can't be hashed */
+    switch (pcp->digest ? 1 : _pcp_sendfile_data(pcp, filefd, size)) {
+    case 0:
+        return 0;
+    case -1:
+        err("%S: _pcp_send_file_data: sendfile %s: %m\n", host, filename);
+        return -1;
+    }
+#endif
+    while (total < size) {
+        inbytes = read(filefd, tmpbuf, MIN(size - total, BUFSIZ));
+        if (inbytes == 0)       /* file shrunk */
+            errno = EIO;
+        if (inbytes <= 0) {
+            err("%S: _pcp_send_file_data: read %s: %m\n", host, filename);
+            return -1;
+        }
+        total += inbytes;
+        if (pcp->digest)
+            digest_update(pcp->digest, tmpbuf, inbytes);
+        if (_pcp_write(pcp, tmpbuf, inbytes) < 0) {
+            err("%S: _pcp_send_file_data: write: %m\n", host);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Write the contents of the named file to the remote host.
+ * Exactly the size sent in the file's record is sent, even if the file 
+ * has grown since it was stat'ed.
+ *	pcp (IN)	client state
+ *	filename (IN)	name of file
+ *	size (IN)	size of file
+ *	RETURN		-1 on failure, 0 on success.
+ */
+static int _pcp_send_file_data(struct pcp_client *pcp, char *filename, 
+                               off_t size)
+{
+    int filefd, rc;
+
     filefd = open(filename, O_RDONLY);
     /* checked ahead of time - shouldn't happen */
     if (filefd < 0) {
-        err("%S: _pcp_send_file_data: open %s: %m\n", host, filename);
+        err("%S: _pcp_send_file_data: open %s: %m\n", pcp->host, filename);
         return -1;
     }
-    do {
-        inbytes = read(filefd, tmpbuf, BUFSIZ);
-        if (inbytes < 0) {
-            err("%S: _pcp_send_file_data: read %s: %m\n", host, filename);
-            return -1;
+    rc = _pcp_send_fd_data(pcp, filefd, filename, size);
+    close(filefd);
+    return rc;
+}
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+/*
+ * Return nonzero if the file with status `sb' has holes and is sent
+ * as an "H" record with only its data segments (-o sparse).
+ */
+static int _pcp_sparse(struct pcp_client *pcp, const struct stat *sb)
+{
+    return (pcp->sparse && S_ISREG(sb->st_mode)
+            && (off_t) sb->st_blocks * 512 < sb->st_size);
+}
+
+/*
+ * Write the data segments of the named sparse file from offset `start'
+ * up to `size' to the remote host, as found with SEEK_DATA and SEEK_HOLE:
+ * each is sent as "<offset> <length>\n" followed by its data, and
+ * "0 0\n" ends the file, or the block of a "P" record (see _sparse_data()
+ * and _patch_segments() in pcp_server.c).
+ *	pcp (IN)	client state
+ *	filename (IN)	name of file
+ *	start (IN)	offset of first byte to send
+ *	size (IN)	size of file, or end of block
+ *	RETURN		-1 on failure, 0 on success.
+ */
+static int _pcp_send_sparse_data(struct pcp_client *pcp, char *filename, 
+                                 off_t start, off_t size)
+{
+    char seg[64];
+    off_t data, hole = start, end = start;
+    int filefd, rc = 0;
+
+    if ((filefd = open(filename, O_RDONLY)) < 0) {
+        err("%S: _pcp_send_sparse_data: open %s: %m\n", pcp->host, filename);
+        return -1;
+    }
+    while (hole < size) {
+        if ((data = lseek(filefd, hole, SEEK_DATA)) < 0 && errno == ENXIO)
+            break;              /* only a hole is left */
+        if (data < 0 || (data < size 
+                         && (hole = lseek(filefd, data, SEEK_HOLE)) < 0)
+            || lseek(filefd, data, SEEK_SET) < 0) {
+            err("%S: _pcp_send_sparse_data: seek %s: %m\n", pcp->host, 
+                filename);
+            rc = -1;
+            break;
         }
-        if (inbytes > 0) {
-            total += inbytes;
-            if (_pcp_write(outfd, tmpbuf, inbytes) < 0) {
-                err("%S: _pcp_send_file_data: write: %m\n", host);
-                return -1;
-            }
+        if (data >= size)
+            break;
+        if (pcp->digest)
+            digest_zeros(pcp->digest, data - end);
+        hole = end = MIN(hole, size);
+        snprintf(seg, sizeof(seg), "%lld %lld\n", (long long) data, 
+                 (long long) (hole - data));
+        if (_pcp_write(pcp, seg, strlen(seg)) < 0) {
+            err("%S: _pcp_send_sparse_data: write: %m\n", pcp->host);
+            rc = -1;
+            break;
         }
-    } while (inbytes > 0);      /* until EOF */
+        if ((rc = _pcp_send_fd_data(pcp, filefd, filename, hole - data)) < 0)
+            break;
+    }
+    close(filefd);
+    if (pcp->digest)
+        digest_zeros(pcp->digest, size - end);
+    if (rc == 0 && _pcp_write(pcp, "0 0\n", 4) < 0) {
+        err("%S: _pcp_send_sparse_data: write: %m\n", pcp->host);
+        rc = -1;
+    }
+    return rc;
+}
+
+/*
+ * Return nonzero if the `len' bytes at `off' of the named file are all
+ * in a hole.
+ */
+static int _pcp_hole(char *filename, off_t off, off_t len)
+{
+    int filefd = open(filename, O_RDONLY);
+    off_t data;
+
+    if (filefd < 0)
+        return 0;
+    data = lseek(filefd, off, SEEK_DATA);
     close(filefd);
+    return ((data < 0 && errno == ENXIO) || data >= off + len);
+}
+#else
+static int _pcp_sparse(struct pcp_client *pcp, const struct stat *sb)
+{
+    return 0;
+}
+
+static int _pcp_hole(char *filename, off_t off, off_t len)
+{
     return 0;
 }
 
+static int _pcp_send_sparse_data(struct pcp_client *pcp, char *filename, 
+                                 off_t start, off_t size)
+{
+    return -1;
+}
+#endif /* SEEK_DATA && SEEK_HOLE */
+
 /*
- * Send string to the specified file descriptor.  Do not send trailing '\0'
+ * Write the contents of a file to the remote host from the shared
+ * source cache, so that the file is read only once for all hosts.
+ *	pcp (IN)	client state
+ *	pf (IN)		file to send
+ *	size (IN)	size of file
+ *	RETURN		-1 on failure, 0 on success.
+ */
+static int _pcp_send_cached_data(struct pcp_client *pcp, 
+                                 struct pcp_filename *pf, off_t size)
+{
+    char *host = pcp->host;
+    pcp_source_t src = pcp_source_get(&pf->source, pf->filename, size);
+    int i;
+
+    for (i = 0; i < pcp_source_nchunks(src); i++) {
+        const char *data;
+        size_t len;
+        int rc;
+
+        if (!(data = pcp_source_chunk_get(src, i, &len))) {
+            err("%S: _pcp_send_cached_data: read %s: %m\n", host, 
+                pf->filename);
+            return -1;
+        }
+        if (pcp->digest)
+            digest_update(pcp->digest, data, len);
+        rc = _pcp_write(pcp, (char *) data, len);
+        pcp_source_chunk_put(src, i);
+
+        if (rc < 0) {
+            err("%S: _pcp_send_cached_data: write: %m\n", host);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#if HAVE_ZLIB
+/*
+ * Compress one chunk of a source file into a frame of the "Z" record
+ * (see _inflate_data() in pcp_server.c): "<len> <zlen>\n" followed by
+ * <zlen> bytes of zlib data, or by the <len> bytes of the chunk as is
+ * (with <zlen> 0) if they do not compress. As a source cache filter,
+ * this runs once per chunk however many hosts the file is sent to.
+ */
+char *pcp_compress_chunk(const char *data, size_t len, size_t *lenp)
+{
+    uLongf zlen = compressBound(len);
+    char *zbuf = Malloc(zlen);
+    char hdr[64], *frame;
+    int hlen;
+
+    if (compress2((Bytef *) zbuf, &zlen, (const Bytef *) data, len, 
+                  Z_BEST_SPEED) == Z_OK && zlen < len) {
+        hlen = snprintf(hdr, sizeof(hdr), "%lu %lu\n", 
+                        (unsigned long) len, (unsigned long) zlen);
+        data = zbuf;
+        len = zlen;
+    } else
+        hlen = snprintf(hdr, sizeof(hdr), "%lu 0\n", (unsigned long) len);
+    frame = Malloc(hlen + len);
+    memcpy(frame, hdr, hlen);
+    memcpy(frame + hlen, data, len);
+    Free((void **) &zbuf);
+
+    *lenp = hlen + len;
+    return frame;
+}
+#endif /* HAVE_ZLIB */
+
+/*
+ * With -o verify, the data of each file is followed by its digest, which
+ * the server compares with the digest of the data it received. The digest
+ * of a file is computed once for all hosts, by the first thread to send
+ * the file as it sends it, or by reading the file if that thread fails
+ * or can't see the data (sendfile() is then not used by that thread).
+ */
+enum { DIGEST_NONE, DIGEST_BUSY, DIGEST_DONE };
+
+static pthread_mutex_t verify_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t verify_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Return nonzero if the calling thread is to compute the digest of `pf'
+ * while sending it. With -o compress, it sees only compressed data.
+ */
+static int _verify_begin(struct pcp_client *pcp, struct pcp_filename *pf)
+{
+    int rc = 0;
+
+    if (!pcp->verify || pcp->compress)
+        return 0;
+    pthread_mutex_lock(&verify_mutex);
+    if (pf->digest_state == DIGEST_NONE) {
+        pf->digest_state = DIGEST_BUSY;
+        rc = 1;
+    }
+    pthread_mutex_unlock(&verify_mutex);
+    return rc;
+}
+
+/*
+ * Record the digest `d' of `pf' computed by the calling thread, or give
+ * up computing it if d is NULL.
+ */
+static void _verify_end(struct pcp_filename *pf, struct digest *d)
+{
+    pthread_mutex_lock(&verify_mutex);
+    if (d) {
+        pf->digest = digest_final(d);
+        pf->digest_state = DIGEST_DONE;
+    } else
+        pf->digest_state = DIGEST_NONE;
+    pthread_cond_broadcast(&verify_cond);
+    pthread_mutex_unlock(&verify_mutex);
+}
+
+/*
+ * Read the first `size' bytes of the file of `pf' into digest `d'.
+ */
+static int _verify_read(struct pcp_filename *pf, off_t size, struct digest *d)
+{
+    char buf[BUFSIZ];
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(pf->filename, O_RDONLY)) < 0)
+        return -1;
+    while (size > 0) {
+        if ((n = read(fd, buf, MIN(size, BUFSIZ))) < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            if (n == 0)         /* file shrunk */
+                errno = EIO;
+            close(fd);
+            return -1;
+        }
+        digest_update(d, buf, n);
+        size -= n;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ * Make the digest line "<hex>\n" of the `size' bytes of `pf' just sent
+ * in `line': wait for the thread computing the digest, or compute it here.
+ *	RETURN		-1 on failure, 0 on success.
+ */
+static int _verify_line(struct pcp_client *pcp, struct pcp_filename *pf, 
+                        off_t size, char line[32])
+{
+    struct digest d;
+
+    pthread_mutex_lock(&verify_mutex);
+    while (pf->digest_state == DIGEST_BUSY)
+        pthread_cond_wait(&verify_cond, &verify_mutex);
+    if (pf->digest_state == DIGEST_NONE) {
+        pf->digest_state = DIGEST_BUSY;
+        pthread_mutex_unlock(&verify_mutex);
+
+        digest_init(&d);
+        if (_verify_read(pf, size, &d) < 0) {
+            err("%S: _verify_line: read %s: %m\n", pcp->host, pf->filename);
+            _verify_end(pf, NULL);
+            return -1;
+        }
+        _verify_end(pf, &d);
+    } else
+        pthread_mutex_unlock(&verify_mutex);
+
+    snprintf(line, 32, "%016llx\n", (unsigned long long) pf->digest);
+    return 0;
+}
+
+/*
+ * Send the `size' bytes of data of file `pf', named `file', with the
+ * digest line if verifying.
+ *	RETURN		-1 on failure, 0 on success.
+ */
+static int _pcp_send_data(struct pcp_client *pcp, struct pcp_filename *pf,
+                          char *file, const struct stat *sb, off_t size)
+{
+    struct digest d;
+    char line[32];
+    int rc;
+
+    if (_verify_begin(pcp, pf)) {
+        digest_init(&d);
+        pcp->digest = &d;
+    }
+    if (_pcp_sparse(pcp, sb))
+        rc = _pcp_send_sparse_data(pcp, file, 0, size);
+    else if (pcp_source_cache_enabled())
+        rc = _pcp_send_cached_data(pcp, pf, size);
+    else
+        rc = _pcp_send_file_data(pcp, file, size);
+    if (pcp->digest) {
+        _verify_end(pf, rc == 0 ? &d : NULL);
+        pcp->digest = NULL;
+    }
+    if (rc < 0 || !pcp->verify)
+        return rc;
+    if (_verify_line(pcp, pf, size, line) < 0
+        || _pcp_write(pcp, line, strlen(line)) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+ * Send string to the remote host.  Do not send trailing '\0'
  * as RCP terminates strings with newlines.
- *	fd (IN)		file descriptor to write to
+ *	pcp (IN)	client state
  *	str (IN)	string to write
- *	host (IN)	name of remote host for error messages
  *	RETURN 		-1 on failure, 0 on success
  */
-static int pcp_sendstr(int outfd, char *str, char *host)
+static int pcp_sendstr(struct pcp_client *pcp, char *str)
 {
     int n;
     assert(strlen(str) > 0);
     assert(str[strlen(str) - 1] == '\n');
 
-    if ((n = _pcp_write(outfd, str, strlen(str))) < 0) 
+    if ((n = _pcp_write(pcp, str, strlen(str))) < 0) 
         return -1;
 
     assert(n == strlen(str));
@@ -254,18 +677,18 @@ static int pcp_sendstr(int outfd, char *str, char *host)
 
 /*
  * Receive an RCP response code and possibly error message.
- *	fd (IN)		file desciptor to read from
- *	host (IN)	hostname for error messages
+ *	pcp (IN)	client state, counting errors
  *	RETURN		-1 on fatal error, 0 otherwise
  */
-static int pcp_response(int infd, char *host)
+static int pcp_response(struct pcp_client *pcp)
 {
-    char resp;
+    pcp_reader_t in = pcp->in;
+    char *host = pcp->host;
+    int resp;
     int i = 0, result = -1;
-    int n;
-    char errstr[BUFSIZ];
+    char errstr[BUFSIZ], *line;
 
-    if ((n = read(infd, &resp, sizeof(resp))) != sizeof(resp)) 
+    if ((resp = pcp_reader_getc(in)) < 0)
         return (-1);
 
     switch (resp) {
@@ -276,31 +699,99 @@ static int pcp_response(int infd, char *host)
             errstr[i++] = resp;
             result = 0;
         case 1:                /* fatal error + string */
-            fd_read_line (infd, &errstr[i], BUFSIZ - i);
+            line = pcp_reader_line(in, NULL);
+            snprintf(&errstr[i], BUFSIZ - i, "%s\n", line ? line : "");
             err("%p: %S: %s: %s", host, result ? "fatal" : "error", errstr);
+            pcp->errors++;
             break;
     }
     return result;
 }
 
+/*
+ * Receive a response in pipelined mode: either "K<seq>\n", which
+ * acknowledges all records up to <seq>, or an error "\01<seq> message\n"
+ * for record <seq>, which is reported and also counts as an ack.
+ *	pcp (IN)	client state
+ *	RETURN		-1 on lost connection or protocol error, 0 otherwise
+ */
+static int _pcp_pipeline_response(struct pcp_client *pcp)
+{
+    int resp;
+    char *str, *p;
+    unsigned long seq;
+
+    if ((resp = pcp_reader_getc(pcp->in)) < 0
+        || !(str = pcp_reader_line(pcp->in, NULL))) {
+        err("%p: %S: lost connection\n", pcp->host);
+        return -1;
+    }
+
+    seq = strtoul(str, &p, 10);
+    if (p == str || (resp != 'K' && resp != '\01')) {
+        err("%p: %S: protocol error: invalid response\n", pcp->host);
+        return -1;
+    }
+    if (resp == '\01') {
+        err("%p: %S: fatal: %s\n", pcp->host, *p == ' ' ? p + 1 : p);
+        pcp->errors++;
+    }
+    if (seq > pcp->acked)
+        pcp->acked = seq;
+    return 0;
+}
+
+/*
+ * Account for a record sent to the server. In classic mode, wait for the
+ * server to respond to it. In pipelined mode, only read the responses
+ * which are already available, unless `window' records are outstanding
+ * or `drain' is set, in which case wait for responses until that is no
+ * longer true. Reading responses that are ready before each record keeps
+ * the server from blocking on a full connection while we send it data.
+ *	pcp (IN)	client state
+ *	drain (IN)	wait for responses to all records sent so far
+ *	RETURN		-1 on fatal error, 0 otherwise
+ */
+static int _pcp_record_sent(struct pcp_client *pcp, bool drain)
+{
+    struct pollfd pfd;
+
+    if (pcp->window == 0)
+        return (drain ? 0 : pcp_response(pcp));
+
+    if (!drain)
+        pcp->sent++;
+
+    pfd.fd = pcp->infd;
+    pfd.events = POLLIN;
+    while (pcp->acked < pcp->sent) {
+        if (!drain && pcp->sent - pcp->acked < pcp->window
+            && pcp_reader_pending(pcp->in) == 0) {
+            pfd.revents = 0;
+            if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & (POLLIN|POLLHUP)))
+                break;
+        }
+        if (_pcp_pipeline_response(pcp) < 0)
+            return -1;
+    }
+    return 0;
+}
+
 #define RCP_MODEMASK (S_ISUID|S_ISGID|S_ISVTX|S_IRWXU|S_IRWXG|S_IRWXO)
 
-int pcp_sendfile(struct pcp_client *pcp, char *file, char *output_file)
+int pcp_sendfile(struct pcp_client *pcp, struct pcp_filename *pf, 
+                 char *output_file)
 {
+    char *file = pf->filename;
     int result = 0;
     char tmpstr[BUFSIZ], *template;
-    struct stat sb;
+    struct stat sb = pf->sb;    /* not stat'ed again for each host */
 
 	if (output_file == NULL)
 		output_file = file;
 
     /*err("%S: %s\n", host, file); */
 
-    if (stat(file, &sb) < 0) {
-        err("%S: %s: %m\n", pcp->host, file);
-        goto fail;
-    }
-
     if (pcp->preserve) {
         /* 
          * 1: SEND stat time: "T%ld %ld %ld %ld\n" 
@@ -308,11 +799,11 @@ int pcp_sendfile(struct pcp_client *pcp, char *file, char *output_file)
          */
         snprintf(tmpstr, sizeof(tmpstr), "T%ld %ld %ld %ld\n",
                  (long) sb.st_mtime, 0L, sb.st_atime, 0L);
-        if (pcp_sendstr(pcp->outfd, tmpstr, pcp->host) < 0)
+        if (pcp_sendstr(pcp, tmpstr) < 0)
             goto fail;
 
         /* 2: RECV response code */
-        if (pcp_response(pcp->infd, pcp->host) < 0)
+        if (_pcp_record_sent(pcp, false) < 0)
             goto fail;
     }
 
@@ -323,43 +814,54 @@ int pcp_sendfile(struct pcp_client *pcp, char *file, char *output_file)
          */
         snprintf(tmpstr, sizeof(tmpstr), "D%04o %d %s\n",
                  sb.st_mode & RCP_MODEMASK, 0, xbasename(output_file));
-        if (pcp_sendstr(pcp->outfd, tmpstr, pcp->host) < 0)
+        if (pcp_sendstr(pcp, tmpstr) < 0)
             goto fail;
     } else {
         /* 
          * 3b: SEND file mode: "C%04o %lld %s\n" or "C%04o %ld %s\n"
          *    (st_mode & MODE_MASK, st_size, basename(filename))
          *    Use second template if sizeof(st_size) > sizeof(long).
+         *    With -o compress the record is "Z" and the data that
+         *    follows is compressed by the source cache filter. With
+         *    -o sparse, a file with holes is sent as an "H" record.
          */
         template = (sizeof(sb.st_size) > sizeof(long)
-                    ? "C%04o %lld %s\n" : "C%04o %ld %s\n");
-        snprintf(tmpstr, sizeof(tmpstr), template,
+                    ? "%c%04o %lld %s\n" : "%c%04o %ld %s\n");
+        snprintf(tmpstr, sizeof(tmpstr), template, 
+                 _pcp_sparse(pcp, &sb) ? 'H' : pcp->compress ? 'Z' : 'C',
                  sb.st_mode & RCP_MODEMASK, sb.st_size, xbasename(output_file));
-        if (pcp_sendstr(pcp->outfd, tmpstr, pcp->host) < 0)
+        if (pcp_sendstr(pcp, tmpstr) < 0)
             goto fail;
     }
 
-    /* 4: RECV response code */
-    if (pcp_response(pcp->infd, pcp->host) < 0)
-        goto fail;
+    /* 4: RECV response code (not in pipelined mode, see step 7) */
+    if (pcp->window == 0 || S_ISDIR(sb.st_mode)) {
+        if (_pcp_record_sent(pcp, false) < 0)
+            goto fail;
+    }
 
     if (S_ISREG(sb.st_mode)) {
-        /* 5: SEND data */
-        if (_pcp_send_file_data(pcp->outfd, file, pcp->host) < 0)
+        /* 5: SEND data (and with -o verify its digest) */
+        if (_pcp_send_data(pcp, pf, file, &sb, sb.st_size) < 0)
             goto fail;
 
         /* 6: SEND NULL byte */
-        if (_pcp_write(pcp->outfd, "", 1) < 0)
+        if (_pcp_write(pcp, "", 1) < 0)
             goto fail;
 
-        /* 7: RECV response code */
-        if (pcp_response(pcp->infd, pcp->host) < 0)
+        /* 7: RECV response code (pipelined: response to C record) */
+        if (pcp->window == 0)
+            result = pcp_response(pcp);
+        else
+            result = _pcp_record_sent(pcp, false);
+        if (result < 0)
             goto fail;
+        pcp_stats_file(pcp->stats);
     }
 
-    result = 1;                 /* indicate success */
+    return 1;                   /* indicate success */
   fail:
-    return result;
+    return -1;
 }
 
 static int _pcp_sendfile (struct pcp_filename *pf, struct pcp_client *pcp)
@@ -367,38 +869,723 @@ static int _pcp_sendfile (struct pcp_filename *pf, struct pcp_client *pcp)
 	char *output_filename = NULL;
 
 	if (strcmp(pf->filename, EXIT_SUBDIR_FILENAME) == 0) {
-		if (pcp_sendstr(pcp->outfd, EXIT_SUBDIR_FLAG, pcp->host) < 0)
+		/* pipelined: only this host's copy stops, as for files */
+		if (pcp_sendstr(pcp, EXIT_SUBDIR_FLAG) < 0) {
+			if (pcp->window)
+				return (-1);
 			errx("%p: failed to send exit subdir flag\n");
-		if (pcp_response(pcp->infd, pcp->host) < 0)
+		}
+		if (_pcp_record_sent(pcp, false) < 0) {
+			if (pcp->window)
+				return (-1);
 			errx("%p: failed to exit subdir properly\n");
+		}
 		return (0);
 	}
 
 	/* during a reverse copy, the hostname has to be attached
 	 * to the end of the output filename for files specified
-	 * by the user.
+	 * by the user, unless each host has its own directory.
 	 */
-	if (pcp->pcp_client && pf->file_specified_by_user) {
+	if (pcp->pcp_client && !pcp->hostdir && pf->file_specified_by_user) {
 		output_filename = Strdup(pf->filename);
 		xstrcat(&output_filename, ".");
 		xstrcat(&output_filename, pcp->host);
 	}
 
-	pcp_sendfile (pcp, pf->filename, output_filename);
+	if (pcp_sendfile (pcp, pf, output_filename) < 0 && pcp->window)
+		return (-1);   /* lost connection: later records would fail too */
 
 	return (0);
 }
 
-int pcp_client(struct pcp_client *pcp)
+/*
+ * Report a server which exited before its first response. Options which
+ * change the protocol are passed to the remote pdcp on its command line,
+ * and a pdcp which doesn't know them exits with a usage message.
+ */
+static void _pcp_lost_at_start(struct pcp_client *pcp)
+{
+    if (pcp->window || pcp->archive || pcp->sync || pcp->resume
+        || pcp->compress || pcp->sparse || pcp->verify)
+        err("%p: %S: remote pdcp exited before the copy started: "
+            "-o options require the same pdcp version on the remote host\n",
+            pcp->host);
+}
+
+/*
+ * Read the server's first response. A server run with -o pipeline
+ * answers "K0\n" instead of a NUL byte, which confirms that records
+ * may be pipelined.
+ *	pcp (IN)	client state
+ *	RETURN		-1 on fatal error, 0 otherwise
+ */
+static int _pcp_start(struct pcp_client *pcp)
+{
+    int errors = pcp->errors;
+    int resp;
+    char *str;
+
+    pcp->sent = pcp->acked = 0;
+    if (pcp->window == 0) {
+        if ((resp = pcp_response(pcp)) < 0 && pcp->errors == errors)
+            _pcp_lost_at_start(pcp);
+        return (resp);
+    }
+
+    if ((resp = pcp_reader_getc(pcp->in)) < 0) {
+        _pcp_lost_at_start(pcp);
+        return (-1);
+    }
+
+    switch (resp) {
+        case 'K':              
+            if (!(str = pcp_reader_line(pcp->in, NULL))
+                || strcmp(str, "0") != 0) {
+                err("%p: %S: protocol error: invalid response\n", pcp->host);
+                return (-1);
+            }
+            return (0);
+        default:               /* error, possibly tagged with seq 0 */
+            if (!(str = pcp_reader_line(pcp->in, NULL)))
+                str = "";
+            err("%p: %S: fatal: %s\n", pcp->host, 
+                strncmp(str, "0 ", 2) == 0 ? str + 2 : str);
+            return (-1);
+    }
+}
+
+/*
+ * Archive stream mode (-o archive). Instead of one exchange per file,
+ * send an "A" record, then the whole file list as one stream of T, C and
+ * D records with file data and paths relative to the target, ending with
+ * "E". Records and the data of small files are collected in a buffer, so
+ * that many small files go out in a few large writes. The server sends
+ * its errors, if any, and a final ack after the "E" record. See 
+ * _unpack() in pcp_server.c.
+ */
+#define ARCHIVE_BUFSIZ      (256 * 1024)
+#define ARCHIVE_SMALL_FILE  (64 * 1024)
+
+struct archive_out {
+    struct pcp_client *pcp;
+    char *buf;
+    size_t len;
+};
+
+static int _archive_flush(struct archive_out *o)
+{
+    if (o->len > 0 && _pcp_write(o->pcp, o->buf, o->len) < 0) {
+        err("%p: %S: write: %m\n", o->pcp->host);
+        return -1;
+    }
+    o->len = 0;
+    return 0;
+}
+
+/*
+ * Make room for `n' bytes in the buffer.
+ */
+static char *_archive_reserve(struct archive_out *o, size_t n)
+{
+    if (o->len + n > ARCHIVE_BUFSIZ && _archive_flush(o) < 0)
+        return NULL;
+    return o->buf + o->len;
+}
+
+static int _archive_record(struct archive_out *o, char *rec)
+{
+    size_t n = strlen(rec);
+    char *p;
+
+    if (!(p = _archive_reserve(o, n)))
+        return -1;
+    memcpy(p, rec, n);
+    o->len += n;
+    return 0;
+}
+
+/*
+ * Append `size' bytes at offset `off' of a file to the buffer. If the
+ * file has shrunk since it was stat'ed, pad it with zeros to keep the
+ * stream in sync, and report an error.
+ */
+static int _archive_file_data(struct archive_out *o, char *file, off_t off,
+                              off_t size)
+{
+    char *p;
+    ssize_t n = 0;
+    off_t got = 0;
+    int fd;
+
+    if (!(p = _archive_reserve(o, size)))
+        return -1;
+    if ((fd = open(file, O_RDONLY)) >= 0) {
+        while (got < size 
+               && (n = pread(fd, p + got, size - got, off + got)) != 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                break;
+            got += n;
+        }
+        close(fd);
+    }
+    if (got < size) {
+        if (fd < 0 || n < 0)
+            err("%p: %S: %s: %m\n", o->pcp->host, file);
+        else
+            err("%p: %S: %s: file changed size\n", o->pcp->host, file);
+        memset(p + got, 0, size - got);
+    }
+    o->len += size;
+    return 0;
+}
+
+/*
+ * A file to be sent in the archive stream.
+ */
+struct archive_entry {
+    struct pcp_filename *pf;
+    char *path;                 /* path relative to the target */
+    const struct stat *sb;      /* snapshot in pf */
+    char *remote;               /* -o sync: server's reply for this file */
+};
+
+/*
+ * Sync mode (-o sync). Before the archive stream, the client asks the
+ * server for the size, mtime and block digests of all regular files in
+ * one batched query, see _sync_query() in pcp_server.c. Files which are
+ * the same on the server are then left out of the stream, and only the
+ * changed blocks of other files which exist on the server are sent.
+ */
+#define SYNC_BLOCK_SIZE     (128 * 1024)
+
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Compute the digest of each block of a local file, once for all hosts.
+ */
+static int _sync_local_digests(struct pcp_filename *pf, off_t size)
+{
+    char *buf;
+    int fd, i;
+
+    pthread_mutex_lock(&sync_mutex);
+    if (pf->blocks || (fd = open(pf->filename, O_RDONLY)) < 0)
+        goto out;
+
+    pf->nblocks = size ? (size + SYNC_BLOCK_SIZE - 1) / SYNC_BLOCK_SIZE : 1;
+    pf->blocks = Malloc(pf->nblocks * sizeof(uint64_t));
+    buf = Malloc(SYNC_BLOCK_SIZE);
+    for (i = 0; i < pf->nblocks; i++) {
+        off_t off = (off_t) i * SYNC_BLOCK_SIZE;
+        ssize_t len = MIN(size - off, SYNC_BLOCK_SIZE);
+        ssize_t n, got = 0;
+
+        while (got < len && (n = read(fd, buf + got, len - got)) != 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                break;
+            got += n;
+        }
+        pf->blocks[i] = digest_buf(buf, got);
+    }
+    Free((void **) &buf);
+    close(fd);
+out:
+    pthread_mutex_unlock(&sync_mutex);
+    return (pf->blocks ? 0 : -1);
+}
+
+/*
+ * Read `n' lines of reply from the server into the entries which were
+ * part of the query.
+ */
+static int _sync_read_replies(struct pcp_client *pcp, 
+                              struct archive_entry *e, int nentries, int n)
+{
+    char *line;
+    int k = 0;
+
+    while (n-- > 0) {
+        if (!(line = pcp_reader_line(pcp->in, NULL))) {
+            err("%p: %S: lost connection\n", pcp->host);
+            return -1;
+        }
+        if (line[0] == '\01') {
+            err("%p: %S: fatal: %s\n", pcp->host, line + 1);
+            return -1;
+        }
+        while (!S_ISREG(e[k].sb->st_mode))
+            k++;
+        e[k++].remote = Strdup(line);
+    }
+    return 0;
+}
+
+static int _sync_query(struct pcp_client *pcp, struct archive_entry *e, 
+                       int nentries)
+{
+    struct archive_out o[1];
+    char rec[MAXPATHNAMELEN + 128];
+    int k, n = 0, rc;
+
+    o->pcp = pcp;
+    o->buf = Malloc(ARCHIVE_BUFSIZ);
+    o->len = 0;
+
+    snprintf(rec, sizeof(rec), "S%d\n", SYNC_BLOCK_SIZE);
+    rc = _archive_record(o, rec);
+    for (k = 0; k < nentries && rc == 0; k++) {
+        if (!S_ISREG(e[k].sb->st_mode))
+            continue;
+        snprintf(rec, sizeof(rec), "%lld %s\n",
+                 (long long) e[k].sb->st_size, e[k].path);
+        rc = _archive_record(o, rec);
+        n++;
+    }
+    if (rc == 0 && _archive_record(o, "\n") == 0)
+        rc = _archive_flush(o);
+    Free((void **) &o->buf);
+    if (rc < 0)
+        return -1;
+
+    return _sync_read_replies(pcp, e, nentries, n);
+}
+
+/*
+ * Decide how to send a regular file in sync mode. Returns -1 to send
+ * the whole file, or the number of changed blocks, which are marked in
+ * `changed'. `same' is set if the file has the same contents on the
+ * server, and -2 returned if it also has the same mtime. With `resume',
+ * the changed blocks are sent however many there are.
+ */
+static int _sync_changes(struct archive_entry *e, bool *changed, bool *same,
+                         bool resume)
+{
+    struct pcp_filename *pf = e->pf;
+    long long rsize;
+    long rmtime;
+    char *p;
+    int i, n = 0;
+
+    if (!e->remote || !strcmp(e->remote, "-"))
+        return -1;
+
+    rsize = strtoll(e->remote, &p, 10);
+    rmtime = strtol(p, &p, 10);
+    if (*p++ != ' ')
+        return -1;
+    if (!strcmp(p, "-") || _sync_local_digests(pf, e->sb->st_size) < 0)
+        return -1;
+
+    for (i = 0; i < pf->nblocks; i++) {
+        uint64_t h = 0;
+        bool have = false;
+
+        if (*p) {
+            h = strtoull(p, &p, 16);
+            have = true;
+            if (*p == ',')
+                p++;
+        }
+        changed[i] = !have || h != pf->blocks[i];
+        if (changed[i])
+            n++;
+    }
+
+    *same = (n == 0 && rsize == e->sb->st_size);
+    if (*same && rmtime == e->sb->st_mtime)
+        return -2;
+
+    /* 
+     * Not worth sending blocks if most of the file has changed, unless
+     * resuming, where most of a file may be missing after a partial copy
+     */
+    if (n > pf->nblocks / 2 && !resume)
+        return -1;
+    return n;
+}
+
+static int _archive_file(struct archive_out *o, struct archive_entry *e)
+{
+    struct pcp_client *pcp = o->pcp;
+    struct pcp_filename *pf = e->pf;
+    const struct stat *sb = e->sb;
+    char rec[MAXPATHNAMELEN + 128];
+    bool *changed = NULL, same = false;
+    int i, n = -1;
+    char type;
+
+    if (pcp->sync && S_ISREG(sb->st_mode)) {
+        changed = Malloc((sb->st_size / SYNC_BLOCK_SIZE + 1) * sizeof(bool));
+        n = _sync_changes(e, changed, &same, pcp->resume);
+
+        /* unchanged: only update its times with -p */
+        if (n == -2 || (same && !pcp->preserve)) {
+            Free((void **) &changed);
+            return 0;
+        }
+    }
+
+    if (pcp->preserve) {
+        snprintf(rec, sizeof(rec), "T%ld %ld %ld %ld\n",
+                 (long) sb->st_mtime, 0L, sb->st_atime, 0L);
+        if (_archive_record(o, rec) < 0)
+            goto fail;
+    }
+    if (S_ISDIR(sb->st_mode)) {
+        snprintf(rec, sizeof(rec), "D%04o %d %s\n",
+                 sb->st_mode & RCP_MODEMASK, 0, e->path);
+        return _archive_record(o, rec);
+    }
+
+    if (n >= 0) {
+        snprintf(rec, sizeof(rec), "P%04o %lld %d %d %s\n",
+                 sb->st_mode & RCP_MODEMASK, (long long) sb->st_size, 
+                 SYNC_BLOCK_SIZE, n, e->path);
+        if (_archive_record(o, rec) < 0)
+            goto fail;
+        for (i = 0; n > 0 && i < pf->nblocks; i++) {
+            off_t off = (off_t) i * SYNC_BLOCK_SIZE;
+
+            off_t len = MIN(sb->st_size - off, SYNC_BLOCK_SIZE);
+
+            if (!changed[i])
+                continue;
+            /* with -o sparse, a block in a hole is sent without data */
+            if (_pcp_sparse(pcp, sb) && _pcp_hole(pf->filename, off, len)) {
+                snprintf(rec, sizeof(rec), "%d -\n", i);
+                if (_archive_record(o, rec) < 0)
+                    goto fail;
+                continue;
+            }
+            snprintf(rec, sizeof(rec), "%d\n", i);
+            if (_archive_record(o, rec) < 0
+                || _archive_file_data(o, pf->filename, off, len) < 0)
+                goto fail;
+        }
+        Free((void **) &changed);
+        return 0;
+    }
+    if (changed)
+        Free((void **) &changed);
+
+    /* small files are sent inline, uncompressed and not sparse */
+    if (sb->st_size < ARCHIVE_SMALL_FILE)
+        type = 'C';
+    else if (_pcp_sparse(pcp, sb))
+        type = 'H';
+    else
+        type = pcp->compress ? 'Z' : 'C';
+    snprintf(rec, sizeof(rec), "%c%04o %lld %s\n", type,
+             sb->st_mode & RCP_MODEMASK, (long long) sb->st_size, e->path);
+    if (_archive_record(o, rec) < 0)
+        return -1;
+
+    if (sb->st_size < ARCHIVE_SMALL_FILE) {
+        if (_archive_file_data(o, pf->filename, 0, sb->st_size) < 0)
+            return -1;
+        if (!pcp->verify)
+            return 0;
+        if (_verify_begin(pcp, pf)) {
+            struct digest d;
+            digest_init(&d);
+            digest_update(&d, o->buf + o->len - sb->st_size, sb->st_size);
+            _verify_end(pf, &d);
+        }
+        if (_verify_line(pcp, pf, sb->st_size, rec) < 0)
+            return -1;
+        return _archive_record(o, rec);
+    }
+
+    if (_archive_flush(o) < 0)
+        return -1;
+    return _pcp_send_data(pcp, pf, pf->filename, sb, sb->st_size);
+fail:
+    if (changed)
+        Free((void **) &changed);
+    return -1;
+}
+
+/*
+ * Build the list of files to send, with their paths relative to the
+ * target. The path of a file found under a directory given by the user
+ * starts with that directory's name on the target.
+ */
+static struct archive_entry *_archive_entries(struct pcp_client *pcp, 
+                                              int *np)
+{
+    struct archive_entry *e;
+    struct pcp_filename *pf, *top = NULL;
+    ListIterator i;
+    char *base = NULL;
+    int n = 0;
+
+    e = Malloc(list_count(pcp->infiles) * sizeof(*e) + 1);
+    i = list_iterator_create(pcp->infiles);
+    while ((pf = list_next(i))) {
+        if (strcmp(pf->filename, EXIT_SUBDIR_FILENAME) == 0)
+            continue;
+        if (pf->file_specified_by_user) {
+            top = pf;
+            if (base)
+                Free((void **) &base);
+            base = Strdup(xbasename(pf->filename));
+            if (pcp->pcp_client && !pcp->hostdir) {
+                xstrcat(&base, ".");
+                xstrcat(&base, pcp->host);
+            }
+        }
+        e[n].pf = pf;
+        e[n].sb = &pf->sb;
+        e[n].path = Strdup(base);
+        xstrcat(&e[n].path, pf->filename + strlen(top->filename));
+        e[n].remote = NULL;
+        n++;
+    }
+    list_iterator_destroy(i);
+    if (base)
+        Free((void **) &base);
+    *np = n;
+    return e;
+}
+
+static void _archive_entries_destroy(struct archive_entry *e, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        Free((void **) &e[i].path);
+        if (e[i].remote)
+            Free((void **) &e[i].remote);
+    }
+    Free((void **) &e);
+}
+
+/*
+ * Several connections to one host (-o streams) share the files of the
+ * copy: every directory is sent on each of them, and each file goes to
+ * the connection which claims it next from the queue of the host. Files
+ * larger than STREAM_CHUNK are split into chunks claimed separately and
+ * sent as one-block "P" records, which the server writes in place.
+ * Chunks can't be verified or compressed, so with -o verify or 
+ * -o compress files are not split.
+ */
+#define STREAM_CHUNK        (8 * 1024 * 1024)
+
+struct pcp_queue {
+    pthread_mutex_t mutex;
+    long next;                  /* next item to be claimed */
+};
+
+pcp_queue_t pcp_queue_create(void)
+{
+    pcp_queue_t q = Malloc(sizeof(*q));
+
+    pthread_mutex_init(&q->mutex, NULL);
+    return q;
+}
+
+void pcp_queue_destroy(pcp_queue_t q)
+{
+    pthread_mutex_destroy(&q->mutex);
+    Free((void **) &q);
+}
+
+static long _queue_next(pcp_queue_t q)
+{
+    long item;
+
+    pthread_mutex_lock(&q->mutex);
+    item = q->next++;
+    pthread_mutex_unlock(&q->mutex);
+    return item;
+}
+
+/*
+ * Return the number of items a file is sent as.
+ */
+static int _stream_chunks(struct pcp_client *pcp, const struct stat *sb)
+{
+    if (pcp->verify || pcp->compress || sb->st_size <= STREAM_CHUNK)
+        return 1;
+    return (sb->st_size + STREAM_CHUNK - 1) / STREAM_CHUNK;
+}
+
+/*
+ * Send chunk `i' of a large file as a "P" record of one block.
+ */
+static int _archive_chunk(struct archive_out *o, struct archive_entry *e,
+                          int i)
+{
+    struct pcp_client *pcp = o->pcp;
+    const struct stat *sb = e->sb;
+    off_t off = (off_t) i * STREAM_CHUNK;
+    off_t len = MIN(sb->st_size - off, STREAM_CHUNK);
+    char rec[MAXPATHNAMELEN + 128];
+    bool sparse, hole;
+    int fd, rc;
+
+    if (pcp->preserve) {
+        snprintf(rec, sizeof(rec), "T%ld %ld %ld %ld\n",
+                 (long) sb->st_mtime, 0L, sb->st_atime, 0L);
+        if (_archive_record(o, rec) < 0)
+            return -1;
+    }
+    snprintf(rec, sizeof(rec), "P%04o %lld %d 1 %s\n",
+             sb->st_mode & RCP_MODEMASK, (long long) sb->st_size,
+             STREAM_CHUNK, e->path);
+    if (_archive_record(o, rec) < 0)
+        return -1;
+    /* -o sparse: a hole, or only the data segments of the chunk */
+    sparse = _pcp_sparse(pcp, sb);
+    hole = sparse && _pcp_hole(e->pf->filename, off, len);
+    snprintf(rec, sizeof(rec), hole ? "%d -\n" : sparse ? "%d s\n" : "%d\n", 
+             i);
+    if (_archive_record(o, rec) < 0 || _archive_flush(o) < 0)
+        return -1;
+    if (hole)
+        return 0;
+    if (sparse)
+        return _pcp_send_sparse_data(pcp, e->pf->filename, off, off + len);
+
+    if ((fd = open(e->pf->filename, O_RDONLY)) < 0) {
+        err("%S: _archive_chunk: open %s: %m\n", pcp->host, e->pf->filename);
+        return -1;
+    }
+    if (lseek(fd, off, SEEK_SET) < 0) {
+        err("%S: _archive_chunk: seek %s: %m\n", pcp->host, e->pf->filename);
+        close(fd);
+        return -1;
+    }
+    rc = _pcp_send_fd_data(pcp, fd, e->pf->filename, len);
+    close(fd);
+    return rc;
+}
+
+/*
+ * Send the share of the `n' entries `e' of this connection to the host.
+ * Items are numbered in the order of the entries, and claimed in
+ * increasing order, so this connection only moves forward through them.
+ */
+static int _archive_streams(struct archive_out *o, struct archive_entry *e,
+                            int n)
+{
+    struct pcp_client *pcp = o->pcp;
+    long item = 0, next = _queue_next(pcp->queue);
+    int i, k, nchunks, rc;
+
+    for (k = 0; k < n; k++) {
+        if (S_ISDIR(e[k].sb->st_mode)) {
+            if (_archive_file(o, &e[k]) < 0)
+                return -1;
+            continue;
+        }
+        nchunks = _stream_chunks(pcp, e[k].sb);
+        for (i = 0; i < nchunks; i++, item++) {
+            if (item != next)
+                continue;
+            if (nchunks > 1)
+                rc = _archive_chunk(o, &e[k], i);
+            else
+                rc = _archive_file(o, &e[k]);
+            if (rc < 0)
+                return -1;
+            if (i == 0)
+                pcp_stats_file(pcp->stats);
+            next = _queue_next(pcp->queue);
+        }
+    }
+    return 0;
+}
+
+static int _pcp_send_archive(struct pcp_client *pcp)
+{
+    struct archive_out o[1];
+    struct archive_entry *e;
+    char *errstr;
+    int resp, k, n, rc = 0;
+
+    e = _archive_entries(pcp, &n);
+    if (pcp->sync && _sync_query(pcp, e, n) < 0) {
+        _archive_entries_destroy(e, n);
+        return -1;
+    }
+
+    if (pcp_sendstr(pcp, "A\n") < 0
+        || pcp_response(pcp) < 0) {
+        _archive_entries_destroy(e, n);
+        return -1;
+    }
+
+    o->pcp = pcp;
+    o->buf = Malloc(ARCHIVE_BUFSIZ);
+    o->len = 0;
+
+    if (pcp->queue)
+        rc = _archive_streams(o, e, n);
+    for (k = 0; k < n && rc == 0 && !pcp->queue; k++) {
+        if ((rc = _archive_file(o, &e[k])) == 0 && S_ISREG(e[k].sb->st_mode))
+            pcp_stats_file(pcp->stats);
+    }
+    _archive_entries_destroy(e, n);
+
+    if (rc == 0 && _archive_record(o, EXIT_SUBDIR_FLAG) == 0)
+        rc = _archive_flush(o);
+    Free((void **) &o->buf);
+    if (rc < 0)
+        return -1;
+
+    /* errors, if any, then the final ack */
+    while ((resp = pcp_reader_getc(pcp->in)) >= 0) {
+        if (resp == 0)
+            return 0;
+        if (!(errstr = pcp_reader_line(pcp->in, NULL)))
+            break;
+        err("%p: %S: fatal: %s\n", pcp->host, errstr);
+        pcp->errors++;
+    }
+    err("%p: %S: lost connection\n", pcp->host);
+    return -1;
+}
+
+static int _pcp_client(struct pcp_client *pcp)
 {
     /* 0: RECV response code */
-    if (pcp_response(pcp->infd, pcp->host) >= 0) {
+    if (_pcp_start(pcp) >= 0) {
         struct pcp_filename *pf;
-        ListIterator i = list_iterator_create (pcp->infiles);
-        while ((pf = list_next (i)))
-            _pcp_sendfile (pf, pcp);
+        ListIterator i;
+        int rc = 0;
+
+        if (pcp->archive)
+            return _pcp_send_archive (pcp);
+
+        i = list_iterator_create (pcp->infiles);
+        while ((pf = list_next (i))) {
+            if ((rc = _pcp_sendfile (pf, pcp)) < 0)
+                break;
+        }
         list_iterator_destroy (i);
-        return 0;
+
+        /* wait for all pipelined records to be acknowledged */
+        if (rc == 0 && _pcp_record_sent (pcp, true) < 0)
+            return -1;
+        return rc;
     }
     return -1;
 }
+
+int pcp_client(struct pcp_client *pcp)
+{
+    int rc;
+
+    pcp->in = pcp_reader_create(pcp->infd, BUFSIZ);
+    pcp_reader_set_stats(pcp->in, pcp->stats);
+    pcp->errors = 0;
+    rc = _pcp_client(pcp);
+    pcp_reader_destroy(pcp->in);
+    return rc;
+}
@@ -31,9 +31,16 @@
 #  include <config.h>
 #endif 
 
+#include <stdint.h>
+#include <sys/stat.h>
+
 #include "src/pdsh/opt.h"
 
 #include "src/common/list.h"
+#include "src/pdsh/pcp_source.h"
+#include "src/pdsh/pcp_reader.h"
+#include "src/pdsh/pcp_rate.h"
+#include "src/pdsh/pcp_stats.h"
 
 /* define the filename flag as an impossible filename */
 #define EXIT_SUBDIR_FILENAME    "a!b@c#d$"
@@ -48,20 +55,65 @@
 struct pcp_filename {
     char *filename;
     int file_specified_by_user;
+    struct stat sb;             /* taken once, when the list is built */
+    pcp_source_t source;        /* shared source cache (-o source-cache) */
+    uint64_t *blocks;           /* digest of each block (-o sync) */
+    int nblocks;
+    uint64_t digest;            /* digest of the data sent (-o verify) */
+    int digest_state;           /* see _verify_begin() in pcp_client.c */
 };
 
 /* expand directories, if any, and verify access for all files */
+/*
+ *  Return the command which runs the pcp server (pdcp -z) on a target
+ *   host, with the options of `opt' that the server must know about.
+ *   With `chain_next' set, the server forwards the stream to those
+ *   hosts (-o chain). The result is freed with Free().
+ */
+char *pcp_server_cmd (opt_t *opt, bool target_is_dir, char *chain_next);
+
 List pcp_expand_dirs (List infile_names);
 
+/* warn about files which changed since the list was built, return count */
+int pcp_check_unchanged (List infiles);
+
+/* -o streams: files and chunks claimed in turn by the connections to a host */
+typedef struct pcp_queue * pcp_queue_t;
+
+pcp_queue_t pcp_queue_create (void);
+void pcp_queue_destroy (pcp_queue_t q);
+
 struct pcp_client {
 	int infd;
 	int outfd;
+	pcp_reader_t in;        /* buffered reader on infd */
 	bool preserve;
 	bool pcp_client;
 	char *host;
 	List infiles;
+	bool archive;           /* -o archive: send files as one stream */
+	bool sync;              /* -o sync: send only changed files */
+	bool compress;          /* -o compress: send compressed file data */
+	bool sparse;            /* -o sparse: send only data of sparse files */
+	bool verify;            /* -o verify: send digest after file data */
+	struct digest *digest;  /* digest of data being sent, or NULL */
+	bool hostdir;           /* -o hostdir: don't append host to names */
+	bool resume;            /* -o resume: send all changed blocks */
+	int errors;             /* errors reported by the server */
+	pcp_rate_t rate;        /* send limit and byte count, or NULL */
+	pcp_stats_t stats;      /* progress counters, or NULL */
+	pcp_queue_t queue;      /* -o streams: shared with the other
+	                           connections to the host, or NULL */
+	int window;             /* -o pipeline: max unacked records, or 0 */
+	unsigned long sent;     /* records sent (pipelined mode) */
+	unsigned long acked;    /* records acknowledged (pipelined mode) */
 };
 
 int pcp_client (struct pcp_client *cli);
 
+#if HAVE_ZLIB
+/* source cache filter which compresses each chunk (-o compress) */
+char *pcp_compress_chunk (const char *data, size_t len, size_t *lenp);
+#endif
+
 #endif /* _PCP_CLIENT_H */
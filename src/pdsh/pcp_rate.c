@@ -0,0 +1,215 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "pcp_rate.h"
+#include "pcp_stats.h"
+
+/*
+ *  Most data granted to a thread in one turn. Smaller grants share the
+ *   bandwidth more evenly, larger ones mean fewer wakeups.
+ */
+#define RATE_QUANTUM        (64 * 1024)
+
+/*
+ *  Token bucket: `tokens' bytes may be sent now, refilled at `rate'
+ *   bytes per second up to `burst'.
+ */
+struct bucket {
+    double          rate;
+    double          burst;
+    double          tokens;
+    double          last;
+};
+
+struct pcp_rate {
+    struct bucket   host;           /* -o host-rate, if rate > 0 */
+    uint64_t        bytes;          /* bytes granted */
+    double          created;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    struct bucket   total;          /* -o rate, if rate > 0 */
+    size_t          host_rate;
+    unsigned long   next_ticket;    /* next turn to hand out */
+    unsigned long   serving;        /* turn of thread now served */
+    uint64_t        bytes;          /* totals for pcp_rate_total() */
+    double          first;
+    double          last;
+} rate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+            { 0.0, 0.0, 0.0, 0.0 }, 0, 0, 0, 0, 0.0, 0.0 };
+
+static void _bucket_init (struct bucket *b, size_t bps)
+{
+    b->rate = bps;
+    b->burst = MAX (bps / 10, 4096);
+    b->tokens = b->burst;
+    b->last = pcp_stats_now ();
+}
+
+static void _bucket_refill (struct bucket *b, double now)
+{
+    if (now > b->last)
+        b->tokens = MIN (b->burst, b->tokens + (now - b->last) * b->rate);
+    b->last = now;
+}
+
+/*
+ *  Return seconds to wait until `n' tokens are in bucket `b'.
+ */
+static double _bucket_wait (struct bucket *b, size_t n)
+{
+    _bucket_refill (b, pcp_stats_now ());
+    if (b->tokens >= n)
+        return (0.0);
+    return ((n - b->tokens) / b->rate);
+}
+
+static void _sleep (double secs)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) secs;
+    ts.tv_nsec = (long) ((secs - ts.tv_sec) * 1e9);
+    while (nanosleep (&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+void pcp_rate_init (size_t bps, size_t host_bps)
+{
+    if (bps)
+        _bucket_init (&rate.total, bps);
+    rate.host_rate = host_bps;
+}
+
+int pcp_rate_enabled (void)
+{
+    return (rate.total.rate > 0 || rate.host_rate > 0);
+}
+
+pcp_rate_t pcp_rate_create (void)
+{
+    pcp_rate_t r = Malloc (sizeof (*r));
+
+    if (rate.host_rate)
+        _bucket_init (&r->host, rate.host_rate);
+    r->created = pcp_stats_now ();
+
+    pthread_mutex_lock (&rate.mutex);
+    if (rate.first == 0.0 || r->created < rate.first)
+        rate.first = r->created;
+    pthread_mutex_unlock (&rate.mutex);
+    return (r);
+}
+
+void pcp_rate_destroy (pcp_rate_t r)
+{
+    pthread_mutex_lock (&rate.mutex);
+    rate.bytes += r->bytes;
+    rate.last = MAX (rate.last, pcp_stats_now ());
+    pthread_mutex_unlock (&rate.mutex);
+    Free ((void **) &r);
+}
+
+/*
+ *  Take `n' tokens from the shared bucket, waiting for this thread's
+ *   turn and then for the tokens.
+ */
+static void _total_take (size_t n)
+{
+    unsigned long ticket;
+    double wait;
+
+    pthread_mutex_lock (&rate.mutex);
+    ticket = rate.next_ticket++;
+    while (ticket != rate.serving)
+        pthread_cond_wait (&rate.cond, &rate.mutex);
+
+    while ((wait = _bucket_wait (&rate.total, n)) > 0.0) {
+        struct timespec ts;
+        double t = pcp_stats_now () + wait;
+
+        ts.tv_sec = (time_t) t;
+        ts.tv_nsec = (long) ((t - ts.tv_sec) * 1e9);
+        pthread_cond_timedwait (&rate.cond, &rate.mutex, &ts);
+    }
+    rate.total.tokens -= n;
+
+    rate.serving++;
+    pthread_cond_broadcast (&rate.cond);
+    pthread_mutex_unlock (&rate.mutex);
+}
+
+size_t pcp_rate_take (pcp_rate_t r, size_t len)
+{
+    size_t n = len;
+    double wait;
+
+    if (rate.total.rate > 0)
+        n = MIN (n, MIN (RATE_QUANTUM, rate.total.burst));
+    if (r->host.rate > 0) {
+        n = MIN (n, MIN (RATE_QUANTUM, r->host.burst));
+        if ((wait = _bucket_wait (&r->host, n)) > 0.0)
+            _sleep (wait);
+    }
+    if (rate.total.rate > 0)
+        _total_take (n);
+    if (r->host.rate > 0) {
+        _bucket_refill (&r->host, pcp_stats_now ());
+        r->host.tokens -= n;
+    }
+    r->bytes += n;
+    return (n);
+}
+
+uint64_t pcp_rate_stats (pcp_rate_t r, double *secs)
+{
+    *secs = pcp_stats_now () - r->created;
+    return (r->bytes);
+}
+
+uint64_t pcp_rate_total (double *secs)
+{
+    *secs = rate.last - rate.first;
+    return (rate.bytes);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
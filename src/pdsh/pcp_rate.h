@@ -0,0 +1,84 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Bandwidth shaping for pdcp (-o rate, -o host-rate): all pcp client
+ *   threads draw from one token bucket refilled at the aggregate rate,
+ *   and optionally each from a bucket of its own refilled at the per
+ *   host rate. Threads waiting for the shared bucket are served in
+ *   turn, at most one quantum of data each, so that a fast host cannot
+ *   starve the others of bandwidth.
+ */
+
+#ifndef _PCP_RATE_H
+#define _PCP_RATE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+typedef struct pcp_rate * pcp_rate_t;
+
+/*
+ *  Limit the data sent by all threads to `rate' bytes per second, and
+ *   that sent to each host to `host_rate' (0: no limit).
+ */
+void pcp_rate_init (size_t rate, size_t host_rate);
+
+/*
+ *  Return nonzero if sends are limited.
+ */
+int pcp_rate_enabled (void);
+
+/*
+ *  Create the send state of one host, which also counts the bytes sent
+ *   to it for the debug statistics.
+ */
+pcp_rate_t pcp_rate_create (void);
+void pcp_rate_destroy (pcp_rate_t r);
+
+/*
+ *  Wait until data may be sent to the host of `r', and return how many
+ *   of `len' bytes may be sent now (at least 1).
+ */
+size_t pcp_rate_take (pcp_rate_t r, size_t len);
+
+/*
+ *  Return bytes sent to the host of `r' so far, and the seconds since
+ *   it was created in `secs'.
+ */
+uint64_t pcp_rate_stats (pcp_rate_t r, double *secs);
+
+/*
+ *  Return bytes sent to all hosts whose state has been destroyed, and
+ *   the seconds from the first create to the last destroy in `secs'.
+ */
+uint64_t pcp_rate_total (double *secs);
+
+#endif /* !_PCP_RATE_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,190 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "src/common/fd.h"
+#include "pcp_reader.h"
+
+/*
+ *  Longest line the buffer is grown for
+ */
+#define PCP_READER_MAX_LINE  (64 * 1024 * 1024)
+
+struct pcp_reader {
+    int     fd;
+    char *  buf;
+    size_t  size;
+    size_t  start;              /* start of unconsumed data in buf      */
+    size_t  end;                /* end of data in buf                   */
+    pcp_stats_t stats;          /* time blocked in read and write       */
+};
+
+pcp_reader_t pcp_reader_create (int fd, size_t size)
+{
+    pcp_reader_t r = Malloc (sizeof (*r));
+
+    r->fd = fd;
+    r->buf = Malloc (size);
+    r->size = size;
+    r->start = r->end = 0;
+    return (r);
+}
+
+void pcp_reader_set_stats (pcp_reader_t r, pcp_stats_t stats)
+{
+    r->stats = stats;
+}
+
+void pcp_reader_destroy (pcp_reader_t r)
+{
+    Free ((void **) &r->buf);
+    Free ((void **) &r);
+}
+
+size_t pcp_reader_pending (pcp_reader_t r)
+{
+    return (r->end - r->start);
+}
+
+/*
+ *  Read more of the stream into the buffer, moving unconsumed data to
+ *   the front first, and growing the buffer if it is full.
+ *   Returns -1 on EOF or error.
+ */
+static int _fill (pcp_reader_t r)
+{
+    ssize_t n;
+
+    if (r->start > 0) {
+        memmove (r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (r->end == r->size) {
+        if (r->size >= PCP_READER_MAX_LINE)
+            return (-1);
+        r->size *= 2;
+        Realloc ((void **) &r->buf, r->size);
+    }
+    pcp_stats_wait_begin (r->stats);
+    do 
+        n = read (r->fd, r->buf + r->end, r->size - r->end);
+    while (n < 0 && errno == EINTR);
+    pcp_stats_wait_end (r->stats);
+    if (n <= 0)
+        return (-1);
+    r->end += n;
+    return (0);
+}
+
+int pcp_reader_getc (pcp_reader_t r)
+{
+    if (r->start == r->end && _fill (r) < 0)
+        return (-1);
+    return ((unsigned char) r->buf[r->start++]);
+}
+
+char *pcp_reader_line (pcp_reader_t r, size_t *lenp)
+{
+    size_t scanned = 0;
+    char *nl, *line;
+
+    while (!(nl = memchr (r->buf + r->start + scanned, '\n', 
+                          r->end - r->start - scanned))) {
+        scanned = r->end - r->start;
+        if (_fill (r) < 0)
+            return (NULL);
+    }
+    *nl = '\0';
+    line = r->buf + r->start;
+    if (lenp)
+        *lenp = nl - line;
+    r->start = nl - r->buf + 1;
+    return (line);
+}
+
+int pcp_reader_read (pcp_reader_t r, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len > 0) {
+        size_t n;
+
+        if (r->start == r->end && _fill (r) < 0)
+            return (-1);
+        n = MIN (r->end - r->start, len);
+        memcpy (p, r->buf + r->start, n);
+        r->start += n;
+        p += n;
+        len -= n;
+    }
+    return (0);
+}
+
+int pcp_reader_copy (pcp_reader_t r, int fd, off_t size, int *errp)
+{
+    return (pcp_reader_copy_digest (r, fd, size, errp, NULL));
+}
+
+int pcp_reader_copy_digest (pcp_reader_t r, int fd, off_t size, int *errp,
+                            struct digest *d)
+{
+    while (size > 0) {
+        size_t n;
+
+        if (r->start == r->end && _fill (r) < 0)
+            return (-1);
+        n = r->end - r->start;
+        if ((off_t) n > size)
+            n = size;
+        if (fd >= 0 && *errp == 0) {
+            pcp_stats_write_begin (r->stats);
+            if (fd_write_n (fd, r->buf + r->start, n) < 0)
+                *errp = errno ? errno : EIO;
+            pcp_stats_write_end (r->stats, *errp ? 0 : n);
+        }
+        if (d)
+            digest_update (d, r->buf + r->start, n);
+        r->start += n;
+        size -= n;
+    }
+    return (0);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
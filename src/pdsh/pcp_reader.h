@@ -0,0 +1,101 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Buffered reader for the pcp protocol stream: control records,
+ *   responses and file data are parsed out of one large buffer, so
+ *   that reading a record or a response costs no system call per
+ *   byte, and file data following a record is often read with it.
+ *   Used by both the pcp client and server, one reader per connection.
+ */
+
+#ifndef _PCP_READER_H
+#define _PCP_READER_H
+
+#include <sys/types.h>
+
+#include "src/common/digest.h"
+#include "src/pdsh/pcp_stats.h"
+
+typedef struct pcp_reader * pcp_reader_t;
+
+/*
+ *  Create a reader on file descriptor `fd', with an initial buffer of
+ *   `size' bytes. The buffer grows as needed to hold one long line.
+ */
+pcp_reader_t pcp_reader_create (int fd, size_t size);
+void pcp_reader_destroy (pcp_reader_t r);
+
+/*
+ *  Count the time blocked reading from the descriptor, and the time and
+ *   bytes written by pcp_reader_copy(), in `stats' (may be NULL).
+ */
+void pcp_reader_set_stats (pcp_reader_t r, pcp_stats_t stats);
+
+/*
+ *  Return the number of bytes which have been read from the descriptor
+ *   but not yet consumed, i.e. which can be consumed without blocking.
+ */
+size_t pcp_reader_pending (pcp_reader_t r);
+
+/*
+ *  Return the next byte from the stream, or -1 on EOF or error.
+ */
+int pcp_reader_getc (pcp_reader_t r);
+
+/*
+ *  Return the next line from the stream, NUL-terminated and without its
+ *   newline, and store its length in `*lenp' if `lenp' is not NULL. The
+ *   line is valid until the next call on `r'. Returns NULL on EOF or
+ *   error, including EOF after an incomplete line.
+ */
+char *pcp_reader_line (pcp_reader_t r, size_t *lenp);
+
+/*
+ *  Read exactly `len' bytes from the stream into `buf'.
+ *   Returns 0, or -1 if the stream ends first.
+ */
+int pcp_reader_read (pcp_reader_t r, void *buf, size_t len);
+
+/*
+ *  Consume `size' bytes of data from the stream, writing them to `fd'
+ *   unless fd < 0 or `*errp' is nonzero. A write error stops writing
+ *   and is stored in `*errp', but the rest of the data is still
+ *   consumed. Returns -1 if the stream ends first.
+ */
+int pcp_reader_copy (pcp_reader_t r, int fd, off_t size, int *errp);
+
+/*
+ *  As pcp_reader_copy(), also adding the data consumed to digest `d'.
+ */
+int pcp_reader_copy_digest (pcp_reader_t r, int fd, off_t size, int *errp,
+                            struct digest *d);
+
+#endif /* !_PCP_READER_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,165 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "src/common/err.h"
+#include "src/common/fd.h"
+#include "src/common/digest.h"
+#include "src/common/xmalloc.h"
+#include "pcp_client.h"
+#include "pcp_resume.h"
+
+#define RESUME_MAGIC    "pdcp-resume"
+
+static pthread_mutex_t resume_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int journal_fd = -1;
+
+/*
+ *  Digest identifying the copy: a journal is only valid for the same
+ *   destination and the same source files, unchanged.
+ */
+static uint64_t _copy_key (List infiles, const char *dest, bool preserve)
+{
+    struct digest d;
+    struct pcp_filename *pf;
+    ListIterator i;
+
+    digest_init (&d);
+    digest_update (&d, dest, strlen (dest) + 1);
+    digest_update (&d, preserve ? "p" : "-", 1);
+
+    i = list_iterator_create (infiles);
+    while ((pf = list_next (i))) {
+        long long attr[3];
+
+        attr[0] = pf->sb.st_size;
+        attr[1] = pf->sb.st_mode;
+        attr[2] = pf->sb.st_mtime;
+        digest_update (&d, pf->filename, strlen (pf->filename) + 1);
+        digest_update (&d, attr, sizeof (attr));
+    }
+    list_iterator_destroy (i);
+
+    return (digest_final (&d));
+}
+
+/*
+ *  Read the hosts completed in an earlier run of the copy with header
+ *   `header' from journal `fp' into `done'. Returns -1 if the journal
+ *   is of another copy.
+ */
+static int _read_journal (FILE *fp, const char *header, hostlist_t done)
+{
+    char line[1024];
+
+    if (!fgets (line, sizeof (line), fp) || strcmp (line, header) != 0)
+        return (-1);
+    while (fgets (line, sizeof (line), fp)) {
+        size_t len = strlen (line);
+
+        /* ignore a line cut short by an earlier crash */
+        if (len < 2 || line[len - 1] != '\n')
+            continue;
+        line[len - 1] = '\0';
+        hostlist_push_host (done, line);
+    }
+    return (0);
+}
+
+void pcp_resume_init (const char *path, List infiles, const char *dest,
+                      bool preserve, hostlist_t wcoll)
+{
+    hostlist_t done = hostlist_create (NULL);
+    char header[64];
+    FILE *fp;
+    int fd, oflags = O_WRONLY | O_CREAT | O_APPEND;
+
+    snprintf (header, sizeof (header), "%s %016llx\n", RESUME_MAGIC,
+              (unsigned long long) _copy_key (infiles, dest, preserve));
+
+    if ((fp = fopen (path, "r"))) {
+        if (_read_journal (fp, header, done) < 0)
+            oflags |= O_TRUNC;
+        fclose (fp);
+    } else 
+        oflags |= O_TRUNC;
+
+    if ((fd = open (path, oflags, 0644)) < 0)
+        errx ("%p: -o resume: %s: %m\n", path);
+    if ((oflags & O_TRUNC) && fd_write_n (fd, header, strlen (header)) < 0)
+        errx ("%p: -o resume: %s: %m\n", path);
+    fd_set_close_on_exec (fd);
+    journal_fd = fd;
+
+    hostlist_delete_list (wcoll, done);
+    hostlist_destroy (done);
+}
+
+int pcp_resume_enabled (void)
+{
+    return (journal_fd >= 0);
+}
+
+void pcp_resume_host_done (const char *host)
+{
+    size_t len = strlen (host);
+    char *line = Malloc (len + 2);
+
+    memcpy (line, host, len);
+    line[len] = '\n';
+
+    /* one write per line, so lines of different hosts don't mix */
+    pthread_mutex_lock (&resume_mutex);
+    if (fd_write_n (journal_fd, line, len + 1) < 0)
+        err ("%p: -o resume: journal write: %m\n");
+    pthread_mutex_unlock (&resume_mutex);
+
+    Free ((void **) &line);
+}
+
+void pcp_resume_fini (void)
+{
+    if (journal_fd >= 0)
+        (void) close (journal_fd);
+    journal_fd = -1;
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
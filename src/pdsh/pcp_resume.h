@@ -0,0 +1,74 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Resumable pdcp (-o resume): with -o sync, each target reports the 
+ *   size and block digests of the files it already has, so only the
+ *   blocks which are missing or differ are sent, however far an earlier
+ *   copy got. The optional journal additionally records each host which
+ *   received all files without error, so that a rerun of the same copy
+ *   does not contact it again. It is a text file of a header line
+ *
+ *     pdcp-resume <key>
+ *
+ *   where <key> is a digest of the destination and of the name, size,
+ *   mode and mtime of every source file, followed by one line per
+ *   completed host. A journal of a different copy is started over.
+ */
+
+#ifndef _PCP_RESUME_H
+#define _PCP_RESUME_H
+
+#include <stdbool.h>
+
+#include "src/common/list.h"
+#include "src/common/hostlist.h"
+
+/*
+ *  Open journal `path' for the copy of `infiles' (as returned by
+ *   pcp_expand_dirs()) to `dest', and remove the hosts it records as
+ *   completed from `wcoll'. Exits on error.
+ */
+void pcp_resume_init (const char *path, List infiles, const char *dest,
+                      bool preserve, hostlist_t wcoll);
+
+/*
+ *  Return nonzero if a journal is open.
+ */
+int pcp_resume_enabled (void);
+
+/*
+ *  Record that `host' received all files.
+ */
+void pcp_resume_host_done (const char *host);
+
+void pcp_resume_fini (void);
+
+#endif /* !_PCP_RESUME_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -69,6 +69,10 @@ char rcsid[] = "$Id$";
 # include "config.h"
 #endif
 
+#if HAVE_SPLICE || HAVE_FALLOCATE || HAVE_SYNCFS
+# define _GNU_SOURCE    /* splice(), fallocate(), syncfs(), O_DIRECT */
+#endif
+
 #include <sys/param.h>     /* roundup() */
 #if HAVE_SYS_SYSMACROS_H
 # include <sys/sysmacros.h>
@@ -77,6 +81,7 @@ char rcsid[] = "$Id$";
 #include <sys/time.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/poll.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
@@ -93,8 +98,15 @@ char rcsid[] = "$Id$";
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "src/common/err.h"
+#include "src/common/fd.h"
+#include "src/common/list.h"
+#include "src/common/xmalloc.h"
+#include "src/common/digest.h"
 #include "pcp_server.h"
 #include "opt.h"
 
@@ -102,6 +114,24 @@ char rcsid[] = "$Id$";
 #  define roundup(x, y) ((((x) + ((y) - 1)) / (y)) * (y))
 #endif
 
+/*
+ * In pipelined and archive mode, files of up to WRITE_BEHIND_MAX bytes
+ * are read into memory and written by a pool of threads (see 
+ * pcp_writer.h), which hold at most WRITE_BEHIND_LIMIT bytes of data.
+ */
+#define WRITE_BEHIND_THREADS    4
+#define WRITE_BEHIND_MAX        (1024 * 1024)
+#define WRITE_BEHIND_LIMIT      (64 * 1024 * 1024)
+
+/*
+ * With -o direct, files of at least DIRECT_MIN bytes are written with
+ * O_DIRECT, DIRECT_BUFSIZ bytes at a time from a buffer aligned to
+ * DIRECT_ALIGN bytes.
+ */
+#define DIRECT_MIN              (64 * 1024 * 1024)
+#define DIRECT_BUFSIZ           (4 * 1024 * 1024)
+#define DIRECT_ALIGN            4096
+
 /* The majority of the code below is unchanged from the original
  * rcp code.  Changes include:
  * - rcp bug fix
@@ -113,16 +143,30 @@ char rcsid[] = "$Id$";
  * - don't exit on error, just return
  */
 
-typedef struct _buf {
-    int	   cnt;
-    char  *buf;
-} BUF;
-
 static int  _verifydir(struct pcp_server *s, const char *cp);
 static int  _response(struct pcp_server *s);
-static BUF *_allocbuf(struct pcp_server *s, BUF *bp, int fd, int blksize);
 static void _error(struct pcp_server *s, const char *fmt, ...);
-static void _sink(struct pcp_server *s, char *targ, BUF *bufp);
+static void _ack(struct pcp_server *s);
+static void _write_behind_errors(struct pcp_server *s);
+static int  _discard(struct pcp_server *s, char type, off_t size);
+static int  _verify(struct pcp_server *s, uint64_t digest);
+static void _sink(struct pcp_server *s, char *targ);
+static int  _sparse_data(struct pcp_server *s, int fd, off_t size, 
+                          int *errp, struct digest *d);
+static int  _inflate_data(struct pcp_server *s, int fd, off_t size, 
+                          int *errp, struct digest *d);
+static int  _unpack(struct pcp_server *s, char *targ, int targisdir);
+static int  _sync_query(struct pcp_server *s, char *targ, int targisdir,
+                        const char *rec);
+#if HAVE_SPLICE
+static off_t _splice_data(struct pcp_server *s, int ofd, off_t size, 
+                          int *errp);
+#endif
+static int  _prealloc(struct pcp_server *s, int fd, off_t size);
+static int  _direct_data(struct pcp_server *s, int fd, off_t size, 
+                         int *errp, struct digest *d);
+static void _written(struct pcp_server *s, const char *path);
+static int  _flush(struct pcp_server *s);
 
 static int
 _verifydir(struct pcp_server *s, const char *cp)
@@ -141,9 +185,9 @@ _verifydir(struct pcp_server *s, const char *cp)
 static int
 _response(struct pcp_server *s)
 {
-    char resp;
+    int resp;
 
-    if (read(s->infd, &resp, sizeof(resp)) != sizeof(resp)) {
+    if ((resp = pcp_reader_getc(s->in)) < 0) {
         _error(s, "lost connection\n");
         return -1;
     }
@@ -160,34 +204,6 @@ _response(struct pcp_server *s)
     return 0;
 }
 
-static BUF *
-_allocbuf(struct pcp_server *s, BUF *bp, int fd, int blksize)
-{
-    struct stat stb;
-    int size;
-
-    if (fstat(fd, &stb) < 0) {
-        _error(s, "fstat: %m\n");
-        return NULL;
-    }
-
-    size = roundup(stb.st_blksize, blksize);
-    if (size == 0)
-        size = blksize;
-    if (bp->cnt < size) {
-        if (bp->buf != 0)
-            free(bp->buf);
-        bp->buf = malloc(size);
-        if (!bp->buf) {
-            _error(s, "malloc: out of memory\n");
-            bp->cnt = 0;
-            return NULL;
-        }
-    }
-    bp->cnt = size;
-    return(bp);
-}
-
 static void
 _error(struct pcp_server *s, const char *fmt, ...)
 {
@@ -196,13 +212,22 @@ _error(struct pcp_server *s, const char *fmt, ...)
     va_list ap;
     int save_errno = errno;   /* errno could be changed by fopen */
 
+    /* errors of earlier records first, as this also acks them */
+    if (s->writer)
+        _write_behind_errors(s);
+
     if (!(fp = fdopen(s->outfd, "w")))
         return;
 
     va_start(ap, fmt);
 
-    /* must put "1" at beginning of the format to indicate an error */
-    snprintf(newfmt, 1000, "%c%s", 0x01, fmt);
+    /* must put "1" at beginning of the format to indicate an error,
+     * followed by the record sequence number in pipelined mode.
+     */
+    if (s->pipeline)
+        snprintf(newfmt, 1000, "%c%lu %s", 0x01, s->seq, fmt);
+    else
+        snprintf(newfmt, 1000, "%c%s", 0x01, fmt);
     errno = save_errno;
     errf(fp, newfmt, ap);
     va_end(ap);
@@ -210,19 +235,352 @@ _error(struct pcp_server *s, const char *fmt, ...)
     fflush(fp);
 }
 
+/*
+ * Acknowledge the current record. In pipelined mode (-o pipeline) the
+ * ack is "K<seq>\n", which acknowledges all records up to and including
+ * record number <seq>, so the client need not wait for each one.
+ */
+static void
+_ack(struct pcp_server *s)
+{
+    char buf[32];
+    int len;
+
+    if (!s->pipeline) {
+        (void)write(s->outfd, "", 1);
+        return;
+    }
+    if (s->writer) {
+        s->ack_owed = true;
+        return;
+    }
+    len = snprintf(buf, sizeof(buf), "K%lu\n", s->seq);
+    (void)fd_write_n(s->outfd, buf, len);
+}
+
+/*
+ * Wait for the write-behind threads, and report their errors, each
+ * tagged with the number of the record it belongs to.
+ */
+static void
+_write_behind_errors(struct pcp_server *s)
+{
+    unsigned long seq;
+    char *msg, *buf;
+    int len;
+
+    pcp_writer_wait(s->writer);
+    while ((msg = pcp_writer_error(s->writer, &seq))) {
+        buf = Malloc(strlen(msg) + 32);
+        len = sprintf(buf, "%c%lu %s", 0x01, seq, msg);
+        (void)fd_write_n(s->outfd, buf, len);
+        Free((void **) &buf);
+        Free((void **) &msg);
+    }
+}
+
+/*
+ * In pipelined mode with write-behind threads, acks are held back until
+ * the server would block waiting for more records. Then wait for the
+ * files received so far to be written, and send the acks, so that the
+ * client never sees a record acknowledged before its file is written.
+ */
 static void
-_sink(struct pcp_server *svr, char *targ, BUF *bufp) {
+_write_behind_sync(struct pcp_server *s)
+{
+    struct pollfd pfd;
+    char buf[32];
+    int len;
+
+    if (pcp_reader_pending(s->in) > 0)
+        return;
+    pfd.fd = s->infd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) > 0)
+        return;
+
+    _write_behind_errors(s);
+    if (s->ack_owed) {
+        s->ack_owed = false;
+        len = snprintf(buf, sizeof(buf), "K%lu\n", s->seq);
+        (void)fd_write_n(s->outfd, buf, len);
+    }
+}
+
+/*
+ * Read and throw away `size' bytes of file data and the trailing NUL,
+ * compressed if the record `type' is "Z". In pipelined mode the client 
+ * sends the data of a file without waiting for the server to open it,
+ * so the data must be consumed on error.
+ */
+static int
+_discard(struct pcp_server *s, char type, off_t size)
+{
+    int errnum = 0;
+
+    if (type == 'Z' || type == 'H') {
+        if ((type == 'Z' ? _inflate_data(s, -1, size, &errnum, NULL)
+                         : _sparse_data(s, -1, size, &errnum, NULL)) < 0)
+            return -1;
+        size = 0;
+    }
+    if (pcp_reader_copy(s->in, -1, size, &errnum) < 0)
+        return -1;
+    if (s->verify && _verify(s, 0) == -2)
+        return -1;
+    return pcp_reader_copy(s->in, -1, 1, &errnum);
+}
+
+/*
+ * -o verify: read the digest line "<hex>" the client sends after the
+ * data of a file (see _verify_line() in pcp_client.c), and compare it
+ * with `digest' of the data received.
+ * Returns 0 if they match, -1 if not, -2 if the line is missing.
+ */
+static int
+_verify(struct pcp_server *s, uint64_t digest)
+{
+    char *line, *p;
+    unsigned long long sent;
+
+    if (!(line = pcp_reader_line(s->in, NULL)))
+        return -2;
+    sent = strtoull(line, &p, 16);
+    if (p == line || *p != '\0')
+        return -2;
+    return (sent == digest ? 0 : -1);
+}
+
+/*
+ * rpdcp -o dedup: make the store key of `size' bytes of data with 
+ * digest `digest' in a new file created with `mode', and with times 
+ * `tv' set if not NULL.
+ */
+static char *
+_store_key(struct pcp_server *s, char *key, uint64_t digest, off_t size,
+           int mode, struct timeval *tv)
+{
+    if (!s->preserve)
+        mode &= ~s->mask;
+    return pcp_store_key(key, digest, size, mode, tv ? &tv[1] : NULL);
+}
+
+#if HAVE_SPLICE
+/*
+ * Move up to `size' bytes of file data from the connection to `ofd' with 
+ * splice(2) through a pipe, so the data is not copied through user space.
+ * The caller must first consume any data already in the read buffer.
+ * Returns the number of bytes consumed from the connection, which is 
+ * less than `size' if splice() cannot be used with these descriptors;
+ * the caller then reads the rest. If writing to `ofd' fails, the rest
+ * of the data is still consumed, and the write errno stored in `*errp'.
+ */
+static off_t
+_splice_data(struct pcp_server *svr, int ofd, off_t size, int *errp)
+{
+    int p[2];
+    off_t done = 0;
+    bool out_splice = true;
+    char buf[BUFSIZ];
+
+    if (pipe(p) < 0)
+        return 0;
+
+    while (done < size) {
+        off_t want = size - done;
+        ssize_t n, m;
+
+        pcp_stats_wait_begin(svr->stats);
+        n = splice(svr->infd, NULL, p[1], NULL, 
+                   want > 0x100000 ? 0x100000 : want, SPLICE_F_MOVE);
+        pcp_stats_wait_end(svr->stats);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+
+        /* Empty the pipe into the file */
+        while (n > 0) {
+            if (out_splice && *errp == 0) {
+                pcp_stats_write_begin(svr->stats);
+                m = splice(p[0], NULL, ofd, NULL, n, SPLICE_F_MOVE);
+                pcp_stats_write_end(svr->stats, MAX(m, 0));
+                if (m > 0) {
+                    n -= m;
+                    continue;
+                }
+                if (m < 0 && errno == EINTR)
+                    continue;
+                if (m < 0 && errno == EINVAL) {
+                    out_splice = false;
+                    continue;
+                }
+                *errp = m < 0 ? errno : EIO;
+            }
+            if ((m = read(p[0], buf, MIN((size_t) n, sizeof(buf)))) < 0) {
+                if (errno == EINTR)
+                    continue;
+                /* can't happen: data is already in the pipe */
+                *errp = errno;
+                break;
+            }
+            if (*errp == 0) {
+                pcp_stats_write_begin(svr->stats);
+                if (write(ofd, buf, m) != m)
+                    *errp = errno ? errno : EIO;
+                pcp_stats_write_end(svr->stats, *errp ? 0 : m);
+            }
+            n -= m;
+        }
+
+        if (!out_splice || n > 0)
+            break;
+    }
+
+    close(p[0]);
+    close(p[1]);
+    return done;
+}
+#endif /* HAVE_SPLICE */
+
+/*
+ * -o prealloc: allocate all `size' bytes of a file before its data is 
+ * written, so the filesystem can lay it out in one piece. Returns ENOSPC
+ * if there is no room for it, otherwise 0: filesystems that can't 
+ * preallocate are written as usual.
+ */
+static int _prealloc(struct pcp_server *svr, int fd, off_t size)
+{
+#if HAVE_FALLOCATE
+    if (svr->prealloc && fd >= 0 && size > 0 
+        && fallocate(fd, 0, 0, size) < 0 && errno == ENOSPC)
+        return ENOSPC;
+#endif
+    return 0;
+}
+
+/*
+ * -o direct: write `size' bytes of file data from the stream to `fd', 
+ * from the start of the file, with O_DIRECT so they bypass the page
+ * cache. The data is staged in an aligned buffer, and the last partial
+ * block written with O_DIRECT cleared. Filesystems that refuse O_DIRECT
+ * are written as usual. Returns -1 if the stream ends early.
+ */
+static int _direct_data(struct pcp_server *svr, int fd, off_t size, 
+                        int *errp, struct digest *d)
+{
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    char *buf;
+    int rc = 0;
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_DIRECT) < 0)
+        return pcp_reader_copy_digest(svr->in, fd, size, errp, d);
+    if (posix_memalign((void **) &buf, DIRECT_ALIGN, DIRECT_BUFSIZ) != 0) {
+        (void) fcntl(fd, F_SETFL, flags);
+        return pcp_reader_copy_digest(svr->in, fd, size, errp, d);
+    }
+
+    while (size > 0) {
+        size_t n = MIN(size, DIRECT_BUFSIZ);
+        size_t aligned = n & ~((size_t) DIRECT_ALIGN - 1);
+
+        if (pcp_reader_read(svr->in, buf, n) < 0) {
+            rc = -1;
+            break;
+        }
+        if (d)
+            digest_update(d, buf, n);
+        size -= n;
+        if (*errp)
+            continue;
+        pcp_stats_write_begin(svr->stats);
+        if (aligned > 0 && fd_write_n(fd, buf, aligned) < 0)
+            *errp = errno;
+        else if (aligned < n && (fcntl(fd, F_SETFL, flags) < 0
+                 || fd_write_n(fd, buf + aligned, n - aligned) < 0))
+            *errp = errno;
+        pcp_stats_write_end(svr->stats, *errp ? 0 : n);
+    }
+
+    (void) fcntl(fd, F_SETFL, flags);
+    free(buf);
+    return rc;
+#else
+    return pcp_reader_copy_digest(svr->in, fd, size, errp, d);
+#endif
+}
+
+/*
+ * Note that file `path' has been written, for _flush().
+ */
+static void _written(struct pcp_server *svr, const char *path)
+{
+    svr->dirty = true;
+    if (svr->written)
+        list_append(svr->written, Strdup(path));
+}
+
+/*
+ * -o fsync, -o nocache: at the end of a transfer, write all the files to
+ * disk with one syncfs() of the target filesystem rather than an fsync()
+ * of each, then drop them from the page cache, which only works once 
+ * they are clean. Files written behind must be complete. Returns -1 if
+ * the filesystem could not be synced.
+ */
+static int _flush(struct pcp_server *svr)
+{
+    char *path;
+    int rc = 0;
+
+    if (!svr->dirty || !(svr->fsync || svr->nocache))
+        return 0;
+    svr->dirty = false;
+
+#if HAVE_SYNCFS
+    {
+        int fd = open(svr->outfile, O_RDONLY);
+
+        if (fd < 0)
+            sync();
+        else {
+            rc = syncfs(fd);
+            (void) close(fd);
+        }
+    }
+#else
+    sync();
+#endif
+
+    while (svr->written && (path = list_pop(svr->written))) {
+#if HAVE_POSIX_FADVISE
+        int fd = open(path, O_RDONLY);
+
+        if (fd >= 0) {
+            (void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            (void) close(fd);
+        }
+#endif
+        Free((void **) &path);
+    }
+    return rc;
+}
+
+static void
+_sink(struct pcp_server *svr, char *targ) {
     register char *cp;
     struct stat stb;
     struct timeval tv[2];
     enum { YES, NO, DISPLAYED } wrerr;
-    BUF *bp;
-    off_t i, j, size;
-    char ch;
+    off_t i, size;
+    size_t len;
     const char *why = "failed to set 'why' string";
-    int amt, count, exists, mask, mode;
-    int ofd, setimes, targisdir, cursize = 0;
-    char *np, *buf = NULL, *namebuf = NULL;
+    int errnum, exists, mask, mode;
+    int ofd, setimes, timed, targisdir, cursize = 0;
+    struct digest d;
+    char *np, *line, *buf = NULL, *namebuf = NULL;
 
 #define	atime	tv[0]
 #define	mtime	tv[1]
@@ -235,32 +593,35 @@ _sink(struct pcp_server *svr, char *targ, BUF *bufp) {
 
     setimes = targisdir = 0;
     mask = umask(0);
-    if (!svr->preserve)
+    if (!svr->preserve) {
         (void)umask(mask);
+        svr->mask = mask;
+    }
 
     if (svr->target_is_dir) {
         if (_verifydir(svr, svr->outfile) < 0)
             return;
     }
 
-    (void)write(svr->outfd, "", 1);
+    _ack(svr);
     if (stat(targ, &stb) == 0 && (stb.st_mode & S_IFMT) == S_IFDIR)
         targisdir = 1;
 
     while (1) {
-		int rc;
-        cp = buf;
-        if ((rc = read(svr->infd, cp, 1)) <= 0)
-            goto end_server;
-        if (*cp++ == '\n')
-            SCREWUP("unexpected <newline>");
+        if (svr->writer)
+            _write_behind_sync(svr);
 
-        do {
-            if (read(svr->infd, &ch, sizeof(ch)) != sizeof(ch))
+        /* records are parsed out of the read buffer, not read bytewise */
+        if (!(line = pcp_reader_line(svr->in, &len))) {
+            if (pcp_reader_pending(svr->in) > 0)
                 SCREWUP("lost connection");
-            *cp++ = ch;
-        } while (cp < &buf[BUFSIZ - 1] && ch != '\n');
-        *cp = 0;
+            goto end_server;
+        }
+        if (len == 0)
+            SCREWUP("unexpected <newline>");
+        if (len >= BUFSIZ)
+            SCREWUP("control record too long");
+        memcpy(buf, line, len + 1);
 
         if (buf[0] == '\01' || buf[0] == '\02') {
             if (buf[0] == '\02')
@@ -268,13 +629,22 @@ _sink(struct pcp_server *svr, char *targ, BUF *bufp) {
             continue;
         }
 
+        svr->seq++;
         if (buf[0] == 'E') {
-            (void)write(svr->outfd, "", 1);
+            _ack(svr);
             goto end_server;
         }
 
-        if (ch == '\n')
-            *--cp = 0;
+        if (buf[0] == 'A' && buf[1] == '\0') {
+            if (_unpack(svr, targ, targisdir) < 0)
+                goto end_server;
+            continue;
+        }
+        if (buf[0] == 'S') {
+            if (_sync_query(svr, targ, targisdir, buf) < 0)
+                goto end_server;
+            continue;
+        }
 
 #define getnum(t) (t) = 0; while (isdigit(*cp)) (t) = (t) * 10 + (*cp++ - '0');
         cp = buf;
@@ -293,11 +663,15 @@ _sink(struct pcp_server *svr, char *targ, BUF *bufp) {
             getnum(atime.tv_usec);
             if (*cp++ != '\0')
                 SCREWUP("atime.usec not delimited");
-            (void)write(svr->outfd, "", 1);
+            _ack(svr);
             continue;
         }
-        if (*cp != 'C' && *cp != 'D')
+        if (*cp != 'C' && *cp != 'D' && *cp != 'Z' && *cp != 'H')
             SCREWUP("expected control record");
+#if !HAVE_ZLIB
+        if (*cp == 'Z')
+            SCREWUP("compressed data not supported");
+#endif
 
         mode = 0;
         for (++cp; cp < buf + 5; cp++) {
@@ -351,6 +725,60 @@ _sink(struct pcp_server *svr, char *targ, BUF *bufp) {
         else
             np = targ;
 
+        if (svr->writer && buf[0] == 'C' && size <= WRITE_BEHIND_MAX) {
+            struct pcp_write *req = pcp_write_create(np, size);
+            uint64_t digest = 0;
+
+            if (pcp_reader_read(svr->in, req->data, size) < 0) {
+                pcp_write_destroy(req);
+                _error(svr, "lost connection\n");
+                goto end_server;
+            }
+            if (svr->store || svr->verify)
+                digest = digest_buf(req->data, size);
+            if (svr->verify && (errnum = _verify(svr, digest)) < 0) {
+                pcp_write_destroy(req);
+                if (errnum == -2)
+                    SCREWUP("bad digest");
+                if (_response(svr) < 0)
+                    goto end_server;
+                _error(svr, "%s: checksum mismatch\n", np);
+                setimes = 0;
+                continue;
+            }
+            req->oflags = O_WRONLY|O_CREAT;
+            req->mode = mode;
+            req->chmod = svr->preserve;
+            req->setimes = setimes;
+            memcpy(req->tv, tv, sizeof(tv));
+            req->seq = svr->seq;
+            if (svr->store) {
+                _store_key(svr, req->key, digest, size, mode, 
+                           setimes ? tv : NULL);
+                /* identical to a file already stored: no need to write */
+                if (pcp_store_link(svr->store, req->key, np, 
+                                   req->data, size) == 0) {
+                    pcp_write_destroy(req);
+                    req = NULL;
+                } else {
+                    pcp_store_remove(np);
+                    req->store = svr->store;
+                }
+            }
+            if (req)
+                pcp_writer_queue(svr->writer, req);
+            _written(svr, np);
+            pcp_stats_bytes(svr->stats, size);
+            pcp_stats_file(svr->stats);
+            setimes = 0;
+            if (_response(svr) < 0)
+                goto end_server;
+            _ack(svr);
+            continue;
+        }
+
+        if (svr->store && buf[0] != 'D')
+            pcp_store_remove(np);
         exists = stat(np, &stb) == 0;
         if (buf[0] == 'D') {
             if (exists) {
@@ -364,10 +792,13 @@ _sink(struct pcp_server *svr, char *targ, BUF *bufp) {
                 goto bad;
 
             /* recursively go down a directory */
-            _sink(svr, np, bufp);
+            _sink(svr, np);
 
             if (setimes) {
                 setimes = 0;
+                /* files created in it change its times */
+                if (svr->writer)
+                    pcp_writer_wait(svr->writer);
                 if (utimes(np, tv) < 0)
                     _error(svr, "can't set times on %s: %m\n", np);
             }
@@ -376,50 +807,86 @@ _sink(struct pcp_server *svr, char *targ, BUF *bufp) {
 
         if ((ofd = open(np, O_WRONLY|O_CREAT, mode)) < 0) {
 bad:	     
+            if (svr->pipeline && buf[0] != 'D') {
+                int save_errno = errno;
+                if (_discard(svr, buf[0], size) < 0)
+                    goto end_server;
+                errno = save_errno;
+            }
             _error(svr, "%s: %m\n", np);
             continue;
         }
         if (exists && svr->preserve)
             (void)fchmod(ofd, mode);
 
-        (void)write(svr->outfd, "", 1);
-        if ((bp = _allocbuf(svr, bufp, ofd, BUFSIZ)) == NULL) {
-            (void)close(ofd);
-            continue;
+        if (!svr->pipeline)
+            _ack(svr);
+        /* sparse files keep their holes */
+        errnum = buf[0] != 'H' ? _prealloc(svr, ofd, size) : 0;
+        digest_init(&d);
+        if (buf[0] == 'H') {
+            /* old data must not show through the holes */
+            if (ftruncate(ofd, 0) < 0)
+                errnum = errno;
+            if (_sparse_data(svr, ofd, size, &errnum, &d) < 0) {
+                (void)close(ofd);
+                SCREWUP("bad sparse data");
+            }
+        } else if (buf[0] == 'Z') {
+            if (_inflate_data(svr, ofd, size, &errnum, &d) < 0) {
+                (void)close(ofd);
+                SCREWUP("bad compressed data");
+            }
+        } else if (svr->direct && size >= DIRECT_MIN) {
+            if (_direct_data(svr, ofd, size, &errnum, &d) < 0) {
+                _error(svr, "lost connection\n");
+                (void)close(ofd);
+                goto end_server;
+            }
+        } else {
+            /* data already buffered with the record, then the rest */
+            i = MIN(size, (off_t) pcp_reader_pending(svr->in));
+            (void)pcp_reader_copy_digest(svr->in, ofd, i, &errnum, &d);
+#if HAVE_SPLICE
+            /* data spliced to the file can't be hashed */
+            if (errnum == 0 && !svr->store && !svr->verify)
+                i += _splice_data(svr, ofd, size - i, &errnum);
+#endif
+            if (pcp_reader_copy_digest(svr->in, ofd, size - i, &errnum, 
+                                       &d) < 0) {
+                _error(svr, "lost connection\n");
+                (void)close(ofd);
+                goto end_server;
+            }
         }
-        cp = bp->buf;
-        count = 0;
         wrerr = NO;
-        for (i = 0; i < size; i += BUFSIZ) {
-            amt = BUFSIZ;
-            if (i + amt > size)
-                amt = size - i;
-            count += amt;
-            do {
-                j = read(svr->infd, cp, amt);
-                if (j <= 0) {
-                    _error(svr, "%m\n");
-                    goto end_server;
+        if (errnum) {
+            errno = errnum;
+            wrerr = YES;
+        }
+        if (svr->verify) {
+            int save_errno = errno;
+            switch (_verify(svr, digest_final(&d))) {
+            case -2:
+                (void)close(ofd);
+                SCREWUP("bad digest");
+            case -1:
+                if (wrerr == NO) {
+                    _error(svr, "%s: checksum mismatch\n", np);
+                    wrerr = DISPLAYED;
                 }
-                amt -= j;
-                cp += j;
-            } while (amt > 0);
-            if (count == bp->cnt) {
-                if (wrerr == NO && write(ofd, bp->buf, count) != count)
-                    wrerr = YES;
-                count = 0;
-                cp = bp->buf;
             }
+            errno = save_errno;
         }
-        if (count != 0 && wrerr == NO && write(ofd, bp->buf, count) != count)
-            wrerr = YES;
         if (ftruncate(ofd, size)) {
             _error(svr, "can't truncate %s: %m\n", np);
             wrerr = DISPLAYED;
         }
         (void)close(ofd);
+        _written(svr, np);
         if (_response(svr) < 0)
             goto end_server;
+        timed = setimes && wrerr == NO;
         if (setimes && wrerr == NO) {
             setimes = 0;
             if (utimes(np, tv) < 0) {
@@ -427,12 +894,23 @@ bad:
                 wrerr = DISPLAYED;
             }
         }
+        if (svr->store && wrerr == NO) {
+            char key[PCP_STORE_KEYLEN];
+
+            _store_key(svr, key, digest_final(&d), size, mode, 
+                       timed ? tv : NULL);
+            if (pcp_store_add(svr->store, key, np) < 0) {
+                _error(svr, "can't deduplicate %s: %m\n", np);
+                wrerr = DISPLAYED;
+            }
+        }
         switch(wrerr) {
             case YES:
                 _error(svr, "%s: %m\n", np);
                 break;
             case NO:
-                (void)write(svr->outfd, "", 1);
+                pcp_stats_file(svr->stats);
+                _ack(svr);
                 break;
             case DISPLAYED:
                 break;
@@ -450,15 +928,889 @@ end_server:
     return;
 }
 
+/*
+ * Archive stream mode (-o archive). After an "A" record the client sends
+ * the whole tree as one stream of records without waiting for any
+ * responses (see _pcp_send_archive() in pcp_client.c):
+ *
+ *   T<mtime> 0 <atime> 0    times for the next record (with -p)
+ *   D<mode> 0 <path>        directory
+ *   C<mode> <size> <path>   file, followed by <size> bytes of data
+ *   P<mode> <size> <bsize> <n> <path>
+ *                           changes to an existing file (-o sync): 
+ *                           <n> times "<block>\n" followed by the data
+ *                           of that block of <bsize> bytes, or
+ *                           "<block> -\n" for a block which is a hole
+ *                           in the source, or "<block> s\n" followed by
+ *                           the data segments of the block as for an
+ *                           "H" record (-o sparse)
+ *   Z<mode> <size> <path>   file, followed by compressed data
+ *                           (-o compress, see _inflate_data())
+ *   H<mode> <size> <path>   sparse file, followed by its data segments
+ *                           (-o sparse, see _sparse_data())
+ *   E                       end of archive
+ *
+ * <path> is relative to the target, with the first component naming the
+ * target itself if it is not a directory. The stream is read through a
+ * large buffer, so that headers and the data of small files cost no
+ * extra system calls. Errors are collected and sent after the "E"
+ * record, followed by a final ack.
+ */
+#define ARCHIVE_BUFSIZ      (256 * 1024)
+#define ARCHIVE_MAX_ERRORS  100
+
+struct archive {
+    struct pcp_server *svr;
+    List errors;                /* error messages to send at the end */
+    int nerrors;
+    List dirtimes;              /* directories that need times set */
+    pcp_writer_t writer;        /* write-behind threads */
+};
+
+struct dirtime {
+    struct timeval tv[2];
+    char path[];
+};
+
+static void _archive_free(void *x)
+{
+    Free(&x);
+}
+
+static struct archive *_archive_create(struct pcp_server *svr)
+{
+    struct archive *a = Malloc(sizeof(*a));
+
+    a->svr = svr;
+    a->errors = list_create(_archive_free);
+    a->dirtimes = list_create(_archive_free);
+    a->writer = pcp_writer_create(WRITE_BEHIND_THREADS, WRITE_BEHIND_LIMIT);
+    return a;
+}
+
+static void _archive_destroy(struct archive *a)
+{
+    pcp_writer_destroy(a->writer);
+    list_destroy(a->errors);
+    list_destroy(a->dirtimes);
+    Free((void **) &a);
+}
+
+/*
+ * Record an error message "<prefix><path>: <strerror(errno)>".
+ */
+static void _archive_error(struct archive *a, const char *prefix, 
+                           const char *path)
+{
+    char *msg;
+
+    if (a->nerrors++ >= ARCHIVE_MAX_ERRORS)
+        return;
+    msg = Malloc(strlen(prefix) + strlen(path) + 256);
+    sprintf(msg, "%s%s: %.200s\n", prefix, path, strerror(errno));
+    list_append(a->errors, msg);
+}
+
+/*
+ * Return the local name of archive `path' below `targ'. Without a target
+ * directory, the top of the tree is renamed to `targ'. 
+ */
+static char *_archive_target(const char *targ, int targisdir, 
+                             const char *path)
+{
+    const char *rest = targisdir ? path : strchr(path, '/');
+    char *name = Malloc(strlen(targ) + strlen(path) + 2);
+
+    sprintf(name, "%s%s%s", targ, targisdir ? "/" : "", rest ? rest : "");
+    return name;
+}
+
+/*
+ * -o verify: report that the data received for `path' does not match
+ * the digest sent with it.
+ */
+static void _archive_mismatch(struct archive *a, const char *path)
+{
+    char *msg;
+
+    if (a->nerrors++ >= ARCHIVE_MAX_ERRORS)
+        return;
+    msg = Malloc(strlen(path) + 64);
+    sprintf(msg, "%s: checksum mismatch\n", path);
+    list_append(a->errors, msg);
+}
+
+/*
+ * Return the next record from the stream, without its newline.
+ */
+static char *_archive_line(struct archive *a)
+{
+    return pcp_reader_line(a->svr->in, NULL);
+}
+
+/*
+ * Write `size' bytes of file data from the stream to `fd', or discard
+ * them if fd < 0, adding them to digest `d'. A write error is recorded
+ * and the rest of the data discarded. Returns -1 if the stream ends 
+ * early.
+ */
+static int _archive_data(struct archive *a, int fd, off_t size, char *path,
+                         struct digest *d)
+{
+    int errnum = 0;
+    int rc;
+
+    if (fd >= 0 && a->svr->direct && size >= DIRECT_MIN)
+        rc = _direct_data(a->svr, fd, size, &errnum, d);
+    else
+        rc = pcp_reader_copy_digest(a->svr->in, fd, size, &errnum, d);
+    if (rc < 0)
+        return -1;
+    if (errnum) {
+        errno = errnum;
+        _archive_error(a, "", path);
+    }
+    return 0;
+}
+
+/*
+ * Make the `len' bytes at `off' of the file open on `fd' read as zeros,
+ * deallocating them if the filesystem can.
+ */
+static int _punch_hole(int fd, off_t off, off_t len)
+{
+    static const char zeros[BUFSIZ];
+
+#if HAVE_FALLOCATE && defined(FALLOC_FL_PUNCH_HOLE)
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len) 
+        == 0)
+        return 0;
+#endif
+    if (lseek(fd, off, SEEK_SET) < 0)
+        return -1;
+    while (len > 0) {
+        size_t n = MIN(len, (off_t) sizeof(zeros));
+        if (fd_write_n(fd, (void *) zeros, n) < 0)
+            return -1;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Write the data segments of the `len' bytes at `start' of a file, sent
+ * after a "<block> s" line in the same form as those of an "H" record,
+ * to `*fdp' (or discard them if it is < 0), and make the rest of the
+ * block a hole. On a write error, `*fdp' is set to -1.
+ * Returns -1 if the stream ends early or a segment is out of range.
+ */
+static int _patch_segments(struct archive *a, int *fdp, off_t start, 
+                           off_t len, char *path)
+{
+    off_t end = start;
+
+    for (;;) {
+        char *line = _archive_line(a), *p;
+        long long off, n;
+
+        if (!line)
+            return -1;
+        off = strtoll(line, &p, 10);
+        if (*p++ != ' ')
+            return -1;
+        n = strtoll(p, &p, 10);
+        if (*p != '\0' || n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        if (off < end || off > start + len - n)
+            return -1;
+
+        if (*fdp >= 0 && ((off > end && _punch_hole(*fdp, end, off - end) < 0)
+                          || lseek(*fdp, off, SEEK_SET) < 0)) {
+            _archive_error(a, "", path);
+            *fdp = -1;
+        }
+        if (_archive_data(a, *fdp, n, path, NULL) < 0)
+            return -1;
+        end = off + n;
+    }
+    if (*fdp >= 0 && end < start + len 
+        && _punch_hole(*fdp, end, start + len - end) < 0) {
+        _archive_error(a, "", path);
+        *fdp = -1;
+    }
+    return 0;
+}
+
+/*
+ * Write `nblocks' changed blocks of `bsize' bytes from the stream into
+ * the file of `size' bytes open on `fd' (or discard them if fd < 0).
+ * Returns -1 if the stream ends early or a block is out of range.
+ */
+static int _patch(struct archive *a, int fd, off_t size, off_t bsize, 
+                  long nblocks, char *path)
+{
+    while (nblocks-- > 0) {
+        char *line = _archive_line(a), *p;
+        off_t off, len;
+        bool hole, segs;
+
+        if (!line)
+            return -1;
+        off = strtol(line, &p, 10) * bsize;
+        hole = (strcmp(p, " -") == 0);
+        segs = (strcmp(p, " s") == 0);
+        if ((*p != '\0' && !hole && !segs) || off < 0 || off >= size)
+            return -1;
+        len = size - off < bsize ? size - off : bsize;
+        if (segs) {
+            if (_patch_segments(a, &fd, off, len, path) < 0)
+                return -1;
+            continue;
+        }
+        if (hole) {
+            if (fd >= 0 && _punch_hole(fd, off, len) < 0) {
+                _archive_error(a, "", path);
+                fd = -1;
+            }
+            continue;
+        }
+        if (fd >= 0 && lseek(fd, off, SEEK_SET) < 0) {
+            _archive_error(a, "", path);
+            fd = -1;
+        }
+        if (_archive_data(a, fd, len, path, NULL) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+ * Compressed file data (-o compress). A "Z" record has the same fields
+ * as a "C" record, but its <size> bytes of file data are sent as frames
+ * of at most ZFRAME_MAX bytes each:
+ *
+ *   <len> <zlen>            followed by <zlen> bytes of zlib data which
+ *                           inflate to <len> bytes, or by <len> bytes of
+ *                           plain data if <zlen> is 0
+ *
+ * Outside of an archive stream the NUL byte after the last frame is left
+ * to the caller.
+ */
+#define ZFRAME_MAX  (16 * 1024 * 1024)
+
+#if HAVE_ZLIB
+static int _zheader(struct pcp_server *svr, unsigned long *lenp, 
+                    unsigned long *zlenp)
+{
+    char *line, *p;
+
+    if (!(line = pcp_reader_line(svr->in, NULL)))
+        return -1;
+    *lenp = strtoul(line, &p, 10);
+    if (*p++ != ' ')
+        return -1;
+    *zlenp = strtoul(p, &p, 10);
+    return (*p == '\0' ? 0 : -1);
+}
+
+/*
+ * Inflate `size' bytes of file data sent after a "Z" record, and write
+ * it to `fd' (or discard it if fd < 0), adding it to digest `d' if not
+ * NULL. A write error stops writing and is stored in `*errp', but the 
+ * rest of the data is still consumed. 
+ * Returns -1 if the stream ends early or the data is corrupt.
+ */
+static int _inflate_data(struct pcp_server *svr, int fd, off_t size, 
+                         int *errp, struct digest *d)
+{
+    char *zbuf = NULL, *out = NULL;
+    size_t zcap = 0, cap = 0;
+    int rc = -1;
+
+    while (size > 0) {
+        unsigned long len, zlen;
+        uLongf n;
+
+        if (_zheader(svr, &len, &zlen) < 0 || len == 0 
+            || len > ZFRAME_MAX || (off_t) len > size 
+            || zlen > compressBound(len))
+            goto done;
+
+        if (len > cap) {
+            cap = len;
+            if (out)
+                Realloc((void **) &out, cap);
+            else
+                out = Malloc(cap);
+        }
+        if (zlen == 0) {
+            if (pcp_reader_read(svr->in, out, len) < 0)
+                goto done;
+        } else {
+            if (zlen > zcap) {
+                zcap = zlen;
+                if (zbuf)
+                    Realloc((void **) &zbuf, zcap);
+                else
+                    zbuf = Malloc(zcap);
+            }
+            if (pcp_reader_read(svr->in, zbuf, zlen) < 0)
+                goto done;
+            n = len;
+            if (uncompress((Bytef *) out, &n, (Bytef *) zbuf, zlen) != Z_OK
+                || n != len)
+                goto done;
+        }
+
+        if (fd >= 0 && *errp == 0) {
+            pcp_stats_write_begin(svr->stats);
+            if (fd_write_n(fd, out, len) < 0)
+                *errp = errno;
+            pcp_stats_write_end(svr->stats, *errp ? 0 : len);
+        }
+        if (d)
+            digest_update(d, out, len);
+        size -= len;
+    }
+    rc = 0;
+done:
+    if (zbuf)
+        Free((void **) &zbuf);
+    if (out)
+        Free((void **) &out);
+    return rc;
+}
+#else
+static int _inflate_data(struct pcp_server *svr, int fd, off_t size, 
+                         int *errp, struct digest *d)
+{
+    return -1;
+}
+#endif /* HAVE_ZLIB */
+
+/*
+ * Sparse file data (-o sparse). An "H" record has the same fields as a
+ * "C" record, but only the data segments of the file are sent, in
+ * increasing order, each as
+ *
+ *   <offset> <length>       followed by <length> bytes of data
+ *
+ * and "0 0" ends the file. The rest of the file is holes: the segments 
+ * are written at their offsets into a file truncated to zero, and the
+ * caller truncates it to <size>. Outside of an archive stream the NUL 
+ * byte after the last segment is left to the caller.
+ */
+
+/*
+ * Write the segments of an "H" record to `fd' (or discard them if 
+ * fd < 0), adding the whole file, holes included, to digest `d' if not
+ * NULL. A write error stops writing and is stored in `*errp', but the 
+ * rest of the data is still consumed. 
+ * Returns -1 if the stream ends early or a segment is out of range.
+ */
+static int _sparse_data(struct pcp_server *svr, int fd, off_t size, 
+                        int *errp, struct digest *d)
+{
+    off_t end = 0;
+
+    for (;;) {
+        char *line = pcp_reader_line(svr->in, NULL), *p;
+        long long off, len;
+
+        if (!line)
+            return -1;
+        off = strtoll(line, &p, 10);
+        if (*p++ != ' ')
+            return -1;
+        len = strtoll(p, &p, 10);
+        if (*p != '\0' || len < 0)
+            return -1;
+        if (len == 0)
+            break;
+        if (off < end || off > size - len)
+            return -1;
+
+        if (d)
+            digest_zeros(d, off - end);
+        if (fd >= 0 && *errp == 0 && lseek(fd, off, SEEK_SET) < 0)
+            *errp = errno;
+        if (pcp_reader_copy_digest(svr->in, fd, len, errp, d) < 0)
+            return -1;
+        end = off + len;
+    }
+    if (d)
+        digest_zeros(d, size - end);
+    return 0;
+}
+
+/*
+ * Check that an archive path names something below the target.
+ */
+static bool _archive_path_ok(const char *path)
+{
+    const char *p = path;
+
+    if (*p == '\0' || *p == '/')
+        return false;
+    while (p) {
+        if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0'))
+            return false;
+        if ((p = strchr(p, '/')))
+            p++;
+    }
+    return true;
+}
+
+/*
+ * Read an archive stream into `targ'. Returns -1 if the stream was
+ * broken off or did not follow the protocol, after reporting this.
+ */
+static int _unpack(struct pcp_server *svr, char *targ, int targisdir)
+{
+    struct archive *a = _archive_create(svr);
+    struct timeval tv[2];
+    bool setimes = false;
+    char *line, *path = NULL, *msg;
+    const char *why = NULL;
+    ListIterator i;
+    struct dirtime *d;
+    unsigned long seq;
+    int rc = -1;
+
+    _ack(svr);
+
+    while ((line = _archive_line(a))) {
+        char *cp = line;
+        struct stat stb;
+        int mode = 0, fd;
+        off_t size = 0, bsize = 0;
+        long nblocks = 0;
+        bool exists;
+        struct digest dg;
+        int nerrors;
+
+        if (*cp == 'E')
+            break;
+
+        if (*cp == 'T') {
+            cp++;
+            tv[1].tv_sec = strtol(cp, &cp, 10);
+            tv[1].tv_usec = strtol(cp, &cp, 10);
+            tv[0].tv_sec = strtol(cp, &cp, 10);
+            tv[0].tv_usec = strtol(cp, &cp, 10);
+            if (*cp != '\0') {
+                why = "bad time record";
+                goto screwup;
+            }
+            setimes = true;
+            continue;
+        }
+        if (*cp != 'C' && *cp != 'D' && *cp != 'P' && *cp != 'Z' 
+            && *cp != 'H') {
+            why = "expected control record";
+            goto screwup;
+        }
+        for (cp++; cp < line + 5; cp++) {
+            if (*cp < '0' || *cp > '7') {
+                why = "bad mode";
+                goto screwup;
+            }
+            mode = (mode << 3) | (*cp - '0');
+        }
+        if (*cp++ != ' ') {
+            why = "mode not delimited";
+            goto screwup;
+        }
+        while (isdigit(*cp))
+            size = size * 10 + (*cp++ - '0');
+        if (*line == 'P') {
+            bsize = strtol(cp, &cp, 10);
+            nblocks = strtol(cp, &cp, 10);
+            if (bsize <= 0 || nblocks < 0) {
+                why = "bad block record";
+                goto screwup;
+            }
+        }
+        if (*cp++ != ' ' || !_archive_path_ok(cp)) {
+            why = "bad path";
+            goto screwup;
+        }
+
+        path = _archive_target(targ, targisdir, cp);
+
+        if (*line == 'C' && size <= WRITE_BEHIND_MAX) {
+            struct pcp_write *req = pcp_write_create(path, size);
+            uint64_t digest = 0;
+            int vrc = 0;
+
+            if (pcp_reader_read(svr->in, req->data, size) < 0) {
+                pcp_write_destroy(req);
+                line = NULL;
+                break;
+            }
+            if (svr->store || svr->verify)
+                digest = digest_buf(req->data, size);
+            if (svr->verify && (vrc = _verify(svr, digest)) < 0) {
+                pcp_write_destroy(req);
+                if (vrc == -2) {
+                    why = "bad digest";
+                    goto screwup;
+                }
+                _archive_mismatch(a, path);
+                setimes = false;
+                Free((void **) &path);
+                continue;
+            }
+            req->oflags = O_WRONLY|O_CREAT|O_TRUNC;
+            req->mode = mode;
+            req->chmod = svr->preserve;
+            req->setimes = setimes;
+            memcpy(req->tv, tv, sizeof(tv));
+            if (svr->store) {
+                _store_key(svr, req->key, digest, size, mode, 
+                           setimes ? tv : NULL);
+                if (pcp_store_link(svr->store, req->key, path, 
+                                   req->data, size) == 0) {
+                    pcp_write_destroy(req);
+                    req = NULL;
+                } else {
+                    pcp_store_remove(path);
+                    req->store = svr->store;
+                }
+            }
+            if (req)
+                pcp_writer_queue(a->writer, req);
+            _written(svr, path);
+            pcp_stats_bytes(svr->stats, size);
+            pcp_stats_file(svr->stats);
+            setimes = false;
+            Free((void **) &path);
+            continue;
+        }
+
+        if (svr->store && *line == 'P') {
+            /* the file may share its data with other hosts' files */
+            why = "block records not supported with dedup";
+            goto screwup;
+        }
+        if (svr->store && *line != 'D')
+            pcp_store_remove(path);
+        exists = stat(path, &stb) == 0;
+        if (*line == 'D') {
+            if (exists && !S_ISDIR(stb.st_mode)) {
+                errno = ENOTDIR;
+                _archive_error(a, "", path);
+            } else if (!exists && mkdir(path, mode) < 0 && errno != EEXIST)
+                _archive_error(a, "", path);    /* EEXIST: -o streams */
+            else {
+                if (exists && svr->preserve)
+                    (void)chmod(path, mode);
+                if (setimes) {
+                    d = Malloc(sizeof(*d) + strlen(path) + 1);
+                    memcpy(d->tv, tv, sizeof(tv));
+                    strcpy(d->path, path);
+                    list_prepend(a->dirtimes, d);
+                }
+            }
+        } else if (*line == 'P') {
+            if ((fd = open(path, O_WRONLY|O_CREAT, mode)) < 0)
+                _archive_error(a, "", path);
+            else if (exists && svr->preserve)
+                (void)fchmod(fd, mode);
+            if (_patch(a, fd, size, bsize, nblocks, path) < 0) {
+                if (fd >= 0)
+                    close(fd);
+                why = "bad block record";
+                goto screwup;
+            }
+            if (fd >= 0 && ftruncate(fd, size) < 0)
+                _archive_error(a, "can't truncate ", path);
+            if (fd >= 0 && close(fd) < 0)
+                _archive_error(a, "", path);
+            else if (fd >= 0 && setimes && utimes(path, tv) < 0)
+                _archive_error(a, "can't set times on ", path);
+            if (fd >= 0)
+                _written(svr, path);
+        } else {
+            if ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, mode)) < 0)
+                _archive_error(a, "", path);
+            else if (exists && svr->preserve)
+                (void)fchmod(fd, mode);
+            if (*line != 'H' && (errno = _prealloc(svr, fd, size))) {
+                /* no room: the data is discarded */
+                _archive_error(a, "", path);
+                close(fd);
+                fd = -1;
+            }
+            digest_init(&dg);
+            nerrors = a->nerrors;
+            if (*line == 'Z') {
+                int errnum = 0;
+                if (_inflate_data(svr, fd, size, &errnum, &dg) < 0) {
+                    if (fd >= 0)
+                        close(fd);
+                    why = "bad compressed data";
+                    goto screwup;
+                }
+                if (errnum) {
+                    errno = errnum;
+                    _archive_error(a, "", path);
+                }
+            } else if (*line == 'H') {
+                int errnum = 0;
+                if (_sparse_data(svr, fd, size, &errnum, &dg) < 0) {
+                    if (fd >= 0)
+                        close(fd);
+                    why = "bad sparse data";
+                    goto screwup;
+                }
+                if (errnum) {
+                    errno = errnum;
+                    _archive_error(a, "", path);
+                } else if (fd >= 0 && ftruncate(fd, size) < 0)
+                    _archive_error(a, "can't truncate ", path);
+            } else if (_archive_data(a, fd, size, path, &dg) < 0) {
+                if (fd >= 0)
+                    close(fd);
+                line = NULL;
+                break;
+            }
+            if (svr->verify) {
+                int vrc = _verify(svr, digest_final(&dg));
+
+                if (vrc == -2) {
+                    if (fd >= 0)
+                        close(fd);
+                    why = "bad digest";
+                    goto screwup;
+                }
+                if (vrc == -1 && a->nerrors == nerrors)
+                    _archive_mismatch(a, path);
+            }
+            if (fd >= 0 && close(fd) < 0)
+                _archive_error(a, "", path);
+            else if (fd >= 0 && setimes && utimes(path, tv) < 0)
+                _archive_error(a, "can't set times on ", path);
+            else if (fd >= 0 && svr->store && a->nerrors == nerrors) {
+                char key[PCP_STORE_KEYLEN];
+
+                _store_key(svr, key, digest_final(&dg), size, mode, 
+                           setimes ? tv : NULL);
+                if (pcp_store_add(svr->store, key, path) < 0)
+                    _archive_error(a, "can't deduplicate ", path);
+            }
+            if (fd >= 0)
+                _written(svr, path);
+            if (a->nerrors == nerrors)
+                pcp_stats_file(svr->stats);
+        }
+        setimes = false;
+        Free((void **) &path);
+    }
+
+    /* errors from files still being written */
+    pcp_writer_wait(a->writer);
+    while ((msg = pcp_writer_error(a->writer, &seq))) {
+        if (a->nerrors++ < ARCHIVE_MAX_ERRORS)
+            list_append(a->errors, msg);
+        else
+            Free((void **) &msg);
+    }
+
+    if (line == NULL || *line != 'E') {
+        why = "lost connection";
+        goto screwup;
+    }
+
+    /* Set directory times last, children before their parents */
+    i = list_iterator_create(a->dirtimes);
+    while ((d = list_next(i))) {
+        if (utimes(d->path, d->tv) < 0)
+            _archive_error(a, "can't set times on ", d->path);
+    }
+    list_iterator_destroy(i);
+
+    if (_flush(svr) < 0)
+        _archive_error(a, "can't sync ", targ);
+
+    i = list_iterator_create(a->errors);
+    while ((msg = list_next(i)))
+        _error(svr, "%s", msg);
+    list_iterator_destroy(i);
+    if (a->nerrors > ARCHIVE_MAX_ERRORS)
+        _error(svr, "%d more errors\n", a->nerrors - ARCHIVE_MAX_ERRORS);
+    _ack(svr);
+    rc = 0;
+
+screwup:
+    if (why)
+        _error(svr, "protocol screwup: %s\n", why);
+    if (path)
+        Free((void **) &path);
+    _archive_destroy(a);
+    return rc;
+}
+
+/*
+ * Sync query (-o sync), sent by the client before an archive stream:
+ *
+ *   S<bsize>                    followed by one line per regular file
+ *   <size> <path>               the client's size of <path>
+ *   (empty line)                end of query
+ *
+ * All lines are read before any reply is sent, so that neither side can
+ * block on a full connection. The reply is one line per file:
+ *
+ *   -                           <path> is not a regular file here
+ *   <size> <mtime> -            differs, not worth hashing
+ *   <size> <mtime> <h>[,<h>..]  hex XXH64 digests of each <bsize> bytes
+ *
+ * Hashes are computed only when the sizes match or the file has more
+ * than one block, so the client can send only the changed blocks. The
+ * mtime alone is not trusted to mean that a file is unchanged, since it
+ * has a resolution of one second.
+ */
+#define SYNC_MAX_BLOCK  (64 * 1024 * 1024)
+
+struct reply {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static void _reply_append(struct reply *r, const char *str)
+{
+    size_t n = strlen(str);
+
+    if (r->len + n > r->size) {
+        r->size = (r->len + n) * 2 + 4096;
+        if (r->buf)
+            Realloc((void **) &r->buf, r->size);
+        else
+            r->buf = Malloc(r->size);
+    }
+    memcpy(r->buf + r->len, str, n);
+    r->len += n;
+}
+
+static void _sync_hashes(int fd, off_t size, off_t bsize, char *blockbuf, 
+                         struct reply *reply)
+{
+    char hex[32];
+    off_t off;
+
+    for (off = 0; off < size || off == 0; off += bsize) {
+        ssize_t n, len = size - off < bsize ? size - off : bsize;
+        ssize_t got = 0;
+
+        while (got < len && (n = read(fd, blockbuf + got, len - got)) != 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                break;
+            got += n;
+        }
+        if (got < len) {        /* file changed: hash can't match */
+            _reply_append(reply, off ? ",0" : "0");
+            return;
+        }
+        snprintf(hex, sizeof(hex), "%s%llx", off ? "," : "", 
+                 (unsigned long long) digest_buf(blockbuf, len));
+        _reply_append(reply, hex);
+    }
+}
+
+static int _sync_query(struct pcp_server *svr, char *targ, int targisdir,
+                       const char *rec)
+{
+    struct reply reply = { NULL, 0, 0 };
+    char *blockbuf = NULL, *line, *cp, *path;
+    List queries = list_create(_archive_free);
+    ListIterator i;
+    long bsize = strtol(rec + 1, &cp, 10);
+    int rc = -1;
+
+    if (*cp != '\0' || bsize < 4096 || bsize > SYNC_MAX_BLOCK) {
+        _error(svr, "protocol screwup: bad sync block size\n");
+        goto out;
+    }
+
+    while ((line = pcp_reader_line(svr->in, NULL)) && *line != '\0')
+        list_append(queries, Strdup(line));
+    if (line == NULL || pcp_reader_pending(svr->in) > 0) {
+        _error(svr, "protocol screwup: bad sync query\n");
+        goto out;
+    }
+
+    blockbuf = Malloc(bsize);
+    i = list_iterator_create(queries);
+    while ((line = list_next(i))) {
+        long long qsize = strtoll(line, &cp, 10);
+        struct stat stb;
+        char buf[64];
+        int fd = -1;
+
+        if (*cp++ != ' ' || !_archive_path_ok(cp)) {
+            _error(svr, "protocol screwup: bad sync query\n");
+            list_iterator_destroy(i);
+            goto out;
+        }
+        path = _archive_target(targ, targisdir, cp);
+        if (stat(path, &stb) < 0 || !S_ISREG(stb.st_mode)
+            || (fd = open(path, O_RDONLY)) < 0) {
+            _reply_append(&reply, "-\n");
+            Free((void **) &path);
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%lld %ld ", 
+                 (long long) stb.st_size, (long) stb.st_mtime);
+        _reply_append(&reply, buf);
+        if (stb.st_size == qsize || stb.st_size > bsize)
+            _sync_hashes(fd, stb.st_size, bsize, blockbuf, &reply);
+        else
+            _reply_append(&reply, "-");
+        _reply_append(&reply, "\n");
+        close(fd);
+        Free((void **) &path);
+    }
+    list_iterator_destroy(i);
+
+    if (reply.len && fd_write_n(svr->outfd, reply.buf, reply.len) < 0)
+        goto out;
+    rc = 0;
+out:
+    if (reply.buf)
+        Free((void **) &reply.buf);
+    if (blockbuf)
+        Free((void **) &blockbuf);
+    list_destroy(queries);
+    return rc;
+}
+
 int pcp_server(struct pcp_server *svr) 
 {
-	BUF buffer;
-	memset (&buffer, 0, sizeof (buffer));
+    svr->seq = 0;
+    svr->in = pcp_reader_create(svr->infd, ARCHIVE_BUFSIZ);
+    pcp_reader_set_stats(svr->in, svr->stats);
+    svr->writer = NULL;
+    svr->ack_owed = false;
+    svr->dirty = false;
+    svr->written = svr->nocache ? list_create(_archive_free) : NULL;
+    if (svr->pipeline)
+        svr->writer = pcp_writer_create(WRITE_BEHIND_THREADS, 
+                                        WRITE_BEHIND_LIMIT);
 
     /* If reverse copy, outfile is always a directory. */
-    _sink (svr, svr->outfile, &buffer);
+    _sink (svr, svr->outfile);
 
-	if (buffer.buf)
-		free (buffer.buf);
+    if (svr->writer)
+        pcp_writer_destroy(svr->writer);
+    if (_flush(svr) < 0)
+        _error(svr, "can't sync %s: %m\n", svr->outfile);
+    if (svr->written)
+        list_destroy(svr->written);
+    pcp_reader_destroy(svr->in);
     return 0;
 }
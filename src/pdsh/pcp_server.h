@@ -31,14 +31,34 @@
 #  include <config.h>
 #endif 
 
+#include "src/common/list.h"
 #include "src/pdsh/opt.h"
+#include "src/pdsh/pcp_reader.h"
+#include "src/pdsh/pcp_writer.h"
+#include "src/pdsh/pcp_store.h"
+#include "src/pdsh/pcp_stats.h"
 
 struct pcp_server {
 	int infd;
 	int outfd;
+	pcp_reader_t in;        /* buffered reader on infd */
 	bool preserve;
 	bool target_is_dir;
 	char *outfile;
+	bool pipeline;          /* -o pipeline: ack records asynchronously */
+	unsigned long seq;      /* number of records received */
+	pcp_writer_t writer;    /* write-behind threads (pipelined mode) */
+	bool ack_owed;          /* ack held back until writes are done */
+	pcp_store_t store;      /* rpdcp -o dedup: content store, or NULL */
+	mode_t mask;            /* umask for files not created with -p */
+	bool verify;            /* -o verify: file data followed by digest */
+	pcp_stats_t stats;      /* progress counters, or NULL */
+	bool prealloc;          /* -o prealloc: fallocate() files up front */
+	bool direct;            /* -o direct: O_DIRECT writes of large files */
+	bool nocache;           /* -o nocache: drop written files from cache */
+	bool fsync;             /* -o fsync: syncfs() at end of transfer */
+	bool dirty;             /* files written since the last _flush() */
+	List written;           /* -o nocache: paths written, or NULL */
 };
 
 int pcp_server (struct pcp_server *s);
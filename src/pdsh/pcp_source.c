@@ -0,0 +1,324 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "src/common/macros.h"
+#include "src/common/list.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "pcp_source.h"
+
+struct chunk {
+    pcp_source_t   source;
+    int            index;       /* chunk number within source           */
+    char *         data;
+    size_t         len;
+    int            refs;        /* threads using this chunk             */
+    bool           loading;     /* data is being read by some thread    */
+    int            error;       /* errno from failed read, or 0         */
+    struct chunk * prev;        /* LRU list of unused chunks            */
+    struct chunk * next;
+};
+
+struct pcp_source {
+    char *         path;
+    off_t          size;
+    int            nchunks;
+    struct chunk **chunks;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cache_cond =  PTHREAD_COND_INITIALIZER;
+
+static size_t cache_limit = 0;
+static size_t cache_used = 0;
+static List   sources = NULL;
+static pcp_source_filter_f filter = NULL;
+
+/*
+ *  Unused chunks, least recently used at head
+ */
+static struct chunk *lru_head = NULL;
+static struct chunk *lru_tail = NULL;
+
+static void _lru_remove (struct chunk *c)
+{
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        lru_head = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    else
+        lru_tail = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void _lru_append (struct chunk *c)
+{
+    c->prev = lru_tail;
+    c->next = NULL;
+    if (lru_tail)
+        lru_tail->next = c;
+    else
+        lru_head = c;
+    lru_tail = c;
+}
+
+static void _chunk_free (struct chunk *c)
+{
+    if (c->data) {
+        cache_used -= c->len;
+        Free ((void **) &c->data);
+    }
+    Free ((void **) &c);
+}
+
+/*
+ *  Drop unused chunks until `need' more bytes fit in the cache, or
+ *   no unused chunks remain. Chunks in use are never dropped, so the
+ *   cache may exceed its limit by up to one chunk per thread.
+ *   Called with cache_mutex held.
+ */
+static void _cache_evict (size_t need)
+{
+    while (lru_head && cache_used + need > cache_limit) {
+        struct chunk *c = lru_head;
+        _lru_remove (c);
+        c->source->chunks[c->index] = NULL;
+        _chunk_free (c);
+    }
+}
+
+static void _source_destroy (pcp_source_t s)
+{
+    int i;
+    for (i = 0; i < s->nchunks; i++) {
+        if (s->chunks[i])
+            _chunk_free (s->chunks[i]);
+    }
+    if (s->chunks)
+        Free ((void **) &s->chunks);
+    Free ((void **) &s->path);
+    Free ((void **) &s);
+}
+
+void pcp_source_cache_init (size_t limit)
+{
+    cache_limit = limit;
+    if (sources == NULL)
+        sources = list_create ((ListDelF) _source_destroy);
+}
+
+void pcp_source_cache_set_filter (pcp_source_filter_f f)
+{
+    filter = f;
+}
+
+int pcp_source_cache_enabled (void)
+{
+    return (cache_limit > 0);
+}
+
+void pcp_source_cache_fini (void)
+{
+    pthread_mutex_lock (&cache_mutex);
+    lru_head = lru_tail = NULL;
+    if (sources)
+        list_destroy (sources);
+    sources = NULL;
+    cache_limit = 0;
+    pthread_mutex_unlock (&cache_mutex);
+}
+
+pcp_source_t pcp_source_get (pcp_source_t *sp, const char *path, off_t size)
+{
+    pcp_source_t s;
+
+    pthread_mutex_lock (&cache_mutex);
+    if ((s = *sp) == NULL) {
+        s = Malloc (sizeof (*s));
+        s->path = Strdup (path);
+        s->size = size;
+        s->nchunks = (size + PCP_SOURCE_CHUNK_SIZE - 1) / PCP_SOURCE_CHUNK_SIZE;
+        if (s->nchunks > 0)
+            s->chunks = Malloc (s->nchunks * sizeof (struct chunk *));
+        list_append (sources, s);
+        *sp = s;
+    }
+    pthread_mutex_unlock (&cache_mutex);
+
+    return (s);
+}
+
+int pcp_source_nchunks (pcp_source_t s)
+{
+    return (s->nchunks);
+}
+
+static size_t _chunk_len (pcp_source_t s, int n)
+{
+    off_t off = (off_t) n * PCP_SOURCE_CHUNK_SIZE;
+    off_t len = s->size - off;
+    return (len > PCP_SOURCE_CHUNK_SIZE ? PCP_SOURCE_CHUNK_SIZE : len);
+}
+
+/*
+ *  Read chunk `n' of source `s' into `c', and pass it through the
+ *   filter if any. Called without cache_mutex, by the one thread
+ *   which created the chunk.
+ */
+static int _chunk_read (pcp_source_t s, int n, struct chunk *c)
+{
+    off_t off = (off_t) n * PCP_SOURCE_CHUNK_SIZE;
+    size_t got = 0;
+    int fd;
+
+    if ((fd = open (s->path, O_RDONLY)) < 0)
+        return (-1);
+
+    while (got < c->len) {
+        ssize_t rc = pread (fd, c->data + got, c->len - got, off + got);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            close (fd);
+            return (-1);
+        }
+        if (rc == 0) {
+            /* file is shorter than when copy started */
+            close (fd);
+            errno = EIO;
+            return (-1);
+        }
+        got += rc;
+    }
+    close (fd);
+
+    if (filter) {
+        size_t len;
+        char *data = filter (c->data, c->len, &len);
+
+        if (data == NULL) {
+            errno = ENOMEM;
+            return (-1);
+        }
+        Free ((void **) &c->data);
+        c->data = data;
+
+        pthread_mutex_lock (&cache_mutex);
+        cache_used = cache_used - c->len + len;
+        c->len = len;
+        pthread_mutex_unlock (&cache_mutex);
+    }
+    return (0);
+}
+
+const char *pcp_source_chunk_get (pcp_source_t s, int n, size_t *lenp)
+{
+    struct chunk *c;
+
+    pthread_mutex_lock (&cache_mutex);
+
+    if ((c = s->chunks[n]) == NULL) {
+        /*
+         *  Not cached: this thread reads the chunk while any others
+         *   which need it wait on cache_cond.
+         */
+        c = Malloc (sizeof (*c));
+        c->source = s;
+        c->index = n;
+        c->len = _chunk_len (s, n);
+        c->refs = 1;
+        c->loading = true;
+        s->chunks[n] = c;
+
+        _cache_evict (c->len);
+        cache_used += c->len;
+        c->data = Malloc (c->len);
+        pthread_mutex_unlock (&cache_mutex);
+
+        if (_chunk_read (s, n, c) < 0)
+            c->error = errno;
+
+        pthread_mutex_lock (&cache_mutex);
+        c->loading = false;
+        pthread_cond_broadcast (&cache_cond);
+    }
+    else {
+        if (c->refs++ == 0)
+            _lru_remove (c);
+        while (c->loading)
+            pthread_cond_wait (&cache_cond, &cache_mutex);
+    }
+
+    pthread_mutex_unlock (&cache_mutex);
+
+    if (c->error) {
+        errno = c->error;
+        pcp_source_chunk_put (s, n);
+        return (NULL);
+    }
+
+    *lenp = c->len;
+    return (c->data);
+}
+
+void pcp_source_chunk_put (pcp_source_t s, int n)
+{
+    struct chunk *c;
+
+    pthread_mutex_lock (&cache_mutex);
+    c = s->chunks[n];
+    if (--c->refs == 0) {
+        if (c->error) {
+            /* let the next thread retry the read */
+            s->chunks[n] = NULL;
+            _chunk_free (c);
+        }
+        else {
+            _lru_append (c);
+            _cache_evict (0);
+        }
+    }
+    pthread_mutex_unlock (&cache_mutex);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,100 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Shared source file cache for pdcp: each source file is read once,
+ *   in fixed size chunks, into a cache shared by all pcp client
+ *   threads, so that the same data is not read again for every host.
+ *   Chunks not in use by any thread are kept, least recently used
+ *   first out, until the cache memory limit is reached. With hosts
+ *   progressing at different rates, the cache then holds the window
+ *   of the file between the slowest and the fastest host.
+ */
+
+#ifndef _PCP_SOURCE_H
+#define _PCP_SOURCE_H
+
+#include <sys/types.h>
+
+#define PCP_SOURCE_CHUNK_SIZE  (1024 * 1024)
+
+typedef struct pcp_source * pcp_source_t;
+
+/*
+ *  A filter is applied once to each chunk after it is read, and returns
+ *   the data to cache in its place (e.g. compressed, see -o compress),
+ *   in a buffer allocated with Malloc(), storing its length in `*lenp'.
+ *   Returns NULL on failure.
+ */
+typedef char * (*pcp_source_filter_f) (const char *data, size_t len, 
+                                       size_t *lenp);
+
+/*
+ *  Enable the shared source cache with memory limit `limit' bytes.
+ */
+void pcp_source_cache_init (size_t limit);
+
+/*
+ *  Set the filter for all chunks read from now on.
+ */
+void pcp_source_cache_set_filter (pcp_source_filter_f f);
+
+/*
+ *  Return nonzero if the shared source cache has been enabled.
+ */
+int pcp_source_cache_enabled (void);
+
+/*
+ *  Free all cached data.
+ */
+void pcp_source_cache_fini (void);
+
+/*
+ *  Return the shared source object for file `path' with size `size',
+ *   creating it and storing it in `*sp' if `*sp' is NULL. Threads
+ *   copying the same file must pass the same `sp'.
+ */
+pcp_source_t pcp_source_get (pcp_source_t *sp, const char *path, off_t size);
+
+/*
+ *  Return number of chunks in source `s'.
+ */
+int pcp_source_nchunks (pcp_source_t s);
+
+/*
+ *  Return a pointer to the data of chunk `n' of source `s', reading it
+ *   from the file if it is not already cached, and store its length in
+ *   `*lenp'. The chunk stays in memory until released with
+ *   pcp_source_chunk_put(). Returns NULL with errno set on failure.
+ */
+const char *pcp_source_chunk_get (pcp_source_t s, int n, size_t *lenp);
+void pcp_source_chunk_put (pcp_source_t s, int n);
+
+#endif /* !_PCP_SOURCE_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
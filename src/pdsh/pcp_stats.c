@@ -0,0 +1,169 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "src/common/xmalloc.h"
+#include "pcp_stats.h"
+
+struct pcp_stats {
+    pthread_mutex_t mutex;
+    struct pcp_stats_info info;
+    double          begin;          /* 0 until pcp_stats_begin()         */
+    double          end;            /* 0 until pcp_stats_end()           */
+    double          wait_start;     /* 0 unless in a read                */
+    double          write_start;
+};
+
+double pcp_stats_now (void)
+{
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+pcp_stats_t pcp_stats_create (void)
+{
+    pcp_stats_t s = Malloc (sizeof (*s));
+
+    pthread_mutex_init (&s->mutex, NULL);
+    return (s);
+}
+
+void pcp_stats_destroy (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_destroy (&s->mutex);
+    Free ((void **) &s);
+}
+
+void pcp_stats_begin (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    s->begin = pcp_stats_now ();
+    pthread_mutex_unlock (&s->mutex);
+}
+
+void pcp_stats_end (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    s->end = pcp_stats_now ();
+    pthread_mutex_unlock (&s->mutex);
+}
+
+void pcp_stats_wait_begin (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    s->wait_start = pcp_stats_now ();
+    pthread_mutex_unlock (&s->mutex);
+}
+
+void pcp_stats_wait_end (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    s->info.wait += pcp_stats_now () - s->wait_start;
+    s->wait_start = 0.0;
+    pthread_mutex_unlock (&s->mutex);
+}
+
+/*
+ *  Only the thread of the connection writes, so the start of a write
+ *   needs no lock.
+ */
+void pcp_stats_write_begin (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    s->write_start = pcp_stats_now ();
+}
+
+void pcp_stats_write_end (pcp_stats_t s, size_t bytes)
+{
+    double now;
+
+    if (s == NULL)
+        return;
+    now = pcp_stats_now ();
+    pthread_mutex_lock (&s->mutex);
+    s->info.write += now - s->write_start;
+    s->info.bytes += bytes;
+    pthread_mutex_unlock (&s->mutex);
+}
+
+void pcp_stats_bytes (pcp_stats_t s, size_t bytes)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    s->info.bytes += bytes;
+    pthread_mutex_unlock (&s->mutex);
+}
+
+void pcp_stats_file (pcp_stats_t s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    s->info.files++;
+    pthread_mutex_unlock (&s->mutex);
+}
+
+void pcp_stats_get (pcp_stats_t s, struct pcp_stats_info *info)
+{
+    double now = pcp_stats_now ();
+
+    memset (info, 0, sizeof (*info));
+    if (s == NULL)
+        return;
+    pthread_mutex_lock (&s->mutex);
+    *info = s->info;
+    if (s->wait_start > 0.0)
+        info->waiting = now - s->wait_start;
+    if (s->begin > 0.0)
+        info->secs = (s->end > 0.0 ? s->end : now) - s->begin;
+    pthread_mutex_unlock (&s->mutex);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,98 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Progress counters of one pdcp or rpdcp connection, for -o progress
+ *   and the -d statistics: bytes and files copied, and the time spent
+ *   blocked reading from the remote host (the client waiting for
+ *   acknowledgements, the server for data) and writing (the client to
+ *   the network, the server to local files). Updated by the thread of
+ *   the connection and read by others. All functions accept NULL.
+ */
+
+#ifndef _PCP_STATS_H
+#define _PCP_STATS_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+typedef struct pcp_stats * pcp_stats_t;
+
+struct pcp_stats_info {
+    uint64_t        bytes;          /* bytes written                     */
+    unsigned long   files;          /* files copied                      */
+    double          wait;           /* seconds blocked reading           */
+    double          write;          /* seconds blocked writing           */
+    double          waiting;        /* seconds of the current wait, or 0 */
+    double          secs;           /* seconds from begin to end or now  */
+};
+
+/*
+ *  Return the current time in seconds, as used by all pcp timings.
+ */
+double pcp_stats_now (void);
+
+pcp_stats_t pcp_stats_create (void);
+void pcp_stats_destroy (pcp_stats_t s);
+
+/*
+ *  Mark the start and the end of the copy.
+ */
+void pcp_stats_begin (pcp_stats_t s);
+void pcp_stats_end (pcp_stats_t s);
+
+/*
+ *  Time a blocking read from the remote host.
+ */
+void pcp_stats_wait_begin (pcp_stats_t s);
+void pcp_stats_wait_end (pcp_stats_t s);
+
+/*
+ *  Time a write, and count the `bytes' written.
+ */
+void pcp_stats_write_begin (pcp_stats_t s);
+void pcp_stats_write_end (pcp_stats_t s, size_t bytes);
+
+/*
+ *  Count `bytes' written without timing them, e.g. by another thread.
+ */
+void pcp_stats_bytes (pcp_stats_t s, size_t bytes);
+
+/*
+ *  Count a file copied.
+ */
+void pcp_stats_file (pcp_stats_t s);
+
+/*
+ *  Take a snapshot of the counters in `info'.
+ */
+void pcp_stats_get (pcp_stats_t s, struct pcp_stats_info *info);
+
+#endif /* !_PCP_STATS_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
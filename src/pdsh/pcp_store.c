@@ -0,0 +1,224 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "src/common/fd.h"
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "pcp_store.h"
+
+#define STORE_CMPSIZ    (64 * 1024)
+
+/*
+ *  Objects are kept in 256 subdirectories named by the first two hex
+ *   digits of their digest, created as needed.
+ */
+struct pcp_store {
+    char *  dir;
+};
+
+pcp_store_t pcp_store_create (const char *dir)
+{
+    pcp_store_t s;
+
+    if (mkdir (dir, 0700) < 0 && errno != EEXIST)
+        return (NULL);
+
+    s = Malloc (sizeof (*s));
+    s->dir = Strdup (dir);
+    return (s);
+}
+
+void pcp_store_destroy (pcp_store_t s)
+{
+    Free ((void **) &s->dir);
+    Free ((void **) &s);
+}
+
+char *pcp_store_key (char *buf, uint64_t digest, off_t size, int mode,
+                     const struct timeval *mtime)
+{
+    int n = snprintf (buf, PCP_STORE_KEYLEN, "%016llx-%llx-%04o",
+                      (unsigned long long) digest, 
+                      (unsigned long long) size, mode & 07777);
+    if (mtime)
+        snprintf (buf + n, PCP_STORE_KEYLEN - n, "-%ld.%06ld", 
+                  (long) mtime->tv_sec, (long) mtime->tv_usec);
+    return (buf);
+}
+
+static char *_object (pcp_store_t s, const char *key)
+{
+    char *obj = Malloc (strlen (s->dir) + strlen (key) + 5);
+
+    sprintf (obj, "%s/%.2s/%s", s->dir, key, key);
+    return (obj);
+}
+
+void pcp_store_remove (const char *path)
+{
+    struct stat st;
+
+    if (lstat (path, &st) == 0 && S_ISREG (st.st_mode))
+        (void) unlink (path);
+}
+
+/*
+ *  Return true if the object `obj' holds the same data as file `path',
+ *   or if `path' is NULL, the `len' bytes at `data'. Keys are made from
+ *   a 64-bit digest which a host can collide on purpose, so an object
+ *   is never shared unless its data is the same byte for byte.
+ */
+static bool _same_data (const char *obj, const char *path, 
+                        const void *data, size_t len)
+{
+    struct stat ost, pst;
+    char *obuf = NULL, *pbuf = NULL;
+    int ofd, pfd = -1;
+    bool same = false;
+    size_t off, n;
+
+    if ((ofd = open (obj, O_RDONLY)) < 0 || fstat (ofd, &ost) < 0)
+        goto done;
+    if (path) {
+        if ((pfd = open (path, O_RDONLY)) < 0 || fstat (pfd, &pst) < 0)
+            goto done;
+        if (pst.st_dev == ost.st_dev && pst.st_ino == ost.st_ino) {
+            same = true;
+            goto done;
+        }
+        len = pst.st_size;
+    }
+    if (ost.st_size != (off_t) len)
+        goto done;
+
+    obuf = Malloc (STORE_CMPSIZ);
+    if (path)
+        pbuf = Malloc (STORE_CMPSIZ);
+    for (off = 0; off < len; off += n) {
+        n = MIN (len - off, STORE_CMPSIZ);
+        if (fd_read_n (ofd, obuf, n) != (ssize_t) n)
+            goto done;
+        if (path && fd_read_n (pfd, pbuf, n) != (ssize_t) n)
+            goto done;
+        if (memcmp (obuf, path ? pbuf : (const char *) data + off, n) != 0)
+            goto done;
+    }
+    same = true;
+
+done:
+    if (obuf)
+        Free ((void **) &obuf);
+    if (pbuf)
+        Free ((void **) &pbuf);
+    if (pfd >= 0)
+        close (pfd);
+    if (ofd >= 0)
+        close (ofd);
+    return (same);
+}
+
+/*
+ *  Atomically replace `path' with a link to `obj', through a temporary
+ *   link next to it, so that `path' is never missing. If `path' is 
+ *   already a link to `obj', rename() leaves the temporary link.
+ */
+static int _replace (const char *obj, const char *path)
+{
+    char *tmp = Malloc (strlen (path) + 16);
+    int rc = -1;
+
+    sprintf (tmp, "%s.pdcp-dedup", path);
+    (void) unlink (tmp);
+    if (link (obj, tmp) == 0) {
+        int save_errno;
+
+        rc = rename (tmp, path);
+        save_errno = errno;
+        (void) unlink (tmp);
+        errno = save_errno;
+    }
+    Free ((void **) &tmp);
+    return (rc);
+}
+
+int pcp_store_link (pcp_store_t s, const char *key, const char *path,
+                    const void *data, size_t len)
+{
+    char *obj = _object (s, key);
+    int rc = -1;
+
+    if (_same_data (obj, NULL, data, len))
+        rc = _replace (obj, path);
+
+    Free ((void **) &obj);
+    return (rc);
+}
+
+int pcp_store_add (pcp_store_t s, const char *key, const char *path)
+{
+    char *obj = _object (s, key);
+    char *sub = Strdup (obj);
+    int rc;
+
+    *strrchr (sub, '/') = '\0';
+    if ((rc = link (path, obj)) < 0 && errno == ENOENT) {
+        if (mkdir (sub, 0700) == 0 || errno == EEXIST)
+            rc = link (path, obj);
+    }
+
+    /*
+     *  Another copy was stored first: share it, unless its data differs.
+     *   If the object has as many links as the filesystem allows, or
+     *   only its key matches, keep this copy.
+     */
+    if (rc < 0 && errno == EEXIST) {
+        if (!_same_data (obj, path, NULL, 0))
+            rc = 0;
+        else if ((rc = _replace (obj, path)) < 0 && errno == EMLINK)
+            rc = 0;
+    }
+
+    Free ((void **) &sub);
+    Free ((void **) &obj);
+    return (rc);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
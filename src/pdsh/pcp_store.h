@@ -0,0 +1,89 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Content-addressed store for rpdcp -o dedup: each file gathered from
+ *   the remote hosts is hashed as it is received and hard linked into
+ *   a store directory under a key made of its digest, size, mode and
+ *   (with -p) modification time, so that identical files gathered from
+ *   many hosts share one inode. Since all links to an object share its
+ *   data and attributes, existing files are removed before they are
+ *   written, rather than overwritten.
+ */
+
+#ifndef _PCP_STORE_H
+#define _PCP_STORE_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdint.h>
+
+typedef struct pcp_store * pcp_store_t;
+
+#define PCP_STORE_KEYLEN    96
+
+/*
+ *  Open the store in directory `dir', creating it if needed.
+ *   Returns NULL with errno set on failure.
+ */
+pcp_store_t pcp_store_create (const char *dir);
+void pcp_store_destroy (pcp_store_t s);
+
+/*
+ *  Make the key for `size' bytes of data with digest `digest', to be
+ *   stored in a file of mode `mode' with modification time `mtime'
+ *   (NULL if the time is not set), in `buf' of PCP_STORE_KEYLEN bytes.
+ */
+char *pcp_store_key (char *buf, uint64_t digest, off_t size, int mode,
+                     const struct timeval *mtime);
+
+/*
+ *  Remove regular file `path' if it exists, so that it is written as
+ *   a new file rather than through a link to a stored object.
+ */
+void pcp_store_remove (const char *path);
+
+/*
+ *  Replace `path' with a link to the object stored under `key', if
+ *   that object holds the `len' bytes at `data'. Returns 0, or -1 if
+ *   there is no such object or it cannot be linked.
+ */
+int pcp_store_link (pcp_store_t s, const char *key, const char *path,
+                    const void *data, size_t len);
+
+/*
+ *  Add file `path', completely written with the data and attributes
+ *   that `key' was made from, to the store. If an object is already
+ *   stored under `key', `path' is replaced with a link to it instead.
+ *   Returns -1 with errno set on failure.
+ */
+int pcp_store_add (pcp_store_t s, const char *key, const char *path);
+
+#endif /* !_PCP_STORE_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,356 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "src/common/err.h"
+#include "src/common/list.h"
+#include "src/common/xmalloc.h"
+#include "pcp_walk.h"
+
+#define WALK_THREADS        8
+#define ARENA_BLOCK_SIZE    (256 * 1024)
+
+/*
+ *  Arena: memory is allocated from large blocks, which are only
+ *   freed all at once. Each walker thread has its own arena, which
+ *   it adds to the global list of blocks when it is done.
+ */
+struct arena_block {
+    struct arena_block *next;
+    size_t              used;
+    size_t              size;
+    char                data[];
+};
+
+struct arena {
+    struct arena_block *blocks;
+};
+
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct arena    arena = { NULL };
+
+static void *_arena_alloc (struct arena *a, size_t n)
+{
+    struct arena_block *b = a->blocks;
+    void *p;
+
+    n = (n + sizeof (void *) - 1) & ~(sizeof (void *) - 1);
+    if (b == NULL || b->size - b->used < n) {
+        size_t size = n > ARENA_BLOCK_SIZE ? n : ARENA_BLOCK_SIZE;
+        b = Malloc (sizeof (*b) + size);   /* zeroed */
+        b->size = size;
+        b->used = 0;
+        b->next = a->blocks;
+        a->blocks = b;
+    }
+    p = b->data + b->used;
+    b->used += n;
+    return (p);
+}
+
+/*
+ *  Add the blocks of arena `a' to the global arena.
+ */
+static void _arena_merge (struct arena *a)
+{
+    struct arena_block *b;
+
+    if (!(b = a->blocks))
+        return;
+    while (b->next)
+        b = b->next;
+
+    pthread_mutex_lock (&arena_mutex);
+    b->next = arena.blocks;
+    arena.blocks = a->blocks;
+    pthread_mutex_unlock (&arena_mutex);
+    a->blocks = NULL;
+}
+
+static struct pcp_filename *_entry (struct arena *a, const char *dir,
+                                    const char *name)
+{
+    struct pcp_filename *pf = _arena_alloc (a, sizeof (*pf));
+    size_t len = dir ? strlen (dir) + 1 : 0;
+
+    pf->filename = _arena_alloc (a, len + strlen (name) + 1);
+    if (dir) {
+        memcpy (pf->filename, dir, len - 1);
+        pf->filename[len - 1] = '/';
+    }
+    strcpy (pf->filename + len, name);
+    return (pf);
+}
+
+struct pcp_filename *pcp_walk_entry (const char *name, int by_user,
+                                     const struct stat *sb)
+{
+    struct pcp_filename *pf;
+
+    pthread_mutex_lock (&arena_mutex);
+    pf = _entry (&arena, NULL, name);
+    pthread_mutex_unlock (&arena_mutex);
+
+    pf->file_specified_by_user = by_user;
+    if (sb)
+        pf->sb = *sb;
+    return (pf);
+}
+
+void pcp_walk_fini (void)
+{
+    struct arena_block *b;
+
+    pthread_mutex_lock (&arena_mutex);
+    while ((b = arena.blocks)) {
+        arena.blocks = b->next;
+        Free ((void **) &b);
+    }
+    pthread_mutex_unlock (&arena_mutex);
+}
+
+/*
+ *  A directory to be listed. Its entries are kept in readdir order,
+ *   each with the listing of its own contents if it is a directory.
+ */
+struct walk_entry {
+    struct pcp_filename *pf;
+    struct walk_dir *    sub;
+};
+
+struct walk_dir {
+    const char *         path;
+    struct walk_entry *  entries;
+    int                  n;
+    int                  size;
+};
+
+struct walker {
+    pthread_mutex_t      mutex;
+    pthread_cond_t       cond;
+    List                 todo;      /* directories not yet listed      */
+    int                  busy;      /* threads listing a directory     */
+};
+
+static struct walk_dir *_walk_dir_create (const char *path)
+{
+    struct walk_dir *d = Malloc (sizeof (*d));
+
+    d->path = path;
+    return (d);
+}
+
+static void _walk_dir_destroy (struct walk_dir *d)
+{
+    int i;
+
+    for (i = 0; i < d->n; i++) {
+        if (d->entries[i].sub)
+            _walk_dir_destroy (d->entries[i].sub);
+    }
+    if (d->entries)
+        Free ((void **) &d->entries);
+    Free ((void **) &d);
+}
+
+/*
+ *  List directory `d', stat'ing each entry relative to the directory,
+ *   and queue its subdirectories to be listed.
+ */
+static void _list_dir (struct walker *w, struct arena *a, struct walk_dir *d)
+{
+    struct dirent *dp;
+    DIR *dir;
+#if HAVE_FDOPENDIR
+    int fd = open (d->path, O_RDONLY | O_DIRECTORY);
+
+    dir = fd < 0 ? NULL : fdopendir (fd);
+    if (dir == NULL && fd >= 0)
+        close (fd);
+#else
+    dir = opendir (d->path);
+#endif
+    if (dir == NULL)
+        errx ("%p: opendir: %s: %m\n", d->path);
+
+    while ((dp = readdir (dir))) {
+        struct walk_entry *e;
+        struct pcp_filename *pf;
+
+        if (dp->d_ino == 0)
+            continue;
+        if (!strcmp (dp->d_name, ".") || !strcmp (dp->d_name, ".."))
+            continue;
+
+        pf = _entry (a, d->path, dp->d_name);
+#if HAVE_FDOPENDIR
+        if (fstatat (dirfd (dir), dp->d_name, &pf->sb, 0) < 0)
+#else
+        if (stat (pf->filename, &pf->sb) < 0)
+#endif
+            errx ("%p: can't stat %s: %m\n", pf->filename);
+        if (!S_ISDIR (pf->sb.st_mode) && !S_ISREG (pf->sb.st_mode))
+            errx ("%p: not a regular file or directory: %s\n", pf->filename);
+
+        if (d->n == d->size) {
+            d->size = d->size ? d->size * 2 : 64;
+            if (d->entries)
+                Realloc ((void **) &d->entries, d->size * sizeof (*e));
+            else
+                d->entries = Malloc (d->size * sizeof (*e));
+        }
+        e = &d->entries[d->n++];
+        e->pf = pf;
+        e->sub = NULL;
+
+        if (S_ISDIR (pf->sb.st_mode)) {
+            e->sub = _walk_dir_create (pf->filename);
+            pthread_mutex_lock (&w->mutex);
+            list_push (w->todo, e->sub);
+            pthread_cond_signal (&w->cond);
+            pthread_mutex_unlock (&w->mutex);
+        }
+    }
+    closedir (dir);
+}
+
+static void *_walk_thread (void *arg)
+{
+    struct walker *w = arg;
+    struct arena a = { NULL };
+    struct walk_dir *d;
+
+    pthread_mutex_lock (&w->mutex);
+    for (;;) {
+        while (!(d = list_pop (w->todo)) && w->busy > 0)
+            pthread_cond_wait (&w->cond, &w->mutex);
+        if (d == NULL)
+            break;
+        w->busy++;
+        pthread_mutex_unlock (&w->mutex);
+
+        _list_dir (w, &a, d);
+
+        pthread_mutex_lock (&w->mutex);
+        if (--w->busy == 0 && list_is_empty (w->todo))
+            pthread_cond_broadcast (&w->cond);
+    }
+    pthread_mutex_unlock (&w->mutex);
+
+    _arena_merge (&a);
+    return (NULL);
+}
+
+/*
+ *  Append the listing of `d' to `files' in serial walk order.
+ */
+static void _walk_append (struct walk_dir *d, List files)
+{
+    int i;
+
+    for (i = 0; i < d->n; i++) {
+        list_append (files, d->entries[i].pf);
+        if (d->entries[i].sub)
+            _walk_append (d->entries[i].sub, files);
+    }
+
+    /* Since pdcp reads file names and directories only once for
+     * efficiency, we must specify a special flag so we know when
+     * to tell the server to "move up" the directory tree.
+     */
+    list_append (files, pcp_walk_entry (EXIT_SUBDIR_FILENAME, 0, NULL));
+}
+
+void pcp_walk (List roots, List files)
+{
+    struct walker w[1];
+    pthread_t threads[WALK_THREADS];
+    struct walk_dir **dirs;
+    struct pcp_filename *pf;
+    ListIterator i;
+    int k, n = 0, nthreads;
+
+    pthread_mutex_init (&w->mutex, NULL);
+    pthread_cond_init (&w->cond, NULL);
+    w->todo = list_create (NULL);
+    w->busy = 0;
+
+    dirs = Malloc ((list_count (roots) + 1) * sizeof (*dirs));
+    i = list_iterator_create (roots);
+    while ((pf = list_next (i))) {
+        dirs[n] = NULL;
+        if (S_ISDIR (pf->sb.st_mode)) {
+            dirs[n] = _walk_dir_create (pf->filename);
+            list_append (w->todo, dirs[n]);
+        }
+        n++;
+    }
+    list_iterator_destroy (i);
+
+    /* the list is empty unless a directory was given */
+    nthreads = list_is_empty (w->todo) ? 0 : WALK_THREADS;
+    for (k = 0; k < nthreads; k++) {
+        int rv = pthread_create (&threads[k], NULL, _walk_thread, w);
+        if (rv != 0)
+            errx ("%p: pthread_create: %S\n", strerror (rv));
+    }
+    for (k = 0; k < nthreads; k++)
+        pthread_join (threads[k], NULL);
+
+    n = 0;
+    i = list_iterator_create (roots);
+    while ((pf = list_next (i))) {
+        list_append (files, pf);
+        if (dirs[n]) {
+            _walk_append (dirs[n], files);
+            _walk_dir_destroy (dirs[n]);
+        }
+        n++;
+    }
+    list_iterator_destroy (i);
+
+    Free ((void **) &dirs);
+    list_destroy (w->todo);
+    pthread_cond_destroy (&w->cond);
+    pthread_mutex_destroy (&w->mutex);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,67 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Parallel directory walker for pdcp -r: the directories below the
+ *   source files are listed and their entries stat'ed by a pool of
+ *   threads, each taking the next unlisted directory from a shared
+ *   stack, and the results are then put together in the order of a
+ *   serial depth first walk, which the pcp protocol requires.
+ *   All pcp_filename entries and their names are allocated from an
+ *   arena, freed at once with pcp_walk_fini().
+ */
+
+#ifndef _PCP_WALK_H
+#define _PCP_WALK_H
+
+#include "src/common/list.h"
+#include "src/pdsh/pcp_client.h"
+
+/*
+ *  Return a new entry for file `name', with its stat snapshot `sb'
+ *   (or all zero if NULL), allocated from the arena.
+ */
+struct pcp_filename *pcp_walk_entry (const char *name, int by_user,
+                                     const struct stat *sb);
+
+/*
+ *  Append each entry in `roots' to `files', each directory followed
+ *   by the entries of all files below it and an entry for
+ *   EXIT_SUBDIR_FILENAME after the contents of every directory, in
+ *   the order of a serial depth first walk. Exits on error.
+ */
+void pcp_walk (List roots, List files);
+
+/*
+ *  Free all entries allocated from the arena.
+ */
+void pcp_walk_fini (void);
+
+#endif /* !_PCP_WALK_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,241 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "src/common/err.h"
+#include "src/common/fd.h"
+#include "src/common/list.h"
+#include "src/common/xmalloc.h"
+#include "pcp_writer.h"
+
+struct write_error {
+    unsigned long   seq;
+    char            msg[];
+};
+
+struct pcp_writer {
+    pthread_mutex_t mutex;
+    pthread_cond_t  work;       /* signaled when a file is queued       */
+    pthread_cond_t  done;       /* signaled when a file is written      */
+    List            queue;      /* files waiting for a writer thread    */
+    List            errors;
+    size_t          queued;     /* bytes of data queued or in progress  */
+    size_t          limit;
+    int             active;     /* files being written                  */
+    bool            shutdown;
+    int             nthreads;
+    pthread_t *     threads;
+};
+
+static void _free (void *x)
+{
+    Free (&x);
+}
+
+/*
+ *  Record error "<prefix><path>: <strerror(errnum)>" for request `req'.
+ */
+static void _write_error (pcp_writer_t w, struct pcp_write *req, 
+                          const char *prefix, int errnum)
+{
+    size_t len = strlen (prefix) + strlen (req->path) + 256;
+    struct write_error *e = Malloc (sizeof (*e) + len);
+
+    e->seq = req->seq;
+    snprintf (e->msg, len, "%s%s: %.200s\n", prefix, req->path, 
+              strerror (errnum));
+
+    pthread_mutex_lock (&w->mutex);
+    list_append (w->errors, e);
+    pthread_mutex_unlock (&w->mutex);
+}
+
+static void _write (pcp_writer_t w, struct pcp_write *req)
+{
+    int fd;
+
+    if ((fd = open (req->path, req->oflags, req->mode)) < 0) {
+        _write_error (w, req, "", errno);
+        return;
+    }
+    if (req->chmod)
+        (void) fchmod (fd, req->mode);
+    if (req->len && fd_write_n (fd, req->data, req->len) < 0) {
+        _write_error (w, req, "", errno);
+        (void) close (fd);
+        return;
+    }
+    if (!(req->oflags & O_TRUNC) && ftruncate (fd, req->len) < 0) {
+        _write_error (w, req, "can't truncate ", errno);
+        (void) close (fd);
+        return;
+    }
+    if (close (fd) < 0)
+        _write_error (w, req, "", errno);
+    else if (req->setimes && utimes (req->path, req->tv) < 0)
+        _write_error (w, req, "can't set times on ", errno);
+    else if (req->store && pcp_store_add (req->store, req->key, req->path) < 0)
+        _write_error (w, req, "can't deduplicate ", errno);
+}
+
+static void *_writer_thread (void *arg)
+{
+    pcp_writer_t w = arg;
+    struct pcp_write *req;
+
+    pthread_mutex_lock (&w->mutex);
+    for (;;) {
+        while (!(req = list_dequeue (w->queue)) && !w->shutdown)
+            pthread_cond_wait (&w->work, &w->mutex);
+        if (req == NULL)
+            break;
+        w->active++;
+        pthread_mutex_unlock (&w->mutex);
+
+        _write (w, req);
+
+        pthread_mutex_lock (&w->mutex);
+        w->active--;
+        w->queued -= req->len;
+        pthread_cond_broadcast (&w->done);
+        pcp_write_destroy (req);
+    }
+    pthread_mutex_unlock (&w->mutex);
+    return (NULL);
+}
+
+pcp_writer_t pcp_writer_create (int nthreads, size_t limit)
+{
+    pcp_writer_t w = Malloc (sizeof (*w));
+    int i;
+
+    pthread_mutex_init (&w->mutex, NULL);
+    pthread_cond_init (&w->work, NULL);
+    pthread_cond_init (&w->done, NULL);
+    w->queue = list_create (NULL);
+    w->errors = list_create (_free);
+    w->queued = 0;
+    w->limit = limit;
+    w->active = 0;
+    w->shutdown = false;
+    w->nthreads = nthreads;
+    w->threads = Malloc (nthreads * sizeof (pthread_t));
+    for (i = 0; i < nthreads; i++) {
+        int rv = pthread_create (&w->threads[i], NULL, _writer_thread, w);
+        if (rv != 0)
+            errx ("%p: pthread_create: %S\n", strerror (rv));
+    }
+    return (w);
+}
+
+void pcp_writer_destroy (pcp_writer_t w)
+{
+    int i;
+
+    pthread_mutex_lock (&w->mutex);
+    w->shutdown = true;
+    pthread_cond_broadcast (&w->work);
+    pthread_mutex_unlock (&w->mutex);
+
+    for (i = 0; i < w->nthreads; i++)
+        pthread_join (w->threads[i], NULL);
+
+    list_destroy (w->queue);
+    list_destroy (w->errors);
+    pthread_cond_destroy (&w->work);
+    pthread_cond_destroy (&w->done);
+    pthread_mutex_destroy (&w->mutex);
+    Free ((void **) &w->threads);
+    Free ((void **) &w);
+}
+
+struct pcp_write *pcp_write_create (const char *path, size_t len)
+{
+    struct pcp_write *req = Malloc (sizeof (*req) + len);
+
+    memset (req, 0, sizeof (*req));
+    req->path = Strdup (path);
+    req->len = len;
+    return (req);
+}
+
+void pcp_write_destroy (struct pcp_write *req)
+{
+    Free ((void **) &req->path);
+    Free ((void **) &req);
+}
+
+void pcp_writer_queue (pcp_writer_t w, struct pcp_write *req)
+{
+    pthread_mutex_lock (&w->mutex);
+    while (w->queued > 0 && w->queued + req->len > w->limit)
+        pthread_cond_wait (&w->done, &w->mutex);
+    w->queued += req->len;
+    list_enqueue (w->queue, req);
+    pthread_cond_signal (&w->work);
+    pthread_mutex_unlock (&w->mutex);
+}
+
+void pcp_writer_wait (pcp_writer_t w)
+{
+    pthread_mutex_lock (&w->mutex);
+    while (list_count (w->queue) > 0 || w->active > 0)
+        pthread_cond_wait (&w->done, &w->mutex);
+    pthread_mutex_unlock (&w->mutex);
+}
+
+char *pcp_writer_error (pcp_writer_t w, unsigned long *seqp)
+{
+    struct write_error *e;
+    char *msg = NULL;
+
+    pthread_mutex_lock (&w->mutex);
+    if ((e = list_dequeue (w->errors))) {
+        *seqp = e->seq;
+        msg = Strdup (e->msg);
+        Free ((void **) &e);
+    }
+    pthread_mutex_unlock (&w->mutex);
+    return (msg);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
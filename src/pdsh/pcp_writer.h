@@ -0,0 +1,103 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Write-behind threads for the pdcp server: the thread reading the
+ *   connection hands each small file, with its data in memory, to a
+ *   pool of writer threads, which open, write, truncate, close and set
+ *   the times of the file, so that slow metadata operations on the
+ *   target filesystem overlap with each other and with the network.
+ *   Errors are collected, tagged with the record they belong to, and
+ *   reported later by the reading thread.
+ */
+
+#ifndef _PCP_WRITER_H
+#define _PCP_WRITER_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdbool.h>
+
+#include "src/pdsh/pcp_store.h"
+
+typedef struct pcp_writer * pcp_writer_t;
+
+struct pcp_write {
+    char *          path;
+    int             oflags;     /* flags for open(2)                    */
+    int             mode;
+    bool            chmod;      /* set mode even if the file exists     */
+    bool            setimes;    /* set times to tv after writing        */
+    struct timeval  tv[2];
+    unsigned long   seq;        /* record number, for errors            */
+    pcp_store_t     store;      /* add file to store under key, or NULL */
+    char            key[PCP_STORE_KEYLEN];
+    size_t          len;
+    char            data[];
+};
+
+/*
+ *  Create a pool of `nthreads' writer threads, which holds at most
+ *   `limit' bytes of queued file data (but always at least one file).
+ */
+pcp_writer_t pcp_writer_create (int nthreads, size_t limit);
+
+/*
+ *  Wait for all queued files to be written, then stop the threads.
+ *   Errors not yet retrieved are dropped.
+ */
+void pcp_writer_destroy (pcp_writer_t w);
+
+/*
+ *  Return a new request to write `len' bytes, to be read into its
+ *   `data' by the caller, to the file `path'.
+ */
+struct pcp_write *pcp_write_create (const char *path, size_t len);
+void pcp_write_destroy (struct pcp_write *req);
+
+/*
+ *  Queue request `req' (which the pool then owns), blocking while the
+ *   pool is holding its limit of file data.
+ */
+void pcp_writer_queue (pcp_writer_t w, struct pcp_write *req);
+
+/*
+ *  Wait until all queued files have been written.
+ */
+void pcp_writer_wait (pcp_writer_t w);
+
+/*
+ *  Return the next error message "<path>: <error>\n" from a completed
+ *   write, to be freed by the caller, storing its record number in
+ *   `*seqp'. Returns NULL if there are no more errors.
+ */
+char *pcp_writer_error (pcp_writer_t w, unsigned long *seqp);
+
+#endif /* !_PCP_WRITER_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,531 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  pdjournal: query an output journal written by pdsh -J.
+ *
+ *  The log and index are mapped read-only, and queries are answered
+ *   from the index alone, reading the log only for the output of the
+ *   hosts actually printed. See journal.h for the file format.
+ */
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include "src/common/err.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/common/hostlist.h"
+#include "src/common/digest.h"
+#include "src/common/fd.h"
+#include "output.h"
+#include "journal.h"
+
+struct journal {
+    const char *                       log;
+    size_t                             loglen;
+    const char *                       idx;
+    size_t                             idxlen;
+    const struct journal_index_entry * entries;
+    uint32_t                           nentries;
+    const uint32_t *                   table;      /* NULL if no trailer  */
+    uint32_t                           nbuckets;
+};
+
+/*
+ *  Journal used by qsort(3) comparison functions
+ */
+static struct journal *cmp_journal = NULL;
+
+static void _usage (void)
+{
+    err ("Usage: %P [OPTION] FILE\n"
+         "  -l         list hosts with exit code, lines and bytes of output\n"
+         "  -e         list hosts grouped by exit code\n"
+         "  -r rc      list hosts which exited with code `rc'\n"
+         "  -w host    print output of `host'\n"
+         "  -c         print identical output of hosts only once\n");
+    exit (1);
+}
+
+static const char * _map (const char *path, size_t *lenp)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if ((fd = open (path, O_RDONLY)) < 0)
+        errx ("%p: open %s: %m\n", path);
+    if (fstat (fd, &st) < 0)
+        errx ("%p: stat %s: %m\n", path);
+    if (st.st_size == 0)
+        errx ("%p: %s: empty file\n", path);
+
+    p = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        errx ("%p: mmap %s: %m\n", path);
+    close (fd);
+
+    *lenp = st.st_size;
+    return (p);
+}
+
+/*
+ *  Use the hash table trailer of the index if present and consistent,
+ *   otherwise fall back to the entries written so far.
+ */
+static void _read_index (struct journal *j, const char *path)
+{
+    const struct journal_index_header *ih = (const void *) j->idx;
+    const struct journal_trailer *t;
+    size_t hdrlen = sizeof (*ih);
+    size_t esize = sizeof (struct journal_index_entry);
+
+    if (j->idxlen < hdrlen
+       || memcmp (ih->magic, JOURNAL_IDX_MAGIC, sizeof (ih->magic)) != 0
+       || ih->version != JOURNAL_VERSION
+       || ih->entry_size != esize)
+        errx ("%p: %s.idx: not a pdsh journal index\n", path);
+
+    j->entries = (const void *) (j->idx + hdrlen);
+    j->nentries = (j->idxlen - hdrlen) / esize;
+    j->table = NULL;
+    j->nbuckets = 0;
+
+    if (j->idxlen < hdrlen + sizeof (*t))
+        return;
+
+    t = (const void *) (j->idx + j->idxlen - sizeof (*t));
+    if (memcmp (t->magic, JOURNAL_TRAILER_MAGIC, sizeof (t->magic)) != 0)
+        return;
+
+    if (t->table_off != hdrlen + (uint64_t) t->nentries * esize
+       || t->nbuckets == 0
+       || (t->nbuckets & (t->nbuckets - 1)) != 0
+       || t->nbuckets < t->nentries
+       || t->table_off + (uint64_t) t->nbuckets * sizeof (uint32_t) 
+          + sizeof (*t) != j->idxlen)
+        errx ("%p: %s.idx: corrupt index trailer\n", path);
+
+    j->nentries = t->nentries;
+    j->table = (const void *) (j->idx + t->table_off);
+    j->nbuckets = t->nbuckets;
+}
+
+static void _journal_open (struct journal *j, const char *path)
+{
+    const struct journal_header *h;
+    char *idxpath = NULL;
+
+    xstrcat (&idxpath, (char *) path);
+    xstrcat (&idxpath, ".idx");
+
+    j->log = _map (path, &j->loglen);
+    j->idx = _map (idxpath, &j->idxlen);
+    Free ((void **) &idxpath);
+
+    h = (const void *) j->log;
+    if (j->loglen < sizeof (*h)
+       || memcmp (h->magic, JOURNAL_MAGIC, sizeof (h->magic)) != 0
+       || h->version != JOURNAL_VERSION)
+        errx ("%p: %s: not a pdsh journal\n", path);
+
+    _read_index (j, path);
+}
+
+/*
+ *  Return pointer to the name of host in entry `e' and set *lenp
+ *   to its length. Names are not NUL terminated.
+ */
+static const char * _entry_name (struct journal *j, 
+                                 const struct journal_index_entry *e,
+                                 size_t *lenp)
+{
+    if (e->name_off > j->loglen || e->name_len > j->loglen - e->name_off)
+        errx ("%p: corrupt journal index entry\n");
+    *lenp = e->name_len;
+    return (j->log + e->name_off);
+}
+
+static char * _entry_strdup (struct journal *j, 
+                             const struct journal_index_entry *e)
+{
+    size_t len;
+    const char *name = _entry_name (j, e, &len);
+    char *s = Malloc (len + 1);
+
+    memcpy (s, name, len);
+    s[len] = '\0';
+    return (s);
+}
+
+static int _name_matches (struct journal *j, 
+                          const struct journal_index_entry *e,
+                          const char *host, size_t hostlen)
+{
+    size_t len;
+    const char *name = _entry_name (j, e, &len);
+    return (len == hostlen && memcmp (name, host, len) == 0);
+}
+
+static const struct journal_index_entry *
+_lookup (struct journal *j, const char *host)
+{
+    size_t len = strlen (host);
+    uint32_t i;
+
+    if (j->table) {
+        uint32_t mask = j->nbuckets - 1;
+        uint32_t slot = digest_buf (host, len) & mask;
+
+        for (i = 0; i < j->nbuckets && j->table[slot]; i++) {
+            uint32_t n = j->table[slot] - 1;
+            if (n < j->nentries && _name_matches (j, &j->entries[n], host, len))
+                return (&j->entries[n]);
+            slot = (slot + 1) & mask;
+        }
+        return (NULL);
+    }
+
+    for (i = 0; i < j->nentries; i++) {
+        if (_name_matches (j, &j->entries[i], host, len))
+            return (&j->entries[i]);
+    }
+    return (NULL);
+}
+
+/*
+ *  Write output of host in entry `e' to `outfd', or to `errfd' for
+ *   data from stderr. The chain of chunks for the host is walked 
+ *   backwards from the last chunk, then written in order.
+ */
+static void _write_output (struct journal *j, 
+                           const struct journal_index_entry *e,
+                           int outfd, int errfd)
+{
+    uint64_t *chunks = NULL;
+    int maxchunks = 0;
+    int n = 0;
+    uint64_t off = e->last;
+
+    while (off != 0) {
+        const struct journal_record *r;
+
+        if (off < sizeof (struct journal_header) 
+           || (off & 7) != 0
+           || off > j->loglen - sizeof (*r))
+            errx ("%p: corrupt journal record at offset %d\n", (int) off);
+
+        r = (const void *) (j->log + off);
+        if (r->type != JOURNAL_REC_DATA 
+           || r->hostid != e->hostid
+           || r->len > j->loglen - off - sizeof (*r)
+           || r->prev >= off)
+            errx ("%p: corrupt journal record at offset %d\n", (int) off);
+
+        if (n == maxchunks) {
+            maxchunks = maxchunks ? 2 * maxchunks : 64;
+            if (chunks == NULL)
+                chunks = Malloc (maxchunks * sizeof (uint64_t));
+            else
+                Realloc ((void **) &chunks, maxchunks * sizeof (uint64_t));
+        }
+        chunks[n++] = off;
+        off = r->prev;
+    }
+
+    while (--n >= 0) {
+        const struct journal_record *r = (const void *) (j->log + chunks[n]);
+        int fd = (r->stream == OUTPUT_STDERR) ? errfd : outfd;
+
+        if (fd_write_n (fd, (void *) (r + 1), r->len) < 0)
+            errx ("%p: write: %m\n");
+    }
+
+    if (chunks)
+        Free ((void **) &chunks);
+}
+
+static void _print_hostlist (hostlist_t hl, const char *prefix)
+{
+    size_t len = 1024;
+    char *buf = Malloc (len);
+
+    hostlist_sort (hl);
+    while (hostlist_ranged_string (hl, len, buf) < 0) {
+        len *= 2;
+        Realloc ((void **) &buf, len);
+    }
+    printf ("%s%s\n", prefix, buf);
+    Free ((void **) &buf);
+}
+
+static void _push_entry (hostlist_t hl, struct journal *j,
+                         const struct journal_index_entry *e)
+{
+    char *host = _entry_strdup (j, e);
+    hostlist_push_host (hl, host);
+    Free ((void **) &host);
+}
+
+static void _list (struct journal *j)
+{
+    uint32_t i;
+
+    for (i = 0; i < j->nentries; i++) {
+        const struct journal_index_entry *e = &j->entries[i];
+        size_t len;
+        const char *name = _entry_name (j, e, &len);
+
+        printf ("%-20.*s %4d %10llu %12llu%s\n", (int) len, name, e->rc,
+                (unsigned long long) e->nlines,
+                (unsigned long long) e->nbytes,
+                (e->flags & JOURNAL_HOST_FAILED) ? " failed" : "");
+    }
+}
+
+static void _list_rc (struct journal *j, int rc)
+{
+    hostlist_t hl = hostlist_create (NULL);
+    uint32_t i;
+
+    for (i = 0; i < j->nentries; i++) {
+        if (j->entries[i].rc == rc)
+            _push_entry (hl, j, &j->entries[i]);
+    }
+    if (hostlist_count (hl) > 0)
+        _print_hostlist (hl, "");
+    hostlist_destroy (hl);
+}
+
+static int _cmp_rc (const void *x, const void *y)
+{
+    const struct journal_index_entry *a = *(const void **) x;
+    const struct journal_index_entry *b = *(const void **) y;
+    return ((a->rc > b->rc) - (a->rc < b->rc));
+}
+
+static void _group_by_rc (struct journal *j)
+{
+    const struct journal_index_entry **v;
+    uint32_t i, start;
+
+    if (j->nentries == 0)
+        return;
+
+    v = Malloc (j->nentries * sizeof (*v));
+    for (i = 0; i < j->nentries; i++)
+        v[i] = &j->entries[i];
+    qsort (v, j->nentries, sizeof (*v), _cmp_rc);
+
+    for (start = 0; start < j->nentries; start = i) {
+        hostlist_t hl = hostlist_create (NULL);
+        char prefix[32];
+
+        for (i = start; i < j->nentries && v[i]->rc == v[start]->rc; i++)
+            _push_entry (hl, j, v[i]);
+
+        snprintf (prefix, sizeof (prefix), "%d: ", v[start]->rc);
+        _print_hostlist (hl, prefix);
+        hostlist_destroy (hl);
+    }
+
+    Free ((void **) &v);
+}
+
+static int _cmp_name (const struct journal_index_entry *a,
+                      const struct journal_index_entry *b)
+{
+    size_t alen, blen;
+    const char *an = _entry_name (cmp_journal, a, &alen);
+    const char *bn = _entry_name (cmp_journal, b, &blen);
+    int rc = memcmp (an, bn, alen < blen ? alen : blen);
+
+    return (rc ? rc : (alen > blen) - (alen < blen));
+}
+
+/*
+ *  Order entries by content (digests and size), then by name
+ */
+static int _cmp_content (const void *x, const void *y)
+{
+    const struct journal_index_entry *a = *(const void **) x;
+    const struct journal_index_entry *b = *(const void **) y;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (a->digest[i] != b->digest[i])
+            return (a->digest[i] < b->digest[i] ? -1 : 1);
+    }
+    if (a->nbytes != b->nbytes)
+        return (a->nbytes < b->nbytes ? -1 : 1);
+    return (_cmp_name (a, b));
+}
+
+static int _same_content (const struct journal_index_entry *a,
+                          const struct journal_index_entry *b)
+{
+    return (a->digest[0] == b->digest[0] 
+         && a->digest[1] == b->digest[1] 
+         && a->nbytes == b->nbytes);
+}
+
+/*
+ *  Order groups (given by their first entry) by host name
+ */
+static int _cmp_group (const void *x, const void *y)
+{
+    const struct journal_index_entry *a = **(const void ***) x;
+    const struct journal_index_entry *b = **(const void ***) y;
+    return (_cmp_name (a, b));
+}
+
+/*
+ *  Print output of each set of hosts with identical output once,
+ *   in the style of dshbak -c. Hosts are grouped by digest and size
+ *   of output, so only the output of one host per group is read.
+ */
+static void _coalesce (struct journal *j)
+{
+    const struct journal_index_entry **v;
+    const struct journal_index_entry ***groups;
+    uint32_t i, ngroups = 0;
+
+    if (j->nentries == 0)
+        return;
+
+    v = Malloc ((j->nentries + 1) * sizeof (*v));
+    groups = Malloc (j->nentries * sizeof (*groups));
+    for (i = 0; i < j->nentries; i++)
+        v[i] = &j->entries[i];
+    v[j->nentries] = NULL;
+
+    cmp_journal = j;
+    qsort (v, j->nentries, sizeof (*v), _cmp_content);
+    for (i = 0; i < j->nentries; i++) {
+        if (i == 0 || !_same_content (v[i], v[i-1]))
+            groups[ngroups++] = &v[i];
+    }
+    qsort (groups, ngroups, sizeof (*groups), _cmp_group);
+
+    fflush (stdout);
+    for (i = 0; i < ngroups; i++) {
+        const struct journal_index_entry **e;
+        hostlist_t hl = hostlist_create (NULL);
+
+        for (e = groups[i]; *e && _same_content (*e, *groups[i]); e++)
+            _push_entry (hl, j, *e);
+
+        printf ("----------------\n");
+        _print_hostlist (hl, "");
+        printf ("----------------\n");
+        fflush (stdout);
+        _write_output (j, *groups[i], STDOUT_FILENO, STDOUT_FILENO);
+
+        hostlist_destroy (hl);
+    }
+
+    Free ((void **) &groups);
+    Free ((void **) &v);
+}
+
+int main (int argc, char *argv[])
+{
+    struct journal j;
+    const struct journal_index_entry *e;
+    char *host = NULL;
+    char *end;
+    int rc = 0;
+    int mode = 0;
+    int c;
+
+    err_init (xbasename (argv[0]));
+
+    while ((c = getopt (argc, argv, "hlecr:w:")) != EOF) {
+        switch (c) {
+        case 'r':
+            rc = strtol (optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0')
+                errx ("%p: invalid exit code \"%s\"\n", optarg);
+            break;
+        case 'w':
+            host = optarg;
+            break;
+        case 'l':
+        case 'e':
+        case 'c':
+            break;
+        default:
+            _usage ();
+        }
+        if (mode != 0)
+            errx ("%p: only one of -l, -e, -r, -w, -c may be given\n");
+        mode = c;
+    }
+
+    if (mode == 0 || optind != argc - 1)
+        _usage ();
+
+    _journal_open (&j, argv[optind]);
+
+    switch (mode) {
+    case 'l':
+        _list (&j);
+        break;
+    case 'e':
+        _group_by_rc (&j);
+        break;
+    case 'r':
+        _list_rc (&j, rc);
+        break;
+    case 'c':
+        _coalesce (&j);
+        break;
+    case 'w':
+        if ((e = _lookup (&j, host)) == NULL)
+            errx ("%p: %s: no such host in journal\n", host);
+        _write_output (&j, e, STDOUT_FILENO, STDERR_FILENO);
+        break;
+    }
+
+    return (0);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,327 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#if HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/common/fd.h"
+#include "src/common/macros.h"
+#include "spillbuf.h"
+
+#define SPILLBUF_DEFAULT_LIMIT  (64 * 1024 * 1024)
+#define SPILLBUF_MIN_CHUNK      1024
+#define SPILLBUF_MAX_CHUNK      (64 * 1024)
+
+/*
+ *  A spillbuf is a list of segments, each of which is either a chunk
+ *   of memory (mem != NULL) or an extent of the spill file.
+ */
+struct segment {
+    struct segment *next;
+    char *          mem;
+    size_t          size;       /* allocated size of mem                   */
+    off_t           off;        /* offset of extent in spill file          */
+    size_t          len;        /* bytes of data in segment                */
+};
+
+struct spillbuf {
+    struct segment *head;
+    struct segment *tail;
+    size_t          len;
+    size_t          chunksize;  /* size of next memory chunk               */
+    int             spilled;    /* segments in spill file                  */
+};
+
+static pthread_mutex_t spill_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t memory_limit = SPILLBUF_DEFAULT_LIMIT;
+static size_t memory_used = 0;
+static int    spill_fd = -1;
+static off_t  spill_off = 0;
+static int    spill_users = 0;  /* spillbufs with data in spill file       */
+
+void spillbuf_set_memory_limit (size_t bytes)
+{
+    pthread_mutex_lock (&spill_mutex);
+    memory_limit = bytes;
+    pthread_mutex_unlock (&spill_mutex);
+}
+
+spillbuf_t spillbuf_create (void)
+{
+    spillbuf_t sb = Malloc (sizeof (*sb));
+
+    sb->head = sb->tail = NULL;
+    sb->len = 0;
+    sb->chunksize = SPILLBUF_MIN_CHUNK;
+    sb->spilled = 0;
+
+    return (sb);
+}
+
+void spillbuf_destroy (spillbuf_t sb)
+{
+    struct segment *s;
+    size_t freed = 0;
+
+    while ((s = sb->head)) {
+        sb->head = s->next;
+        if (s->mem) {
+            freed += s->size;
+            Free ((void **) &s->mem);
+        }
+        Free ((void **) &s);
+    }
+
+    pthread_mutex_lock (&spill_mutex);
+    memory_used -= freed;
+    /*
+     *  Reclaim spill file space once no spillbuf refers to it
+     */
+    if (sb->spilled && --spill_users == 0 && spill_fd >= 0) {
+        if (ftruncate (spill_fd, 0) == 0)
+            spill_off = 0;
+    }
+    pthread_mutex_unlock (&spill_mutex);
+
+    Free ((void **) &sb);
+}
+
+size_t spillbuf_len (spillbuf_t sb)
+{
+    return (sb->len);
+}
+
+static struct segment * _segment_append (spillbuf_t sb)
+{
+    struct segment *s = Malloc (sizeof (*s));
+
+    memset (s, 0, sizeof (*s));
+    if (sb->tail)
+        sb->tail->next = s;
+    else
+        sb->head = s;
+    sb->tail = s;
+
+    return (s);
+}
+
+/*
+ *  Open temporary spill file. Must be called with spill_mutex held.
+ */
+static int _spill_open (void)
+{
+    const char *dir = getenv ("TMPDIR");
+    char *path = NULL;
+    int fd;
+
+    if (dir == NULL || *dir == '\0')
+        dir = "/tmp";
+
+    xstrcat (&path, (char *) dir);
+    xstrcat (&path, "/pdsh-spill.XXXXXX");
+
+    if ((fd = mkstemp (path)) >= 0) {
+        unlink (path);
+        fd_set_close_on_exec (fd);
+    }
+    Free ((void **) &path);
+
+    return (fd);
+}
+
+static int _pwrite_n (int fd, const void *buf, size_t n, off_t off)
+{
+    const char *p = buf;
+
+    while (n > 0) {
+        ssize_t nw = pwrite (fd, p, n, off);
+        if (nw < 0) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        p += nw;
+        off += nw;
+        n -= nw;
+    }
+    return (0);
+}
+
+/*
+ *  Append data to spill file, extending the last extent of `sb' if
+ *   it ends at the current end of the file.
+ */
+static int _spill (spillbuf_t sb, const void *data, size_t len)
+{
+    struct segment *s = sb->tail;
+    int rc = 0;
+
+    pthread_mutex_lock (&spill_mutex);
+
+    if (spill_fd < 0 && (spill_fd = _spill_open ()) < 0) {
+        rc = -1;
+        goto out;
+    }
+
+    if (_pwrite_n (spill_fd, data, len, spill_off) < 0) {
+        rc = -1;
+        goto out;
+    }
+
+    if (s == NULL || s->mem != NULL || s->off + s->len != spill_off) {
+        s = _segment_append (sb);
+        s->off = spill_off;
+        if (sb->spilled++ == 0)
+            spill_users++;
+    }
+    s->len += len;
+    spill_off += len;
+
+out:
+    pthread_mutex_unlock (&spill_mutex);
+    return (rc);
+}
+
+/*
+ *  Allocate a new memory chunk for `sb' if the memory budget allows.
+ */
+static struct segment * _chunk_alloc (spillbuf_t sb)
+{
+    struct segment *s;
+    size_t size = sb->chunksize;
+    int ok;
+
+    pthread_mutex_lock (&spill_mutex);
+    if ((ok = (memory_used + size <= memory_limit)))
+        memory_used += size;
+    pthread_mutex_unlock (&spill_mutex);
+
+    if (!ok)
+        return (NULL);
+
+    s = _segment_append (sb);
+    s->mem = Malloc (size);
+    s->size = size;
+
+    if (sb->chunksize < SPILLBUF_MAX_CHUNK)
+        sb->chunksize *= 2;
+
+    return (s);
+}
+
+int spillbuf_append (spillbuf_t sb, const void *data, size_t len)
+{
+    const char *p = data;
+
+    while (len > 0) {
+        struct segment *s = sb->tail;
+        size_t n;
+
+        if ((s == NULL || s->mem == NULL || s->len == s->size)
+           && !(s = _chunk_alloc (sb))) {
+            if (_spill (sb, p, len) < 0)
+                return (-1);
+            sb->len += len;
+            return (0);
+        }
+
+        n = MIN (len, s->size - s->len);
+        memcpy (s->mem + s->len, p, n);
+        s->len += n;
+        sb->len += n;
+        p += n;
+        len -= n;
+    }
+
+    return (0);
+}
+
+/*
+ *  Write extent of spill file to `fd' through a temporary mapping.
+ */
+static int _write_extent (struct segment *s, int fd)
+{
+    size_t pagesize = (size_t) sysconf (_SC_PAGESIZE);
+    off_t start = s->off - (s->off % pagesize);
+    size_t maplen = s->len + (s->off - start);
+    void *map;
+    int rc = 0;
+
+    map = mmap (NULL, maplen, PROT_READ, MAP_SHARED, spill_fd, start);
+    if (map == MAP_FAILED)
+        return (-1);
+
+    if (fd_write_n (fd, (char *) map + (s->off - start), s->len) < 0)
+        rc = -1;
+
+    munmap (map, maplen);
+    return (rc);
+}
+
+int spillbuf_write (spillbuf_t sb, int fd)
+{
+    struct segment *s;
+
+    for (s = sb->head; s != NULL; s = s->next) {
+        if (s->len == 0)
+            continue;
+        if (s->mem) {
+            if (fd_write_n (fd, s->mem, s->len) < 0)
+                return (-1);
+        }
+        else if (_write_extent (s, fd) < 0)
+            return (-1);
+    }
+
+    return (0);
+}
+
+void spillbuf_fini (void)
+{
+    pthread_mutex_lock (&spill_mutex);
+    if (spill_fd >= 0)
+        close (spill_fd);
+    spill_fd = -1;
+    spill_off = 0;
+    pthread_mutex_unlock (&spill_mutex);
+}
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
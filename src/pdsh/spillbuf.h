@@ -0,0 +1,84 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2001-2006 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Mark Grondona <mgrondona@llnl.gov>.
+ *  UCRL-CODE-2003-005.
+ *  
+ *  This file is part of Pdsh, a parallel remote shell program.
+ *  For details, see <http://www.llnl.gov/linux/pdsh/>.
+ *  
+ *  Pdsh is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *  
+ *  Pdsh is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *  
+ *  You should have received a copy of the GNU General Public License along
+ *  with Pdsh; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA.
+\*****************************************************************************/
+
+/*
+ *  Spillbuf: append-only byte buffers which share a single memory
+ *   budget. Once the budget is exhausted, further data appended to any
+ *   spillbuf is written to a shared, unlinked temporary file instead,
+ *   and mapped back into memory when the buffer is written out. Data
+ *   is always returned in the order in which it was appended.
+ *
+ *  Functions are thread-safe, though a single spillbuf must not be
+ *   used by more than one thread at a time.
+ */
+
+#ifndef _HAVE_SPILLBUF_H
+#define _HAVE_SPILLBUF_H
+
+#include <sys/types.h>
+
+typedef struct spillbuf * spillbuf_t;
+
+/*
+ *  Set the number of bytes of memory which may be used by all spillbufs
+ *   together before data is spilled to disk. Default is 64MB.
+ */
+void spillbuf_set_memory_limit (size_t bytes);
+
+spillbuf_t spillbuf_create (void);
+
+/*
+ *  Destroy spillbuf `sb', returning its memory to the shared budget.
+ */
+void spillbuf_destroy (spillbuf_t sb);
+
+/*
+ *  Append `len' bytes from `data' to `sb'. Returns 0 on success, or -1
+ *   with errno set if the data could not be spilled to disk.
+ */
+int spillbuf_append (spillbuf_t sb, const void *data, size_t len);
+
+/*
+ *  Return the number of bytes held in `sb'.
+ */
+size_t spillbuf_len (spillbuf_t sb);
+
+/*
+ *  Write all data in `sb' to `fd'. Returns 0 on success, -1 on failure.
+ */
+int spillbuf_write (spillbuf_t sb, int fd);
+
+/*
+ *  Close the temporary spill file, if any. All spillbufs must have been
+ *   destroyed.
+ */
+void spillbuf_fini (void);
+
+#endif /* !_HAVE_SPILLBUF_H */
+
+/*
+ * vi: tabstop=4 shiftwidth=4 expandtab
+ */
@@ -45,6 +45,8 @@
 #include "src/common/xstring.h"
 #include "src/common/pipecmd.h"
 #include "src/common/fd.h"
+#include "src/common/digest.h"
+#include "src/common/hostlist.h"
 #include "dsh.h"
 
 typedef enum { FAIL, PASS } testresult_t;
@@ -56,10 +58,14 @@ typedef struct {
 
 static testresult_t _test_xstrerrorcat(void);
 static testresult_t _test_pipecmd(void);
+static testresult_t _test_digest(void);
+static testresult_t _test_hostlist(void);
 
 static testcase_t testcases[] = {
     /* 0 */ {"xstrerrorcat", &_test_xstrerrorcat},
     /* 1 */ {"pipecmd",      &_test_pipecmd},
+    /* 2 */ {"digest",       &_test_digest},
+    /* 3 */ {"hostlist",     &_test_hostlist},
 };
 
 static void _testmsg(int testnum, testresult_t result)
@@ -116,6 +122,170 @@ static testresult_t _test_pipecmd(void)
     return PASS;
 }
 
+static testresult_t _test_digest(void)
+{
+    static const struct {
+        const char *s;
+        uint64_t digest;
+    } vectors[] = {
+        { "",    0xef46db3751d8e999ULL },
+        { "a",   0xd24ec4f1a98c6e5bULL },
+        { "abc", 0x44bc2cf5ad770999ULL },
+        { "Nobody inspects the spammish repetition", 0xfbcea83c8a378bf1ULL },
+    };
+    testresult_t result = PASS;
+    struct digest d;
+    char buf [1000];
+    int i, n;
+
+    for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); i++) {
+        uint64_t h = digest_buf (vectors[i].s, strlen (vectors[i].s));
+        if (h != vectors[i].digest) {
+            err ("testcase: digest (\"%s\") = %llx (should be %llx)\n",
+                 vectors[i].s, (unsigned long long) h,
+                 (unsigned long long) vectors[i].digest);
+            result = FAIL;
+        }
+    }
+
+    /*
+     *  Incremental digest must not depend on how input is split
+     */
+    for (i = 0; i < sizeof (buf); i++)
+        buf[i] = (char) (i * 7);
+
+    digest_init (&d);
+    for (i = 0; i < sizeof (buf); i += n) {
+        n = MIN ((i % 37) + 1, sizeof (buf) - i);
+        digest_update (&d, buf + i, n);
+    }
+    if (digest_final (&d) != digest_buf (buf, sizeof (buf))) {
+        err ("testcase: incremental digest mismatch\n");
+        result = FAIL;
+    }
+
+    return result;
+}
+
+/*
+ *  Position of the first `host' in `hl', found the slow way
+ */
+static int _hostlist_scan(hostlist_t hl, const char *host)
+{
+    int i, n = hostlist_count(hl);
+
+    for (i = 0; i < n; i++) {
+        char *h = hostlist_nth(hl, i);
+        int match = strcmp(h, host) == 0;
+        free(h);
+        if (match)
+            return (i);
+    }
+    return (-1);
+}
+
+static int _hostlist_equal(hostlist_t h1, hostlist_t h2)
+{
+    int i, n = hostlist_count(h1);
+
+    if (hostlist_count(h2) != n)
+        return (0);
+    for (i = 0; i < n; i++) {
+        char *s1 = hostlist_nth(h1, i);
+        char *s2 = hostlist_nth(h2, i);
+        int match = strcmp(s1, s2) == 0;
+        free(s1);
+        free(s2);
+        if (!match)
+            return (0);
+    }
+    return (1);
+}
+
+static void _random_host(char *buf, size_t len)
+{
+    static const char *fmt[] = { "n%d", "n%03d", "n0%d", "x%02d", "y" };
+    snprintf(buf, len, fmt[rand() % 5], rand() % 12);
+}
+
+static testresult_t _test_hostlist(void)
+{
+    testresult_t result = PASS;
+    hostlist_t hl = hostlist_create("foo[1-5],f00[1-3]");
+    char host[64];
+    int i, j;
+
+    /*
+     *  A host matches only ranges with its prefix, which may take
+     *   leading digits of its suffix
+     */
+    if (hostlist_delete_host(hl, "f3") != 0
+        || hostlist_find(hl, "f3") != -1 || hostlist_find(hl, "fo3") != -1
+        || hostlist_find(hl, "foo3") != 2 || hostlist_find(hl, "f002") != 6) {
+        err("testcase: hostlist_find: wrong position for prefix match\n");
+        result = FAIL;
+    }
+    hostlist_destroy(hl);
+
+    /*
+     *  Each host deleted removes its first remaining copy
+     */
+    hl = hostlist_create("n[1-3],n1,x,n[1-2],y[1-9]");
+    if (hostlist_delete(hl, "n1,n1,n2,x,x,y[1-5]") != 9
+        || hostlist_ranged_string(hl, sizeof(host), host) < 0
+        || strcmp(host, "n[3,1-2],y[6-9]") != 0) {
+        err("testcase: hostlist_delete: duplicates not deleted in order\n");
+        result = FAIL;
+    }
+    hostlist_destroy(hl);
+
+    /*
+     *  Indexed lookups and bulk deletes must match a linear search
+     */
+    srand(1);
+    for (i = 0; i < 200; i++) {
+        hostlist_t ref, dl;
+
+        hl = hostlist_create(NULL);
+        dl = hostlist_create(NULL);
+        for (j = rand() % 100; j > 0; j--) {
+            _random_host(host, sizeof(host));
+            hostlist_push_host(hl, host);
+        }
+        if (i % 3 == 0)
+            hostlist_sort(hl);
+        for (j = rand() % 30; j > 0; j--) {
+            _random_host(host, sizeof(host));
+            hostlist_push_host(dl, host);
+            if (hostlist_find(hl, host) != _hostlist_scan(hl, host)) {
+                err("testcase: hostlist_find (\"%s\") = %d (should be %d)\n",
+                    host, hostlist_find(hl, host), _hostlist_scan(hl, host));
+                result = FAIL;
+            }
+        }
+
+        ref = hostlist_copy(hl);
+        for (j = 0; j < hostlist_count(dl); j++) {
+            char *h = hostlist_nth(dl, j);
+            int n = _hostlist_scan(ref, h);
+            if (n >= 0)
+                hostlist_delete_nth(ref, n);
+            free(h);
+        }
+        hostlist_delete_list(hl, dl);
+        if (!_hostlist_equal(hl, ref)) {
+            err("testcase: hostlist_delete_list: lists differ\n");
+            result = FAIL;
+        }
+
+        hostlist_destroy(ref);
+        hostlist_destroy(dl);
+        hostlist_destroy(hl);
+    }
+
+    return result;
+}
+
 void testcase(int testnum)
 {
     testresult_t result;
@@ -0,0 +1,51 @@
+#!/bin/sh
+#
+#  Micro-benchmark of pdsh output formatting: run a command printing
+#   many short lines on several hosts with the exec rcmd module and
+#   report lines per second written by pdsh. This is not part of the
+#   test suite.
+#
+#  Usage: output-bench.sh [PDSH...]
+#
+#   Each PDSH given (default: the pdsh in the build tree) is run in
+#   turn, so the output of two builds may be compared, e.g.
+#
+#     output-bench.sh /path/to/old/pdsh ../src/pdsh/pdsh
+#
+#  Environment:
+#    BENCH_HOSTS  number of hosts (default 8)
+#    BENCH_LINES  lines of output per host (default 500000)
+#    BENCH_RUNS   runs of each pdsh, the best is reported (default 3)
+#    BENCH_ARGS   extra pdsh arguments, e.g. "-o group" or "-N"
+#
+
+hosts=${BENCH_HOSTS:-8}
+lines=${BENCH_LINES:-500000}
+runs=${BENCH_RUNS:-3}
+srcdir=${srcdir:-$(dirname "$0")}
+
+if test $# -eq 0; then
+	set -- "$srcdir/../src/pdsh/pdsh"
+fi
+
+total=$((hosts * lines))
+
+now () {
+	date +%s.%N
+}
+
+for pdsh in "$@"; do
+	best=
+	i=0
+	while test $i -lt $runs; do
+		start=$(now)
+		PDSH_RCMD_TYPE=exec "$pdsh" -f $hosts -w bench[1-$hosts] $BENCH_ARGS \
+		  seq $lines >/dev/null || exit 1
+		end=$(now)
+		best=$(awk "BEGIN { t = $end - $start; b = \"$best\";
+		                    print (b == \"\" || t < b + 0) ? t : b }")
+		i=$((i + 1))
+	done
+	awk "BEGIN { printf \"%-40s %10d lines %8.3fs %12.0f lines/sec\\n\",
+	                    \"$pdsh\", $total, $best, $total / $best }"
+done
@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+#  Benchmark of pdcp file data throughput: copy a large file to several
+#   hosts on the local node and report MB/s and CPU time per byte for
+#   pdcp and its remote servers together. Hosts are subdirectories of
+#   the benchmark directory, reached with the pcptest rcmd module from
+#   tests/test-modules (the pdcp equivalent of "pdsh -R exec"), so the
+#   tests must have been built with "make check". Run from the tests
+#   directory of the build tree, as a user other than root (pdsh ignores
+#   PDSH_MODULE_DIR for root). This is not part of the test suite.
+#
+#  Usage: pdcp-bench.sh [PDSH...]
+#
+#   Each PDSH binary given (default: the pdsh in the build tree) is run
+#   as both pdcp and remote pdcp server, so that two builds may be
+#   compared, e.g.
+#
+#     pdcp-bench.sh /path/to/old/pdsh ../src/pdsh/pdsh
+#
+#  Environment:
+#    BENCH_SIZE   size of file copied in MB (default 2048)
+#    BENCH_HOSTS  number of hosts (default 2)
+#    BENCH_RUNS   runs of each pdcp, the best is reported (default 3)
+#    BENCH_ARGS   extra pdcp arguments, e.g. "-o source-cache"
+#    BENCH_DIR    directory for source file and hosts (default: under
+#                 TMPDIR or /tmp)
+#
+
+size=${BENCH_SIZE:-2048}
+hosts=${BENCH_HOSTS:-2}
+runs=${BENCH_RUNS:-3}
+cwd=$(pwd)
+modules=$cwd/test-modules
+
+if test $# -eq 0; then
+	set -- ../src/pdsh/pdsh
+fi
+
+dir=${BENCH_DIR:-$(mktemp -d ${TMPDIR:-/tmp}/pdcp-bench.XXXXXX)} || exit 1
+trap 'rm -rf "$dir"' 0 INT TERM
+cd "$dir" || exit 1
+
+echo "pdcp-bench: creating ${size}M source file in $dir" >&2
+dd if=/dev/urandom of=src bs=1048576 count=$size 2>/dev/null || exit 1
+
+total=$((size * 1048576 * hosts))
+
+#
+#  Convert output of the "times" builtin for children, e.g.
+#   "0m1.25s 0m3.50s", to seconds of user + system time
+#
+cpu_seconds () {
+	echo "$@" | awk '{ 
+	    for (i = 1; i <= 2; i++) {
+	        split ($i, t, "m"); sub ("s", "", t[2]); s += t[1] * 60 + t[2]
+	    }
+	    print s }'
+}
+
+for pdsh in "$@"; do
+	case $pdsh in
+	/*) path=$pdsh ;;
+	*)  path=$cwd/$pdsh ;;
+	esac
+	rm -rf bin && mkdir bin && ln -s "$path" bin/pdcp
+	best=
+	i=0
+	while test $i -lt $runs; do
+		rm -rf host* && mkdir $(seq -f "host%g" 1 $hosts)
+		sync
+		result=$(
+		    start=$(date +%s.%N)
+		    PDSH_MODULE_DIR=$modules bin/pdcp -Rpcptest -e "$dir/bin/pdcp" \
+		      -f $hosts -w "host[1-$hosts]" $BENCH_ARGS src src || exit 1
+		    end=$(date +%s.%N)
+		    times >times.out
+		    echo "$start $end") || exit 1
+		set -- $result
+		elapsed=$(awk "BEGIN { print $2 - $1 }")
+		cpu=$(cpu_seconds $(tail -1 times.out))
+		best=$(awk "BEGIN { b = \"$best\"; 
+		                    print (b == \"\" || $elapsed < b + 0) ? \"$elapsed $cpu\" : b }")
+		i=$((i + 1))
+	done
+	set -- $best
+	awk "BEGIN { printf \"%-40s %6d MB %8.3fs %9.1f MB/s %8.3f ns/byte cpu\\n\",
+	             \"$pdsh\", $total / 1048576, $1, $total / 1048576 / $1,
+	             $2 * 1e9 / $total }"
+done
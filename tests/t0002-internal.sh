@@ -12,4 +12,10 @@ test_expect_success 'working xstrerrorcat' '
 test_expect_success 'working pipecmd' '
 	pdsh -T1
 '
+test_expect_success 'working digest' '
+	pdsh -T2 | grep PASS
+'
+test_expect_success 'working hostlist index' '
+	pdsh -T3 | grep PASS
+'
 test_done
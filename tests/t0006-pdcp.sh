@@ -146,4 +146,497 @@ test_expect_success DYNAMIC_MODULES,NOTROOT 'rpdcp -r works' '
 	pdsh -SRexec -w "$HOSTS" diff -r tree output/tree.%h >/dev/null
 '
 
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -r -p copies wide and deep trees' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* wide" &&
+	for i in $(seq 1 20); do
+	    mkdir -p wide/d$i/a/b wide/d$i/c &&
+	    echo $i >wide/d$i/f &&
+	    echo $i >wide/d$i/a/b/f &&
+	    echo $i >wide/d$i/c/f || return 1
+	done &&
+	touch -d "2001-01-01" wide/d7/a/b wide/d7/a wide/d7 wide &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -p -r wide . &&
+	pdsh -SRexec -w "$HOSTS" diff -r wide %h/wide >/dev/null &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/wide/d7/a/b -nt wide/d7/a/b &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/wide/d7 -nt wide/d7 &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/wide -nt wide
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -r fails on unreadable subdirectory' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "chmod 755 locked/sub && rm -rf host* locked err" &&
+	mkdir -p locked/sub &&
+	chmod 000 locked/sub &&
+	test_must_fail env PDSH_MODULE_DIR=$T \
+	    pdcp -Rpcptest -w "$HOSTS" -r locked . 2>err &&
+	grep "opendir: locked/sub" err
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'rpdcp -o hostdir -o dedup links identical files' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* output ino" &&
+	pdsh -SRexec -w "$HOSTS" cp -r tree %h/ &&
+	pdsh -SRexec -w "$HOSTS" sh -c "echo %h >%h/tree/bar/host" &&
+	mkdir output &&
+	for o in "" "-o pipeline" "-o archive"; do
+	    PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -r $o \
+	        -o hostdir -o dedup tree output/ &&
+	    pdsh -SRexec -w "$HOSTS" diff -r %h/tree output/%h/tree >/dev/null &&
+	    ls -i output/host*/tree/dir/data | sed "s/ .*//" | sort -u >ino &&
+	    test $(wc -l <ino) -eq 1 &&
+	    ls -i output/host*/tree/bar/host | sed "s/ .*//" | sort -u >ino &&
+	    test $(wc -l <ino) -eq 4 || return 1
+	done
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'rpdcp -o dedup does not link files whose key only matches' '
+	HOSTS="host[0-1]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* output" &&
+	pdsh -SRexec -w "$HOSTS" cp -r tree %h/ &&
+	mkdir output &&
+	PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -r \
+	    -o hostdir -o dedup tree output/ &&
+	obj=$(find output/.pdcp-store -type f -samefile output/host0/tree/dir/data) &&
+	test -n "$obj" &&
+	head -c 1024 /dev/zero >output/forged &&
+	mv output/forged "$obj" &&
+	for o in "" "-o archive"; do
+	    rm -rf output/host* &&
+	    PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -r $o \
+	        -o hostdir -o dedup tree output/ &&
+	    pdsh -SRexec -w "$HOSTS" diff -r %h/tree output/%h/tree >/dev/null &&
+	    test ! output/host0/tree/dir/data -ef "$obj" || return 1
+	done
+'
+test_expect_success 'rpdcp -o dedup is rejected with -o sync' '
+	rpdcp -w foo -o sync -o dedup x . 2>&1 | grep "cannot be used"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp copies empty and large files' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* empty large" &&
+	: >empty &&
+	create_random_file large 20000 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" empty large . &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP empty %h/empty &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP large %h/large
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o source-cache works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* testfile" &&
+	create_random_file testfile 3000 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o source-cache \
+	  testfile testfile &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP testfile %h/testfile
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp source-cache smaller than file' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* testfile" &&
+	create_random_file testfile 3000 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -f 4 \
+	  -o source-cache=1M testfile testfile &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP testfile %h/testfile
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp sends files as stat-ed and warns if they change' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* grow grow.orig grow-pdcp err" &&
+	create_random_file grow 100 &&
+	cp grow grow.orig &&
+	cat >grow-pdcp <<-EOF &&
+	#!$SHELL_PATH
+	cat ../grow.orig >>../grow
+	exec "$(pwd)/pdcp" "\$@"
+	EOF
+	chmod +x grow-pdcp &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -e "$(pwd)/grow-pdcp" \
+	  grow . 2>err &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP grow.orig %h/grow &&
+	grep "warning: grow changed during copy" err
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -r -o source-cache works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host*" &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o source-cache -r tree . &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree %h/tree >/dev/null
+'
+test_expect_success 'pdcp -o source-cache rejects small size' '
+	test_must_fail pdcp -w foo -o source-cache=4k -q err /tmp 2>err &&
+	grep "size must be at least 1M" err &&
+	pdcp -w foo -o source-cache=2M -q err /tmp | 
+	  grep "Shared source cache.*2097152"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -r -o pipeline works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host*" &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o pipeline=2 -p -r tree . &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree %h/tree >/dev/null &&
+	pdsh -SRexec -w "$HOSTS" test -x tree/baz/exec.sh
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'rpdcp -r -o pipeline works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* output" &&
+	pdsh -SRexec -w "$HOSTS" cp -r tree %h/ &&
+	mkdir output &&
+	PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -o pipeline=1 -p -r tree output/ &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree output/tree.%h >/dev/null
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o pipeline reports errors' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* a b c err" &&
+	create_random_file a 100 &&
+	create_random_file b 100 &&
+	create_random_file c 100 &&
+	pdsh -SRexec -w "$HOSTS" mkdir %h/b &&
+	test_might_fail env PDSH_MODULE_DIR=$T \
+	  pdcp -Rpcptest -w "$HOSTS" -o pipeline a b c . 2>err &&
+	test $(grep -c "host[0-3]: fatal: .*b: Is a directory" err) = 4 &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP a %h/a &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP c %h/c
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o pipeline -p sets times after writing many files' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* many" &&
+	mkdir -p many/sub &&
+	for i in $(seq 1 200); do echo $i >many/sub/f$i || return 1; done &&
+	touch -d "2001-01-01" many/sub many &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o pipeline -p -r many . &&
+	pdsh -SRexec -w "$HOSTS" diff -r many %h/many >/dev/null &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/many/sub -nt many/sub &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/many -nt many
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o pipeline stops only the host which fails' '
+	HOSTS="host[0-1]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "chmod 755 host0; rm -rf host* pt err" &&
+	mkdir -p pt/sub &&
+	for f in f1 f2 sub/g1 sub/g2 sub/g3; do echo $f >pt/$f || return 1; done &&
+	chmod 555 host0 &&
+	for i in $(seq 1 10); do
+	    rm -rf host1/pt &&
+	    test_might_fail env PDSH_MODULE_DIR=$T \
+	      pdcp -Rpcptest -w "$HOSTS" -o pipeline=1 -r pt . 2>err &&
+	    diff -r pt host1/pt &&
+	    grep "host0:" err || return 1
+	done
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp reports a remote pdcp which rejects -o options' '
+	setup_host_dirs host0 &&
+	test_when_finished "rm -rf host* oldpdcp f err" &&
+	echo f >f &&
+	printf "#!/bin/sh\necho invalid option >&2\nexit 1\n" >oldpdcp &&
+	chmod +x oldpdcp &&
+	for o in pipeline archive; do
+	    test_might_fail env PDSH_MODULE_DIR=$T pdcp -Rpcptest -w host0 \
+	      -e "$(pwd)/oldpdcp" -o $o f . 2>err &&
+	    grep "host0: remote pdcp exited before the copy started" err || 
+	      return 1
+	done
+'
+test_expect_success 'pdcp -o pipeline checks window' '
+	test_must_fail pdcp -w foo -o pipeline=0 -q err /tmp 2>err &&
+	grep "window must be between 1 and 64" err &&
+	pdcp -w foo -o pipeline=8 -q err /tmp | grep "Pipeline window.*8 records"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -r -o archive works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host*" &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o archive -p -r tree . &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree %h/tree >/dev/null &&
+	pdsh -SRexec -w "$HOSTS" test -x tree/baz/exec.sh &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/tree/dir -nt tree/dir
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o archive copies file to new name' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host*" &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o archive tree/foo copy &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP tree/foo %h/copy
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'rpdcp -r -o archive works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* output" &&
+	pdsh -SRexec -w "$HOSTS" cp -r tree %h/ &&
+	mkdir output &&
+	PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -o archive -r tree output/ &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree output/tree.%h >/dev/null
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o archive reports errors' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* a b c err" &&
+	create_random_file a 100 &&
+	create_random_file b 100 &&
+	create_random_file c 100 &&
+	pdsh -SRexec -w "$HOSTS" mkdir %h/b &&
+	test_might_fail env PDSH_MODULE_DIR=$T \
+	  pdcp -Rpcptest -w "$HOSTS" -o archive a b c . 2>err &&
+	test $(grep -c "host[0-3]: fatal: .*b: Is a directory" err) = 4 &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP a %h/a &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP c %h/c
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o sync sends only changed files' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* sync" &&
+	cp -r tree sync &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o sync -r sync . &&
+	pdsh -SRexec -w "$HOSTS" diff -r sync %h/sync >/dev/null &&
+	pdsh -SRexec -w "$HOSTS" touch -t 200001010000 %h/sync/foo %h/sync/bar/zzz &&
+	echo changed >sync/bar/zzz &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o sync -r sync . &&
+	pdsh -SRexec -w "$HOSTS" diff -r sync %h/sync >/dev/null &&
+	pdsh -SRexec -w "$HOSTS" test %h/sync/foo -ot sync/foo &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/sync/bar/zzz -ot sync/bar/zzz
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o sync updates changed blocks' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* large" &&
+	create_random_file large 2000 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o sync large . &&
+	printf XXXX | dd of=large bs=1 seek=1000000 conv=notrunc 2>/dev/null &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o sync -p large . &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP large %h/large &&
+	dd if=large of=large.new bs=1024 count=1500 2>/dev/null &&
+	mv large.new large &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o sync large . &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP large %h/large
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o resume completes partial files' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* big" &&
+	create_random_file big 2000 &&
+	head -c 300000 big >host0/big &&
+	head -c 1500000 big >host1/big &&
+	printf XXXX | dd of=host1/big bs=1 seek=1000 conv=notrunc 2>/dev/null &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -p -o resume big . &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP big %h/big &&
+	pdsh -SRexec -w "$HOSTS" test ! %h/big -nt big
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o resume=journal skips completed hosts' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* journal f" &&
+	echo foo >f &&
+	mkdir host3/f &&
+	test_might_fail env PDSH_MODULE_DIR=$T \
+	    pdcp -Rpcptest -w "$HOSTS" -o resume=journal f . &&
+	grep "^host2\$" journal &&
+	test_must_fail grep "^host3\$" journal &&
+	rm host2/f &&
+	rmdir host3/f &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o resume=journal f . &&
+	test ! -f host2/f &&
+	$GIT_TEST_CMP f host3/f &&
+	touch -d "2001-01-01" f &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o resume=journal f . &&
+	$GIT_TEST_CMP f host2/f
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'rpdcp -r -o sync works' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* output" &&
+	pdsh -SRexec -w "$HOSTS" cp -r tree %h/ &&
+	mkdir output &&
+	PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -o sync -r tree output/ &&
+	PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -o sync -r tree output/ &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree output/tree.%h >/dev/null
+'
+
+pdcp -w foo -o compress -q x /tmp 2>&1 | grep "without zlib" >/dev/null ||
+    test_set_prereq ZLIB
+
+test_expect_success DYNAMIC_MODULES,NOTROOT,ZLIB 'pdcp -r -o compress works' '
+	HOSTS="host[0-10]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* ztree" &&
+	cp -r tree ztree &&
+	create_random_file ztree/random 1500 &&
+	seq 1 400000 >ztree/text &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o compress -r ztree . &&
+	pdsh -SRexec -w "$HOSTS" diff -r ztree %h/ztree >/dev/null
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT,ZLIB 'pdcp -o compress with pipeline and archive' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* ztree" &&
+	cp -r tree ztree &&
+	seq 1 400000 >ztree/text &&
+	for mode in pipeline=2 archive sync; do
+	    PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o compress \
+	      -o $mode -p -r ztree . &&
+	    pdsh -SRexec -w "$HOSTS" diff -r ztree %h/ztree >/dev/null &&
+	    pdsh -SRexec -w "$HOSTS" rm -rf %h/ztree || return 1
+	done
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT,ZLIB 'rpdcp -r -o compress works' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* output ino" &&
+	pdsh -SRexec -w "$HOSTS" cp -r tree %h/ &&
+	pdsh -SRexec -w "$HOSTS" sh -c "seq 1 400000 >%h/tree/text" &&
+	mkdir output &&
+	PDSH_MODULE_DIR=$T rpdcp -Rpcptest -w "$HOSTS" -o compress -r tree output/ &&
+	pdsh -SRexec -w "$HOSTS" diff -r host0/tree output/tree.%h >/dev/null
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -r -o chain works' '
+	HOSTS="host[0-9]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host*" &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o chain=3 -p -r tree . &&
+	pdsh -SRexec -w "$HOSTS" diff -r tree %h/tree >/dev/null
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o chain reports errors from later hosts' '
+	HOSTS="host[0-5]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host*" &&
+	mkdir -p host4/tree/foo &&
+	PDSH_MODULE_DIR=$T test_might_fail pdcp -Rpcptest -w "$HOSTS" \
+	  -o chain=2 -r tree . 2>err &&
+	grep "host3: fatal: host4: .*Is a directory" err &&
+	pdsh -SRexec -w "host[0-3,5]" diff -r tree %h/tree >/dev/null
+'
+test_expect_success 'pdcp -o chain is rejected with -o sync' '
+	pdcp -w foo -o chain -o sync tree /tmp 2>&1 | grep "cannot be used"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o rate limits the aggregate send rate' '
+	HOSTS="host[0-2]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* testfile err" &&
+	create_random_file testfile 300 &&
+	start=$(date +%s) &&
+	PDSH_MODULE_DIR=$T pdcp -d -Rpcptest -w "$HOSTS" -o rate=300K/s \
+	  -o host-rate=1M testfile testfile 2>err &&
+	test $(($(date +%s) - start)) -ge 2 &&
+	grep "^Send rate:" err &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP testfile %h/testfile
+'
+test_expect_success 'pdcp -o rate is rejected with rpdcp' '
+	rpdcp -w foo -o rate=1M /tmp/foo /tmp 2>&1 | grep "cannot be used"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o sparse keeps holes' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* sparse" &&
+	truncate -s 8M sparse &&
+	dd if=/dev/urandom of=sparse bs=4k count=2 seek=1000 conv=notrunc \
+	  >/dev/null 2>&1 &&
+	for mode in pipeline=2 archive sync resume; do
+	    PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o sparse \
+	      -o $mode sparse . &&
+	    pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP sparse %h/sparse &&
+	    test $(du -k host0/sparse | cut -f1) -lt 1024 || return 1
+	done
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o verify copies files' '
+	HOSTS="host[0-3]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* dir" &&
+	mkdir dir &&
+	echo small >dir/small &&
+	create_random_file dir/big 300 &&
+	for mode in pipeline=1 pipeline=2 archive chain=2; do
+	    rm -rf host*/dir &&
+	    PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -r -o verify \
+	      -o $mode dir . &&
+	    pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP dir/big %h/dir/big &&
+	    pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP dir/small %h/dir/small ||
+	    return 1
+	done
+'
+test_expect_success 'pdcp -o verify is rejected with rpdcp' '
+	rpdcp -w foo -o verify /tmp/foo /tmp 2>&1 | grep "cannot be used"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o progress reports progress' '
+	HOSTS="host[0-1]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* testfile err" &&
+	create_random_file testfile 512 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o rate=400K \
+	  -o progress=1 -d testfile . 2>err &&
+	grep "progress: .*hosts done" err &&
+	grep "^Throughput:" err
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o streams splits files among connections' '
+	HOSTS="host[0-2]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* dir" &&
+	mkdir -p dir/a/b &&
+	for i in 1 2 3 4 5 6; do echo $i >dir/a/b/f$i || return 1; done &&
+	create_random_file dir/big 20000 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -r -p -o streams=3 \
+	  dir . &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP dir/big %h/dir/big &&
+	pdsh -SRexec -w "$HOSTS" diff -r dir %h/dir &&
+	test $(stat -c %Y dir/big) = $(stat -c %Y host2/dir/big)
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o streams -o sparse keeps holes within chunks' '
+	HOSTS="host[0-2]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* sparse" &&
+	truncate -s 20M sparse &&
+	dd if=/dev/urandom of=sparse bs=4k count=2 seek=2047 conv=notrunc \
+	  >/dev/null 2>&1 &&
+	dd if=/dev/urandom of=sparse bs=1 count=1 seek=12345678 conv=notrunc \
+	  >/dev/null 2>&1 &&
+	create_random_file host1/sparse 20480 &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o streams=3 \
+	  -o sparse sparse . &&
+	pdsh -SRexec -w "$HOSTS" $GIT_TEST_CMP sparse %h/sparse &&
+	test $(du -k host0/sparse | cut -f1) -lt 64 &&
+	test $(du -k host1/sparse | cut -f1) -lt 64
+'
+test_expect_success 'pdcp -o streams is rejected with -o chain' '
+	pdcp -w foo -o streams=2 -o chain /tmp/foo /tmp 2>&1 | 
+	  grep "cannot be used"
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o prealloc,direct,nocache,fsync copy files' '
+	HOSTS="host[0-2]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* dir" &&
+	mkdir dir &&
+	echo small >dir/small &&
+	create_random_file dir/big 300 &&
+	for mode in pipeline=2 archive; do
+	    rm -rf host*/dir &&
+	    PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -r -o prealloc \
+	      -o direct -o nocache -o $mode dir . &&
+	    pdsh -SRexec -w "$HOSTS" diff -r dir %h/dir || return 1
+	done &&
+	rm -rf host*/dir &&
+	PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -r -o fsync dir . &&
+	pdsh -SRexec -w "$HOSTS" diff -r dir %h/dir
+'
+test_expect_success DYNAMIC_MODULES,NOTROOT 'pdcp -o direct writes large files with O_DIRECT' '
+	HOSTS="host[0-1]"
+	setup_host_dirs "$HOSTS" &&
+	test_when_finished "rm -rf host* huge" &&
+	truncate -s 67121929 huge &&
+	dd if=/dev/urandom of=huge bs=4k count=2 seek=1023 conv=notrunc \
+	  >/dev/null 2>&1 &&
+	dd if=/dev/urandom of=huge bs=1 count=13065 seek=67108864 \
+	  conv=notrunc >/dev/null 2>&1 &&
+	for mode in pipeline=2 archive; do
+	    rm -f host*/huge &&
+	    PDSH_MODULE_DIR=$T pdcp -Rpcptest -w "$HOSTS" -o direct \
+	      -o $mode huge . &&
+	    pdsh -SRexec -w "$HOSTS" cmp huge %h/huge || return 1
+	done
+'
+test_expect_success 'pdcp -o fsync is rejected with rpdcp' '
+	rpdcp -w foo -o fsync /tmp/foo /tmp 2>&1 | grep "cannot be used"
+'
 test_done
@@ -0,0 +1,80 @@
+#!/bin/sh
+
+test_description='pdsh output modules
+
+Test the output/files and output/journal output sinks'
+
+. ${srcdir:-.}/test-lib.sh
+
+if ! test_have_prereq MOD_RCMD_EXEC; then
+	skip_all='skipping output module tests, exec module not available'
+	test_done
+fi
+
+test_expect_success MOD_OUTPUT_FILES 'files module writes one file per host' '
+	pdsh -Rexec -w foo[1-3] -D outdir echo %h >output &&
+	for h in foo1 foo2 foo3; do
+		echo $h >expected &&
+		test_cmp expected outdir/$h || return 1
+	done
+'
+test_expect_success MOD_OUTPUT_FILES 'files module does not disturb normal output' '
+	cat >expected <<-EOF &&
+	foo1: foo1
+	foo2: foo2
+	foo3: foo3
+	EOF
+	sort output >output.sorted &&
+	test_cmp expected output.sorted
+'
+test_expect_success MOD_OUTPUT_FILES 'files module appends to existing files' '
+	pdsh -Rexec -w foo1 -D outdir echo again >/dev/null &&
+	printf "foo1\nagain\n" >expected &&
+	test_cmp expected outdir/foo1
+'
+test_expect_success MOD_OUTPUT_FILES 'files module writes stderr to host.err' '
+	rm -rf outdir &&
+	pdsh -Rexec -w foo -D outdir sh -c "echo out; echo err >&2" >/dev/null 2>&1 &&
+	echo out >expected &&
+	test_cmp expected outdir/foo &&
+	echo err >expected &&
+	test_cmp expected outdir/foo.err
+'
+test_expect_success MOD_OUTPUT_FILES 'files module saves unterminated output' '
+	rm -rf outdir &&
+	pdsh -Rexec -w foo -D outdir printf "no newline" >/dev/null &&
+	printf "no newline" >expected &&
+	test_cmp expected outdir/foo
+'
+test_expect_success MOD_OUTPUT_FILES 'files module handles large output' '
+	rm -rf outdir &&
+	dd if=/dev/urandom bs=1024 count=512 2>/dev/null | base64 > testfile &&
+	pdsh -Rexec -w foo[1-4] -D outdir cat testfile >/dev/null &&
+	for h in foo1 foo2 foo3 foo4; do
+		test_cmp testfile outdir/$h || return 1
+	done
+'
+test_expect_success MOD_OUTPUT_FILES 'files module fails if directory is a file' '
+	touch notadir &&
+	test_must_fail pdsh -Rexec -w foo -D notadir echo foo
+'
+test_expect_success MOD_OUTPUT_JOURNAL 'journal module writes log and index' '
+	pdsh -Rexec -w foo[1-5] -J journal echo %h >/dev/null &&
+	test -s journal &&
+	test -s journal.idx &&
+	head -c 8 journal | grep PDSHJRNL &&
+	head -c 8 journal.idx | grep PDSHJIDX
+'
+test_expect_success MOD_OUTPUT_JOURNAL 'journal index has one entry per host' '
+	test $(wc -c <journal.idx) -eq $((16 + 5 * 64 + 16 * 4 + 24))
+'
+test_expect_success MOD_OUTPUT_FILES,MOD_OUTPUT_JOURNAL \
+	'multiple output modules may be used at once' '
+	rm -rf outdir journal* &&
+	OUTPUT=$(pdsh -Rexec -w foo -D outdir -J journal echo tee) &&
+	test "$OUTPUT" = "foo: tee" &&
+	echo tee >expected &&
+	test_cmp expected outdir/foo &&
+	test -s journal.idx
+'
+test_done
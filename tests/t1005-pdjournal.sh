@@ -0,0 +1,90 @@
+#!/bin/sh
+
+test_description='pdjournal
+
+Test queries of the output journal written by pdsh -J'
+
+. ${srcdir:-.}/test-lib.sh
+
+if ! test_have_prereq MOD_RCMD_EXEC; then
+	skip_all='skipping pdjournal tests, exec module not available'
+	test_done
+fi
+if ! test_have_prereq MOD_OUTPUT_JOURNAL; then
+	skip_all='skipping pdjournal tests, journal module not available'
+	test_done
+fi
+
+test_expect_success 'create journal' '
+	pdsh -Rexec -w foo[1-5] -J journal \
+	  sh -c "if test %h = foo3; then echo other; echo err >&2; exit 3; fi; \
+	         echo same; echo %h" >/dev/null 2>&1
+'
+test_expect_success 'pdjournal -w prints output of one host' '
+	printf "same\nfoo2\n" >expected &&
+	pdjournal -w foo2 journal >output &&
+	test_cmp expected output
+'
+test_expect_success 'pdjournal -w separates stdout and stderr' '
+	pdjournal -w foo3 journal >output 2>error &&
+	echo other >expected &&
+	test_cmp expected output &&
+	echo err >expected &&
+	test_cmp expected error
+'
+test_expect_success 'pdjournal -w fails for unknown host' '
+	test_must_fail pdjournal -w bar journal
+'
+test_expect_success 'pdjournal -l lists all hosts' '
+	test $(pdjournal -l journal | wc -l) -eq 5 &&
+	pdjournal -l journal | grep "^foo3  *3  *2  *10$"
+'
+test_expect_success 'pdjournal -e groups hosts by exit code' '
+	cat >expected <<-EOF &&
+	0: foo[1-2,4-5]
+	3: foo3
+	EOF
+	pdjournal -e journal >output &&
+	test_cmp expected output
+'
+test_expect_success 'pdjournal -r lists hosts with exit code' '
+	echo foo3 >expected &&
+	pdjournal -r 3 journal >output &&
+	test_cmp expected output
+'
+test_expect_success 'pdjournal -c coalesces identical output' '
+	pdsh -Rexec -w foo[1-5] -J journal2 \
+	  sh -c "test %h = foo3 && echo other || echo same" >/dev/null &&
+	cat >expected <<-EOF &&
+	----------------
+	foo[1-2,4-5]
+	----------------
+	same
+	----------------
+	foo3
+	----------------
+	other
+	EOF
+	pdjournal -c journal2 >output &&
+	test_cmp expected output
+'
+test_expect_success 'pdjournal reads output spanning many chunks' '
+	pdsh -Rexec -w foo -J journal3 seq 1 100000 >/dev/null &&
+	seq 1 100000 >expected &&
+	pdjournal -w foo journal3 >output &&
+	test_cmp expected output
+'
+test_expect_success 'pdjournal works without index trailer' '
+	head -c $((16 + 5 * 64)) journal.idx >journal4.idx &&
+	cp journal journal4 &&
+	printf "same\nfoo5\n" >expected &&
+	pdjournal -w foo5 journal4 >output &&
+	test_cmp expected output &&
+	test $(pdjournal -l journal4 | wc -l) -eq 5
+'
+test_expect_success 'pdjournal rejects a file that is not a journal' '
+	echo garbage >notjournal &&
+	echo garbage >notjournal.idx &&
+	test_must_fail pdjournal -l notjournal
+'
+test_done
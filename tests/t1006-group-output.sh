@@ -0,0 +1,90 @@
+#!/bin/sh
+
+test_description='pdsh grouped output
+
+Test -o group output ordering and spilling of buffered output'
+
+. ${srcdir:-.}/test-lib.sh
+
+if ! test_have_prereq MOD_RCMD_EXEC; then
+	skip_all='skipping grouped output tests, exec module not available'
+	test_done
+fi
+
+test_expect_success 'output of each host is printed together' '
+	pdsh -Rexec -w foo[1-3] -o group \
+	  sh -c "echo %h-1; sleep 0.%n; echo %h-2" >output &&
+	cat >expected <<-EOF &&
+	foo1: foo1-1
+	foo1: foo1-2
+	foo2: foo2-1
+	foo2: foo2-2
+	foo3: foo3-1
+	foo3: foo3-2
+	EOF
+	test_cmp expected output
+'
+test_expect_success 'hostlist order is kept when hosts finish out of order' '
+	pdsh -Rexec -w foo[1-4] -o group=hostlist \
+	  sh -c "sleep 0.\$((4 - %n)); echo %h" >output &&
+	cat >expected <<-EOF &&
+	foo1: foo1
+	foo2: foo2
+	foo3: foo3
+	foo4: foo4
+	EOF
+	test_cmp expected output
+'
+test_expect_success 'completion order prints hosts as they finish' '
+	pdsh -Rexec -w foo[1-4] -o group=completion \
+	  sh -c "sleep 0.\$((4 - %n))\$((4 - %n)); echo %h" >output &&
+	cat >expected <<-EOF &&
+	foo4: foo4
+	foo3: foo3
+	foo2: foo2
+	foo1: foo1
+	EOF
+	test_cmp expected output
+'
+test_expect_success 'grouped stderr is written to stderr' '
+	pdsh -Rexec -w foo[1-2] -o group \
+	  sh -c "echo out; echo err >&2" >output 2>error &&
+	printf "foo1: out\nfoo2: out\n" >expected &&
+	test_cmp expected output &&
+	printf "foo1: err\nfoo2: err\n" >expected &&
+	test_cmp expected error
+'
+test_expect_success 'grouped output honors -N' '
+	pdsh -Rexec -N -w foo[1-2] -o group echo %h >output &&
+	printf "foo1\nfoo2\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'grouped output keeps unterminated lines' '
+	pdsh -Rexec -w foo -o group printf foo >output &&
+	echo "foo: foo" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'grouped output spills to disk beyond memory limit' '
+	pdsh -Rexec -N -w foo[1-3] -o group -o group-memory=4k \
+	  seq 1 20000 >output &&
+	for i in 1 2 3; do seq 1 20000; done >expected &&
+	test_cmp expected output
+'
+test_expect_success 'grouped output works with no memory at all' '
+	pdsh -Rexec -w foo[1-3] -o group -o group-memory=0 echo %h >output &&
+	printf "foo1: foo1\nfoo2: foo2\nfoo3: foo3\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'invalid group order is rejected' '
+	test_must_fail pdsh -Rexec -w foo -o group=random true
+'
+test_expect_success 'invalid group-memory is rejected' '
+	test_must_fail pdsh -Rexec -w foo -o group-memory=lots true
+'
+test_expect_success 'unknown extended option is rejected' '
+	test_must_fail pdsh -Rexec -w foo -o nosuchoption true
+'
+test_expect_success '-o help lists extended options' '
+	pdsh -o help | grep group-memory
+'
+test_done
@@ -0,0 +1,93 @@
+#!/bin/sh
+
+test_description='pdsh output filter
+
+Test -o include, exclude, fields, delimiter and max-lines'
+
+. ${srcdir:-.}/test-lib.sh
+
+if ! test_have_prereq MOD_RCMD_EXEC; then
+	skip_all='skipping output filter tests, exec module not available'
+	test_done
+fi
+
+test_expect_success 'include prints only matching lines' '
+	pdsh -Rexec -w foo -o include="^b" \
+	  printf "abc\nbcd\ncde\nbxx\n" >output &&
+	printf "foo: bcd\nfoo: bxx\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'multiple include patterns match any' '
+	pdsh -Rexec -w foo -o include=abc -o include="^c" \
+	  printf "abc\nbcd\ncde\n" >output &&
+	printf "foo: abc\nfoo: cde\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'exclude drops matching lines' '
+	pdsh -Rexec -w foo -o exclude="c$" printf "abc\nbcd\nxyc\n" >output &&
+	printf "foo: bcd\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'exclude takes precedence over include' '
+	pdsh -Rexec -w foo -o include=b -o exclude=d \
+	  printf "abc\nbcd\ncde\n" >output &&
+	printf "foo: abc\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'fields selects blank separated fields' '
+	pdsh -Rexec -w foo -o fields=1,3- \
+	  printf "  a  b\tc d\none\n" >output &&
+	printf "foo: a c d\nfoo: one\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'fields with delimiter' '
+	pdsh -Rexec -w foo -o fields=-2,4 -o delimiter=: \
+	  echo "a:b::d:e" >output &&
+	echo "foo: a:b:d" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'fields applies after include' '
+	pdsh -Rexec -w foo -o include="^x" -o fields=2 \
+	  printf "x 1\ny 2\nx 3\n" >output &&
+	printf "foo: 1\nfoo: 3\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'max-lines limits output of each host' '
+	pdsh -Rexec -w foo[1-2] -o max-lines=2 -o group \
+	  printf "1\n2\n3\n" >output &&
+	printf "foo1: 1\nfoo1: 2\nfoo2: 1\nfoo2: 2\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'max-lines counts only printed lines' '
+	pdsh -Rexec -w foo -o max-lines=1 -o include=b \
+	  printf "a\nb1\nb2\n" >output &&
+	printf "foo: b1\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'filter does not apply to stderr' '
+	pdsh -Rexec -w foo -o include=none \
+	  sh -c "echo out; echo err >&2" >output 2>error &&
+	test_must_fail test -s output &&
+	echo "foo: err" >expected &&
+	test_cmp expected error
+'
+test_expect_success 'filter does not affect -S return code' '
+	test_expect_code 3 pdsh -S -Rexec -w foo -o exclude=. \
+	  sh -c "echo hi; exit 3" >output &&
+	test_must_fail test -s output
+'
+test_expect_success 'invalid regex is an error' '
+	test_must_fail pdsh -Rexec -w foo -o include="a[" echo a 2>err &&
+	grep "Error matching output pattern" err
+'
+test_expect_success 'invalid field list is an error' '
+	test_must_fail pdsh -Rexec -w foo -o fields=3-1 echo a 2>err &&
+	grep "Invalid field list" err &&
+	test_must_fail pdsh -Rexec -w foo -o fields=1, echo a &&
+	test_must_fail pdsh -Rexec -w foo -o fields=x echo a
+'
+test_expect_success 'invalid max-lines is an error' '
+	test_must_fail pdsh -Rexec -w foo -o max-lines=x echo a 2>err &&
+	grep "invalid number of lines" err
+'
+test_done
@@ -38,4 +38,17 @@ test_expect_success 'exec cmd susbstitution works interactive mode' '
 test_debug '
 	echo Output: $OUTPUT
 '
+test_expect_success 'labels strip domain only if all hosts share it' '
+	pdsh -Rexec -w foo.a,bar.a echo x | sort >output &&
+	printf "bar: x\nfoo: x\n" >expected &&
+	test_cmp expected output &&
+	pdsh -Rexec -w foo.a,bar.b echo x | sort >output &&
+	printf "bar.b: x\nfoo.a: x\n" >expected &&
+	test_cmp expected output
+'
+test_expect_success 'long lines are written whole with labels' '
+	pdsh -Rexec -w foo[1-4] sh -c "printf \"%%05000d\n\" 0; printf %h" >output &&
+	test $(grep -c "^foo[1-4]: 00000*$" output) -eq 4 &&
+	test $(grep -c "^foo[1-4]: foo[1-4]$" output) -eq 4
+'
 test_done
@@ -75,6 +75,7 @@ struct pdsh_module pdsh_module_info = {
   &a_module_ops,
   &a_rcmd_ops,
   &a_module_options[0],
+  NULL,
 };
 
 static int opt_a(opt_t *pdsh_opt, int opt, char *arg)
@@ -37,6 +37,7 @@
 
 
 #include <sys/wait.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -98,6 +99,7 @@ struct pdsh_module pdsh_module_info = {
   &pcptest_module_ops,
   &pcptest_rcmd_ops,
   &pcptest_module_options[0],
+  NULL,
 };
 
 
@@ -119,6 +121,16 @@ static int pcptest_init(opt_t * opt)
     if ((geteuid() == 0) && (getuid() != 0))
         setuid (getuid ());
 
+    /*
+     *  Remember the directory holding the "host" directories, for
+     *   a pdcp run from within one of them (-o chain)
+     */
+    if (!getenv ("PCPTEST_ROOT")) {
+        char dir[4096];
+        if (getcwd (dir, sizeof (dir)))
+            setenv ("PCPTEST_ROOT", dir, 1);
+    }
+
     /*
      *  Do not resolve hostnames in pdsh when using pcptest
      */
@@ -147,7 +159,7 @@ static char **pcptest_argv_create (char *remote_cmd)
     /*  Prepend chdir to remote argv, then collapse args
      *   so they can be fed to /bin/sh -c
      */
-    cmd = Strdup ("cd %h; ");
+    cmd = Strdup ("cd \"$PCPTEST_ROOT\"/%h; ");
     xstrcat (&cmd, remote_cmd);
 
     argv = Malloc (4 * sizeof (char *));